@@ -0,0 +1,403 @@
+﻿#include "BlockCache.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+
+// 定义全局的块缓存
+BlockCache blockCache;
+
+void BlockCache::attach(BlockDevice* device, size_t capacityBytes) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        device_ = device;
+        blockSize_ = static_cast<size_t>(device->blockSize());
+        capacity_ = blockSize_ == 0 ? 0 : std::min(std::max(capacityBytes / blockSize_, MIN_FRAMES), static_cast<size_t>(device->blockCount()));
+        // 只分配不初始化，实际用到的帧才占用物理内存
+        frames_.reset(capacity_ > 0 ? new char[capacity_ * blockSize_] : nullptr);
+        frameInfo_.assign(capacity_, Frame());
+        index_.clear();
+        index_.reserve(capacity_);
+        stats_ = BlockCacheStats();
+    }
+    clear();
+}
+
+void BlockCache::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    index_.clear();
+    cold_ = FrameList();
+    hot_ = FrameList();
+    freeFrames_.clear();
+    dirtyFrames_.clear();
+    pinnedFrames_.clear();
+    fences_.clear();
+    for (size_t frame = capacity_; frame-- > 0;) {
+        frameInfo_[frame] = Frame();
+        freeFrames_.push_back(static_cast<int>(frame));
+    }
+}
+
+int BlockCache::lookup(int block) const {
+    auto it = index_.find(block);
+    return it == index_.end() ? -1 : it->second;
+}
+
+void BlockCache::unlink(int frame) {
+    Frame& info = frameInfo_[frame];
+    FrameList& list = info.hot ? hot_ : cold_;
+    (info.prev >= 0 ? frameInfo_[info.prev].next : list.head) = info.next;
+    (info.next >= 0 ? frameInfo_[info.next].prev : list.tail) = info.prev;
+    info.prev = info.next = -1;
+}
+
+void BlockCache::append(FrameList& list, int frame) {
+    Frame& info = frameInfo_[frame];
+    info.hot = &list == &hot_;
+    info.prev = list.tail;
+    info.next = -1;
+    (list.tail >= 0 ? frameInfo_[list.tail].next : list.head) = frame;
+    list.tail = frame;
+}
+
+// 再次访问的帧移到热链表末尾
+void BlockCache::touch(int frame) {
+    unlink(frame);
+    append(hot_, frame);
+}
+
+void BlockCache::markDirty(int frame) {
+    Frame& info = frameInfo_[frame];
+    info.dirty = true;
+    if (!info.listed) {
+        info.listed = true;
+        dirtyFrames_.push_back(frame);
+    }
+}
+
+// 先找冷链表，再找热链表，各自从表头（最久未访问）开始跳过钉住的帧
+int BlockCache::findVictim() const {
+    for (const FrameList* list : { &cold_, &hot_ }) {
+        for (int frame = list->head; frame >= 0; frame = frameInfo_[frame].next) {
+            if (frameInfo_[frame].pin == 0) {
+                return frame;
+            }
+        }
+    }
+    return -1;
+}
+
+int BlockCache::install(int block) {
+    if (freeFrames_.empty()) {
+        // 淘汰最久未访问的未钉住的冷块（没有则取热块）
+        int victim = findVictim();
+        if (victim < 0) {
+            return -1;
+        }
+        if (frameInfo_[victim].dirty && !writeBack(victim)) {
+            return -1;
+        }
+        release(victim);
+        stats_.evictions++;
+    }
+    int frame = freeFrames_.back();
+    freeFrames_.pop_back();
+    frameInfo_[frame].block = block;
+    frameInfo_[frame].dirty = false;
+    append(cold_, frame);
+    index_[block] = frame;
+    return frame;
+}
+
+bool BlockCache::writeBack(int frame) {
+    Frame& info = frameInfo_[frame];
+    if (!device_->writeBlock(info.block, frameData(frame), 0, blockSize_)) {
+        std::cerr << "Failed to write back block: " << info.block << std::endl;
+        return false;
+    }
+    info.dirty = false;
+    stats_.writebacks++;
+    return true;
+}
+
+void BlockCache::release(int frame) {
+    unlink(frame);
+    Frame& info = frameInfo_[frame];
+    index_.erase(info.block);
+    // 帧号可能还在脏帧列表中，保留标记，重新使用时不会重复加入
+    bool listed = info.listed;
+    info = Frame();
+    info.listed = listed;
+    freeFrames_.push_back(frame);
+}
+
+// 直接读写磁盘：起始块可以从块中间开始，之后的块整块连续
+static bool deviceRead(BlockDevice& device, int block, char* buffer, size_t offset, size_t length) {
+    size_t blockSize = static_cast<size_t>(device.blockSize());
+    if (offset + length <= blockSize) {
+        return device.readBlock(block, buffer, offset, length);
+    }
+    size_t head = blockSize - offset;
+    return device.readBlock(block, buffer, offset, head)
+        && device.readBlocks(block + 1, buffer + head, length - head);
+}
+
+static bool deviceWrite(BlockDevice& device, int block, const char* data, size_t offset, size_t length) {
+    size_t blockSize = static_cast<size_t>(device.blockSize());
+    if (offset + length <= blockSize) {
+        return device.writeBlock(block, data, offset, length);
+    }
+    size_t head = blockSize - offset;
+    return device.writeBlock(block, data, offset, head)
+        && device.writeBlocks(block + 1, data + head, length - head);
+}
+
+bool BlockCache::read(int block, char* buffer, size_t offset, size_t length) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (!device_ || length == 0) {
+        return device_ != nullptr;
+    }
+    const size_t end = offset + length;
+    const size_t blocks = (end + blockSize_ - 1) / blockSize_;
+    // 块 i 中与 [offset, end) 相交的部分复制到 buffer
+    auto copyOut = [&](size_t i, const char* source) {
+        size_t from = std::max(offset, i * blockSize_);
+        size_t to = std::min(end, (i + 1) * blockSize_);
+        std::memcpy(buffer + (from - offset), source + (from - i * blockSize_), to - from);
+    };
+
+    if (capacity_ == 0 || blocks > bypassBlocks()) {
+        // 大段读取不进入缓存，已缓存的块可能比磁盘上的新，覆盖上去。
+        // 在锁外读盘；期间别的读者淘汰并写回了脏块时，它已不在缓存里而读到的可能是旧内容，在锁内重读
+        uint64_t writebacks = stats_.writebacks;
+        lock.unlock();
+        bool ok = deviceRead(*device_, block, buffer, offset, length);
+        lock.lock();
+        if (ok && stats_.writebacks != writebacks) {
+            ok = deviceRead(*device_, block, buffer, offset, length);
+        }
+        if (!ok) {
+            return false;
+        }
+        for (size_t i = 0; i < blocks; ++i) {
+            int frame = lookup(block + static_cast<int>(i));
+            if (frame >= 0) {
+                copyOut(i, frameData(frame));
+            }
+        }
+        stats_.misses += blocks;
+        return true;
+    }
+
+    // 合并读取用的缓冲区，每个线程一份
+    static thread_local std::vector<char> scratch;
+    size_t i = 0;
+    while (i < blocks) {
+        int frame = lookup(block + static_cast<int>(i));
+        if (frame >= 0) {
+            stats_.hits++;
+            touch(frame);
+            copyOut(i, frameData(frame));
+            ++i;
+            continue;
+        }
+        // 连续未命中的块用一次读取装入。它们不在缓存中，磁盘上就是最新内容；
+        // 写这些块的线程持有所属 inode 的独占锁，与读者互斥，可以在锁外读盘
+        size_t j = i + 1;
+        while (j < blocks && lookup(block + static_cast<int>(j)) < 0) {
+            ++j;
+        }
+        size_t count = j - i;
+        stats_.misses += count;
+        scratch.resize(count * blockSize_);
+        lock.unlock();
+        if (!device_->readBlocks(block + static_cast<int>(i), scratch.data(), count * blockSize_)) {
+            return false;
+        }
+        for (size_t k = i; k < j; ++k) {
+            copyOut(k, scratch.data() + (k - i) * blockSize_);
+        }
+        lock.lock();
+        for (size_t k = i; k < j; ++k) {
+            // 期间别的读者可能已经装入；全部帧都被钉住时不缓存
+            if (lookup(block + static_cast<int>(k)) < 0) {
+                frame = install(block + static_cast<int>(k));
+                if (frame >= 0) {
+                    std::memcpy(frameData(frame), scratch.data() + (k - i) * blockSize_, blockSize_);
+                }
+            }
+        }
+        i = j;
+    }
+    return true;
+}
+
+bool BlockCache::write(int block, const char* data, size_t offset, size_t length, uint64_t pin) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!device_ || length == 0) {
+        return device_ != nullptr;
+    }
+    const size_t end = offset + length;
+    const size_t blocks = (end + blockSize_ - 1) / blockSize_;
+
+    // 范围内有需要钉住的块时不能直接写盘
+    bool fenced = false;
+    for (size_t i = 0; i < blocks && !fences_.empty() && !fenced; ++i) {
+        fenced = fenceOf(block + static_cast<int>(i)) != 0;
+    }
+    if (capacity_ == 0 || (blocks > bypassBlocks() && pin == 0 && !fenced)) {
+        // 大段写入直接写盘，已缓存的块同步更新
+        if (!deviceWrite(*device_, block, data, offset, length)) {
+            return false;
+        }
+        for (size_t i = 0; i < blocks; ++i) {
+            int frame = lookup(block + static_cast<int>(i));
+            if (frame >= 0) {
+                size_t from = std::max(offset, i * blockSize_);
+                size_t to = std::min(end, (i + 1) * blockSize_);
+                std::memcpy(frameData(frame) + (from - i * blockSize_), data + (from - offset), to - from);
+            }
+        }
+        return true;
+    }
+
+    for (size_t i = 0; i < blocks; ++i) {
+        int current = block + static_cast<int>(i);
+        size_t from = std::max(offset, i * blockSize_);
+        size_t to = std::min(end, (i + 1) * blockSize_);
+        int frame = lookup(current);
+        if (frame >= 0) {
+            stats_.hits++;
+            touch(frame);
+        }
+        else {
+            stats_.misses++;
+            frame = install(current);
+            if (frame < 0) {
+                std::cerr << "All cached blocks are pinned by the journal." << std::endl;
+                return false;
+            }
+            // 只写块的一部分时先读入原内容
+            if (to - from < blockSize_ && !device_->readBlock(current, frameData(frame), 0, blockSize_)) {
+                release(frame);
+                return false;
+            }
+        }
+        std::memcpy(frameData(frame) + (from - i * blockSize_), data + (from - offset), to - from);
+        markDirty(frame);
+        uint64_t framePin = fenced ? std::max(pin, fenceOf(current)) : pin;
+        if (framePin != 0) {
+            if (frameInfo_[frame].pin == 0) {
+                pinnedFrames_.push_back(frame);
+            }
+            frameInfo_[frame].pin = std::max(frameInfo_[frame].pin, framePin);
+        }
+    }
+    return true;
+}
+
+void BlockCache::unpin(uint64_t committed) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t kept = 0;
+    for (int frame : pinnedFrames_) {
+        Frame& info = frameInfo_[frame];
+        if (info.pin > committed) {
+            pinnedFrames_[kept++] = frame;
+        }
+        else {
+            info.pin = 0;
+        }
+    }
+    pinnedFrames_.resize(kept);
+    for (auto it = fences_.begin(); it != fences_.end();) {
+        it = it->second <= committed ? fences_.erase(it) : std::next(it);
+    }
+}
+
+bool BlockCache::hasFences() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return !fences_.empty();
+}
+
+bool BlockCache::isFenced(int block) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return fenceOf(block) != 0;
+}
+
+bool BlockCache::mostlyPinned() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return pinnedFrames_.size() * 2 >= capacity_;
+}
+
+BlockCacheStats BlockCache::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+uint64_t BlockCache::fenceOf(int block) const {
+    auto it = fences_.find(block);
+    return it == fences_.end() ? 0 : it->second;
+}
+
+bool BlockCache::flush() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // 只看脏帧列表，代价与脏帧数成正比；已经干净的帧移出列表，钉住的留待下次
+    std::vector<std::pair<int, int>> dirty; // (块号, 帧号)
+    size_t kept = 0;
+    for (int frame : dirtyFrames_) {
+        Frame& info = frameInfo_[frame];
+        if (!info.dirty) {
+            info.listed = false;
+            continue;
+        }
+        dirtyFrames_[kept++] = frame;
+        if (info.pin == 0) {
+            dirty.emplace_back(info.block, frame);
+        }
+    }
+    dirtyFrames_.resize(kept);
+    std::sort(dirty.begin(), dirty.end());
+    bool ok = true;
+    size_t i = 0;
+    while (i < dirty.size()) {
+        // 物理相邻的脏块合并成一次写
+        size_t j = i + 1;
+        while (j < dirty.size() && dirty[j].first == dirty[j - 1].first + 1) {
+            ++j;
+        }
+        bool written;
+        if (j - i == 1) {
+            written = device_->writeBlock(dirty[i].first, frameData(dirty[i].second), 0, blockSize_);
+        }
+        else {
+            flushBuffer_.resize((j - i) * blockSize_);
+            for (size_t k = i; k < j; ++k) {
+                std::memcpy(flushBuffer_.data() + (k - i) * blockSize_, frameData(dirty[k].second), blockSize_);
+            }
+            written = device_->writeBlocks(dirty[i].first, flushBuffer_.data(), flushBuffer_.size());
+        }
+        if (written) {
+            for (size_t k = i; k < j; ++k) {
+                frameInfo_[dirty[k].second].dirty = false;
+            }
+            stats_.writebacks += j - i;
+        }
+        else {
+            std::cerr << "Failed to write back blocks from: " << dirty[i].first << std::endl;
+            ok = false;
+        }
+        i = j;
+    }
+    return ok;
+}
+
+void BlockCache::discard(int block, uint64_t pin) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    int frame = lookup(block);
+    if (frame >= 0) {
+        release(frame);
+    }
+    if (pin != 0) {
+        fences_[block] = pin;
+    }
+}
@@ -0,0 +1,117 @@
+﻿#pragma once
+#include "BlockDevice.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// 块缓存的命中统计
+struct BlockCacheStats {
+    uint64_t hits = 0;         // 命中的块访问次数
+    uint64_t misses = 0;       // 未命中、需要读盘的块访问次数
+    uint64_t evictions = 0;    // 淘汰的块数
+    uint64_t writebacks = 0;   // 写回磁盘的脏块数
+};
+
+// 块缓存：文件系统与虚拟磁盘之间的定长缓冲区，按近似 LRU-2 的两个链表淘汰：只访问过一次的块
+// 在冷链表中先淘汰，再次访问时移到热链表，一次性的顺序扫描不会挤掉反复读取的热块。
+// 两个链表都是按帧号串起来的侵入式双向链表，命中时 O(1) 移动，不分配内存。
+// 写入只标记脏块并记入脏帧列表，淘汰或 sync 时写回，sync 只看脏帧，把物理相邻的脏块合并成一次写。
+// 超过容量 1/8 或超过 BYPASS_BYTES 的大段读写（流式句柄的预读和合并写）直接访问磁盘，
+// 只与已缓存的块保持一致，不占用缓存。
+// 记入预写日志的块（目录数据）写入时带上事务序号被钉住，日志提交到该序号之前不会写回或淘汰；
+// 被尚未提交的事务释放的块重新分配后也被钉住，否则崩溃后释放没有生效，原主人的内容却已被覆盖。
+// 内部加锁，读写可以来自多个线程，未命中时在锁外读盘；同一块的读者和写者由所属 inode 的锁互斥。
+// 全部帧都被钉住时写入失败，调用者应在开始事务前检查 mostlyPinned 并先提交日志
+class BlockCache {
+public:
+    // 挂接块设备并按字节容量分配缓存帧，原有内容直接丢弃
+    void attach(BlockDevice* device, size_t capacityBytes);
+    // 丢弃全部缓存内容（不写回）
+    void clear();
+
+    // 从块 block 的 offset 处读取 length 字节，可以延续到之后物理连续的块
+    bool read(int block, char* buffer, size_t offset, size_t length);
+    // 向块 block 的 offset 处写入 length 字节，可以延续到之后物理连续的块。
+    // pin 不为 0 时写入的块在 unpin(pin) 之前不会写回磁盘
+    bool write(int block, const char* data, size_t offset, size_t length, uint64_t pin = 0);
+    // 写回全部未钉住的脏块
+    bool flush();
+    // 日志已提交到序号 committed，解除不超过它的钉住
+    void unpin(uint64_t committed);
+    // 块被释放时调用，丢弃缓存内容，脏数据不再写回。
+    // pin 为释放它的事务序号，之后写入这个块的数据在 unpin(pin) 之前不会写回磁盘
+    void discard(int block, uint64_t pin = 0);
+    // 块是否被尚未提交的事务释放过
+    bool hasFences() const;
+    bool isFenced(int block) const;
+    // 被钉住的帧是否已经占了一半缓存
+    bool mostlyPinned() const;
+
+    BlockCacheStats stats() const;
+    size_t capacity() const { return capacity_; }
+
+private:
+    // 缓存帧
+    struct Frame {
+        int block = -1;        // 缓存的物理块号，-1 为空闲帧
+        bool dirty = false;    // 是否有未写回的修改
+        bool hot = false;      // 在热链表（访问过两次以上）中
+        bool listed = false;   // 帧号在脏帧列表中
+        int prev = -1;         // 所在淘汰链表中的前一帧
+        int next = -1;         // 所在淘汰链表中的后一帧
+        uint64_t pin = 0;      // 钉住它的事务序号，0 表示未钉住
+    };
+    // 淘汰链表：表头最先淘汰
+    struct FrameList {
+        int head = -1;
+        int tail = -1;
+    };
+
+    char* frameData(int frame) { return frames_.get() + static_cast<size_t>(frame) * blockSize_; }
+    // 块所在的帧，不在缓存中返回 -1
+    int lookup(int block) const;
+    // 记录一次访问
+    void touch(int frame);
+    void unlink(int frame);
+    void append(FrameList& list, int frame);
+    // 标记帧为脏并记入脏帧列表
+    void markDirty(int frame);
+    // 为 block 分配一帧（必要时淘汰），内容未初始化。
+    // 全部帧都被钉住时返回 -1（读取时不缓存即可）
+    int install(int block);
+    // 按淘汰顺序找第一个未钉住的帧，没有返回 -1
+    int findVictim() const;
+    // 写入 block 时至少要带的钉住序号（释放它的事务尚未提交时）
+    uint64_t fenceOf(int block) const;
+    bool writeBack(int frame);
+    void release(int frame);
+    // 块数超过这个值的读写直接访问磁盘
+    size_t bypassBlocks() const { return std::min(capacity_ / 8 + 1, BYPASS_BYTES / blockSize_); }
+
+    static constexpr size_t BYPASS_BYTES = 128 << 10;
+    // 至少保留的帧数：钉住的块必须留在缓存里，缓存不能完全关闭
+    static constexpr size_t MIN_FRAMES = 16;
+
+    BlockDevice* device_ = nullptr;
+    size_t blockSize_ = 0;
+    size_t capacity_ = 0;                        // 帧数
+    std::unique_ptr<char[]> frames_;             // 所有帧的数据区
+    std::vector<Frame> frameInfo_;
+    std::vector<int> freeFrames_;
+    std::unordered_map<int, int> index_;         // 块号 -> 帧号
+    FrameList cold_;                             // 只访问过一次的帧，按最近访问排列
+    FrameList hot_;                              // 访问过两次以上的帧，按最近访问排列
+    std::vector<int> dirtyFrames_;               // 可能有脏数据的帧（含已写回、已释放的，flush 时清理）
+    std::vector<char> flushBuffer_;              // flush 合并写用的缓冲区
+    std::vector<int> pinnedFrames_;              // 可能被钉住的帧
+    std::unordered_map<int, uint64_t> fences_;   // 被尚未提交的事务释放的块 -> 事务序号
+    BlockCacheStats stats_;
+    mutable std::mutex mutex_;
+};
+
+// 全局的块缓存
+extern BlockCache blockCache;
@@ -0,0 +1,196 @@
+﻿#include "BlockDevice.h"
+#include <iostream>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+
+// 定义全局的虚拟磁盘
+BlockDevice disk;
+
+BlockDevice::~BlockDevice() {
+    close();
+}
+
+bool BlockDevice::create(const std::string& path, int blockSize, int blockCount) {
+    close();
+    if (blockSize <= 0 || blockCount <= 0 || !openHandle(path, true)) {
+        return false;
+    }
+    blockSize_ = blockSize;
+    blockCount_ = blockCount;
+    int64_t imageSize = static_cast<int64_t>(blockSize) * blockCount;
+    // 预分配整个镜像，后续写入不会再改变文件大小
+#ifdef _WIN32
+    LARGE_INTEGER size;
+    size.QuadPart = imageSize;
+    bool ok = SetFilePointerEx(handle_, size, nullptr, FILE_BEGIN) && SetEndOfFile(handle_);
+#else
+    bool ok = ::posix_fallocate(fd_, 0, imageSize) == 0 || ::ftruncate(fd_, imageSize) == 0;
+#endif
+    if (!ok) {
+        std::cerr << "Failed to preallocate disk image: " << path << std::endl;
+        close();
+    }
+    return ok;
+}
+
+bool BlockDevice::open(const std::string& path, int blockSize, int blockCount) {
+    close();
+    if (blockSize <= 0 || blockCount <= 0 || !openHandle(path, false)) {
+        return false;
+    }
+    blockSize_ = blockSize;
+    blockCount_ = blockCount;
+    return true;
+}
+
+void BlockDevice::close() {
+#ifdef _WIN32
+    if (handle_) {
+        CloseHandle(handle_);
+        handle_ = nullptr;
+    }
+#else
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+#endif
+    blockSize_ = 0;
+    blockCount_ = 0;
+}
+
+bool BlockDevice::isOpen() const {
+#ifdef _WIN32
+    return handle_ != nullptr;
+#else
+    return fd_ >= 0;
+#endif
+}
+
+bool BlockDevice::readBlock(int block, char* buffer, size_t offset, size_t length) const {
+    if (!checkRange(block, offset, length)) {
+        return false;
+    }
+    return pread(buffer, length, static_cast<int64_t>(block) * blockSize_ + offset);
+}
+
+bool BlockDevice::writeBlock(int block, const char* data, size_t offset, size_t length) {
+    if (!checkRange(block, offset, length)) {
+        return false;
+    }
+    return pwrite(data, length, static_cast<int64_t>(block) * blockSize_ + offset);
+}
+
+bool BlockDevice::readBlocks(int firstBlock, char* buffer, size_t length) const {
+    if (!checkSpan(firstBlock, length)) {
+        return false;
+    }
+    return pread(buffer, length, static_cast<int64_t>(firstBlock) * blockSize_);
+}
+
+bool BlockDevice::writeBlocks(int firstBlock, const char* data, size_t length) {
+    if (!checkSpan(firstBlock, length)) {
+        return false;
+    }
+    return pwrite(data, length, static_cast<int64_t>(firstBlock) * blockSize_);
+}
+
+bool BlockDevice::flush() {
+    if (!isOpen()) {
+        return false;
+    }
+#ifdef _WIN32
+    return FlushFileBuffers(handle_) != 0;
+#else
+    return ::fsync(fd_) == 0;
+#endif
+}
+
+bool BlockDevice::openHandle(const std::string& path, bool truncate) {
+#ifdef _WIN32
+    HANDLE h = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr,
+        truncate ? CREATE_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (h == INVALID_HANDLE_VALUE) {
+        std::cerr << "Failed to open disk image: " << path << std::endl;
+        return false;
+    }
+    handle_ = h;
+#else
+    int flags = O_RDWR | (truncate ? (O_CREAT | O_TRUNC) : 0);
+    fd_ = ::open(path.c_str(), flags, 0644);
+    if (fd_ < 0) {
+        std::cerr << "Failed to open disk image: " << path << std::endl;
+        return false;
+    }
+#endif
+    return true;
+}
+
+bool BlockDevice::checkRange(int block, size_t offset, size_t length) const {
+    if (!isOpen() || block < 0 || block >= blockCount_ || offset + length > static_cast<size_t>(blockSize_)) {
+        std::cerr << "Block access out of range: " << block << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool BlockDevice::checkSpan(int firstBlock, size_t length) const {
+    int64_t blocks = (static_cast<int64_t>(length) + blockSize_ - 1) / blockSize_;
+    if (!isOpen() || firstBlock < 0 || firstBlock + blocks > blockCount_) {
+        std::cerr << "Block span out of range: " << firstBlock << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool BlockDevice::pread(char* buffer, size_t length, int64_t position) const {
+    while (length > 0) {
+#ifdef _WIN32
+        OVERLAPPED ov = {};
+        ov.Offset = static_cast<DWORD>(position);
+        ov.OffsetHigh = static_cast<DWORD>(position >> 32);
+        DWORD done = 0;
+        if (!ReadFile(handle_, buffer, static_cast<DWORD>(length), &done, &ov) || done == 0) {
+            return false;
+        }
+#else
+        ssize_t done = ::pread(fd_, buffer, length, position);
+        if (done <= 0) {
+            return false;
+        }
+#endif
+        buffer += done;
+        length -= done;
+        position += done;
+    }
+    return true;
+}
+
+bool BlockDevice::pwrite(const char* data, size_t length, int64_t position) {
+    while (length > 0) {
+#ifdef _WIN32
+        OVERLAPPED ov = {};
+        ov.Offset = static_cast<DWORD>(position);
+        ov.OffsetHigh = static_cast<DWORD>(position >> 32);
+        DWORD done = 0;
+        if (!WriteFile(handle_, data, static_cast<DWORD>(length), &done, &ov) || done == 0) {
+            return false;
+        }
+#else
+        ssize_t done = ::pwrite(fd_, data, length, position);
+        if (done <= 0) {
+            return false;
+        }
+#endif
+        data += done;
+        length -= done;
+        position += done;
+    }
+    return true;
+}
@@ -0,0 +1,54 @@
+﻿#pragma once
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+// 虚拟块设备：一个预分配的磁盘镜像文件，按固定块大小划分，
+// 所有文件内容都以块为单位通过定位读写（pread/pwrite）存取
+class BlockDevice {
+public:
+    BlockDevice() = default;
+    ~BlockDevice();
+    BlockDevice(const BlockDevice&) = delete;
+    BlockDevice& operator=(const BlockDevice&) = delete;
+
+    // 创建镜像文件并预分配 blockSize * blockCount 字节（已存在则覆盖）
+    bool create(const std::string& path, int blockSize, int blockCount);
+    // 打开已有的镜像文件
+    bool open(const std::string& path, int blockSize, int blockCount);
+    // 关闭镜像文件
+    void close();
+    bool isOpen() const;
+
+    // 从块 block 的 offset 处读取 length 字节
+    bool readBlock(int block, char* buffer, size_t offset, size_t length) const;
+    // 向块 block 的 offset 处写入 length 字节
+    bool writeBlock(int block, const char* data, size_t offset, size_t length);
+    // 从块 firstBlock 起读取 length 字节，可以跨越多个物理连续的块
+    bool readBlocks(int firstBlock, char* buffer, size_t length) const;
+    // 从块 firstBlock 起写入 length 字节，可以跨越多个物理连续的块
+    bool writeBlocks(int firstBlock, const char* data, size_t length);
+    // 将镜像内容刷到磁盘
+    bool flush();
+
+    int blockSize() const { return blockSize_; }
+    int blockCount() const { return blockCount_; }
+
+private:
+    bool openHandle(const std::string& path, bool truncate);
+    bool checkRange(int block, size_t offset, size_t length) const;
+    bool checkSpan(int firstBlock, size_t length) const;
+    bool pread(char* buffer, size_t length, int64_t position) const;
+    bool pwrite(const char* data, size_t length, int64_t position);
+
+#ifdef _WIN32
+    void* handle_ = nullptr;   // Windows 文件句柄
+#else
+    int fd_ = -1;              // POSIX 文件描述符
+#endif
+    int blockSize_ = 0;        // 块大小（字节）
+    int blockCount_ = 0;       // 块数量
+};
+
+// 全局的虚拟磁盘
+extern BlockDevice disk;
@@ -0,0 +1,121 @@
+﻿#pragma once
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// 按 CLOCK（二次机会）淘汰的定容缓存：命中时只置访问位，满时指针转过带访问位的项并清掉访问位，
+// 淘汰遇到的第一个没有访问位的项。每次只淘汰一项，热项不会随一次大范围扫描全部丢失。
+// 本身不加锁：find 只读（访问位是原子的），可以在调用者的共享锁下并发调用；其余操作需要独占
+template <typename Key, typename Value>
+class ClockCache {
+public:
+    explicit ClockCache(size_t capacity) : capacity_(capacity) {}
+
+    // 查找并置访问位，不在缓存中返回空指针
+    const Value* find(const Key& key) const {
+        auto it = index_.find(key);
+        if (it == index_.end()) {
+            return nullptr;
+        }
+        const Slot& slot = slots_[it->second];
+        slot.referenced.store(true, std::memory_order_relaxed);
+        return &slot.value;
+    }
+
+    // 放入或替换，已满时先淘汰一项
+    void insert(const Key& key, Value value) {
+        auto it = index_.find(key);
+        if (it != index_.end()) {
+            slots_[it->second].value = std::move(value);
+            return;
+        }
+        size_t index;
+        if (!free_.empty()) {
+            index = free_.back();
+            free_.pop_back();
+        }
+        else if (slots_.size() < capacity_) {
+            index = slots_.size();
+            slots_.emplace_back();
+        }
+        else {
+            index = victim();
+            index_.erase(slots_[index].key);
+        }
+        Slot& slot = slots_[index];
+        slot.key = key;
+        slot.value = std::move(value);
+        slot.used = true;
+        slot.referenced.store(false, std::memory_order_relaxed);
+        index_.emplace(key, index);
+    }
+
+    // 删除一项，不存在返回 false
+    bool erase(const Key& key) {
+        auto it = index_.find(key);
+        if (it == index_.end()) {
+            return false;
+        }
+        release(it->second);
+        index_.erase(it);
+        return true;
+    }
+
+    // 删除 predicate(key, value) 为真的全部项
+    template <typename Predicate>
+    void eraseIf(Predicate predicate) {
+        for (auto it = index_.begin(); it != index_.end();) {
+            if (predicate(it->first, static_cast<const Value&>(slots_[it->second].value))) {
+                release(it->second);
+                it = index_.erase(it);
+            }
+            else {
+                ++it;
+            }
+        }
+    }
+
+    void clear() {
+        index_.clear();
+        slots_.clear();
+        free_.clear();
+        hand_ = 0;
+    }
+
+    size_t size() const { return index_.size(); }
+
+private:
+    struct Slot {
+        Key key{};
+        Value value{};
+        bool used = false;
+        mutable std::atomic<bool> referenced{ false };
+    };
+
+    // 转动指针找到要淘汰的槽位（缓存已满，全部槽位都在用）
+    size_t victim() {
+        while (true) {
+            size_t index = hand_;
+            hand_ = (hand_ + 1) % slots_.size();
+            if (slots_[index].used && !slots_[index].referenced.exchange(false, std::memory_order_relaxed)) {
+                return index;
+            }
+        }
+    }
+
+    void release(size_t index) {
+        Slot& slot = slots_[index];
+        slot.value = Value{};
+        slot.used = false;
+        free_.push_back(index);
+    }
+
+    size_t capacity_;
+    std::deque<Slot> slots_;                  // 槽位，deque 追加时不移动已有元素
+    std::unordered_map<Key, size_t> index_;   // 键 -> 槽位
+    std::vector<size_t> free_;                // 被删除后空出的槽位
+    size_t hand_ = 0;                         // CLOCK 指针
+};
@@ -0,0 +1,421 @@
+﻿#include "CommandProcessor.h"
+#include "FileSystem.h"
+#include "VirtualPath.h"
+#include "FileHandle.h"
+#include <fstream>
+#include <cstdlib>
+#include <sstream>
+#include <vector>
+
+// 失败结果
+static CommandResult failure(const std::string& error) {
+    CommandResult result;
+    result.error = error;
+    return result;
+}
+
+// 成功结果
+static CommandResult success(const std::string& output = std::string()) {
+    CommandResult result;
+    result.ok = true;
+    result.output = output;
+    return result;
+}
+
+// 把 write 的内容中的 \n、\t、\\ 转义还原
+static std::string unescape(const std::string& text) {
+    std::string result;
+    result.reserve(text.size());
+    for (size_t i = 0; i < text.size(); ++i) {
+        if (text[i] == '\\' && i + 1 < text.size()) {
+            char next = text[i + 1];
+            if (next == 'n' || next == 't' || next == '\\') {
+                result += next == 'n' ? '\n' : (next == 't' ? '\t' : '\\');
+                ++i;
+                continue;
+            }
+        }
+        result += text[i];
+    }
+    return result;
+}
+
+std::string CommandProcessor::commandName(const std::string& line) {
+    std::istringstream stream(line);
+    std::string name;
+    stream >> name;
+    return name;
+}
+
+CommandResult CommandProcessor::execute(const std::string& line) {
+    std::istringstream stream(line);
+    std::string name;
+    if (!(stream >> name) || name[0] == '#') {
+        return success();
+    }
+    std::vector<std::string> args;
+    std::string arg;
+    if (name == "write" || name == "append" || name == "pwrite") {
+        // write/append <文件> <内容>、pwrite <文件> <偏移> <内容>：其余参数之后的整行都是内容
+        int count = name == "pwrite" ? 2 : 1;
+        for (int i = 0; i < count && stream >> arg; ++i) {
+            args.push_back(arg);
+        }
+        std::string content;
+        std::getline(stream, content);
+        if (!content.empty() && content[0] == ' ') {
+            content.erase(0, 1);
+        }
+        if (name == "append") {
+            return append(args, unescape(content));
+        }
+        if (name == "pwrite") {
+            return writeAt(args, unescape(content));
+        }
+        return write(args, unescape(content));
+    }
+    while (stream >> arg) {
+        args.push_back(arg);
+    }
+    if (name == "mkdir") {
+        return makeDirectory(args);
+    }
+    if (name == "cd") {
+        return changeDirectory(args);
+    }
+    if (name == "touch") {
+        return touch(args);
+    }
+    if (name == "rm") {
+        return remove(args);
+    }
+    if (name == "read") {
+        return read(args);
+    }
+    if (name == "truncate") {
+        return truncate(args);
+    }
+    if (name == "rename") {
+        return rename(args);
+    }
+    if (name == "ls") {
+        return list(args);
+    }
+    if (name == "du") {
+        return usage(args);
+    }
+    if (name == "import") {
+        return importFile(args);
+    }
+    if (name == "export") {
+        return exportFile(args);
+    }
+    if (name == "stats") {
+        return statistics();
+    }
+    if (name == "fsck") {
+        return check(args);
+    }
+    return failure("Unknown command: " + name);
+}
+
+std::string CommandProcessor::resolve(const std::string& path) const {
+    if (path == "~") {
+        return config.rootPath;
+    }
+    return getFullPath(path);
+}
+
+bool CommandProcessor::insideRoot(const std::string& fullPath) const {
+    return VirtualPath(fullPath, "/").isWithin(config.rootPath);
+}
+
+bool CommandProcessor::isRoot(const std::string& fullPath) const {
+    return VirtualPath(fullPath, "/").str() == VirtualPath(config.rootPath, "/").str();
+}
+
+// 访问虚拟根目录之外的路径
+static CommandResult outsideRoot(const std::string& path) {
+    return failure("Outside " + config.rootPath + ": " + path);
+}
+
+CommandResult CommandProcessor::makeDirectory(const std::vector<std::string>& args) {
+    if (args.empty()) {
+        return failure("Missing directory name");
+    }
+    std::string path = resolve(args[0]);
+    if (!insideRoot(path)) {
+        return outsideRoot(path);
+    }
+    if (pathExists(path)) {
+        return failure("Already exists: " + path);
+    }
+    return createDirectory(path) ? success() : failure("Failed to create directory: " + path);
+}
+
+CommandResult CommandProcessor::changeDirectory(const std::vector<std::string>& args) {
+    if (args.empty()) {
+        return failure("Missing path");
+    }
+    std::string path = resolve(args[0]);
+    // 与图形界面相同，不能跳出虚拟根目录
+    if (!insideRoot(path)) {
+        return failure("Cannot leave " + config.rootPath);
+    }
+    if (!isDirectory(path)) {
+        return failure("No such directory: " + path);
+    }
+    setCurrentPath(path);
+    return success();
+}
+
+CommandResult CommandProcessor::touch(const std::vector<std::string>& args) {
+    if (args.empty()) {
+        return failure("Missing file name");
+    }
+    std::string path = resolve(args[0]);
+    if (!insideRoot(path)) {
+        return outsideRoot(path);
+    }
+    if (pathExists(path)) {
+        return failure("Already exists: " + path);
+    }
+    return createFile(path) ? success() : failure("Failed to create file: " + path);
+}
+
+CommandResult CommandProcessor::remove(const std::vector<std::string>& args) {
+    if (args.empty()) {
+        return failure("Missing file or directory name");
+    }
+    std::string path = resolve(args[0]);
+    if (!insideRoot(path)) {
+        return outsideRoot(path);
+    }
+    // 删除虚拟根目录后就再也进不去了
+    if (isRoot(path)) {
+        return failure("Cannot delete " + config.rootPath);
+    }
+    return deleteItem(path) ? success() : failure("Failed to delete: " + path);
+}
+
+CommandResult CommandProcessor::read(const std::vector<std::string>& args) {
+    if (args.empty()) {
+        return failure("Missing file name");
+    }
+    std::string path = resolve(args[0]);
+    if (!insideRoot(path)) {
+        return outsideRoot(path);
+    }
+    if (!pathExists(path) || isDirectory(path)) {
+        return failure("No such file: " + path);
+    }
+    return success(readFileContent(path));
+}
+
+CommandResult CommandProcessor::write(const std::vector<std::string>& args, const std::string& content) {
+    if (args.empty()) {
+        return failure("Missing file name");
+    }
+    std::string path = resolve(args[0]);
+    if (!insideRoot(path)) {
+        return outsideRoot(path);
+    }
+    return writeFileContent(path, content) ? success() : failure("Failed to write: " + path);
+}
+
+CommandResult CommandProcessor::append(const std::vector<std::string>& args, const std::string& content) {
+    if (args.empty()) {
+        return failure("Missing file name");
+    }
+    std::string path = resolve(args[0]);
+    if (!insideRoot(path)) {
+        return outsideRoot(path);
+    }
+    return appendFile(path, content) ? success() : failure("Failed to append: " + path);
+}
+
+// 解析非负的字节偏移/大小
+static bool parseSize(const std::string& text, int64_t& value) {
+    char* end = nullptr;
+    long long parsed = std::strtoll(text.c_str(), &end, 10);
+    if (text.empty() || *end != '\0' || parsed < 0) {
+        return false;
+    }
+    value = parsed;
+    return true;
+}
+
+CommandResult CommandProcessor::writeAt(const std::vector<std::string>& args, const std::string& content) {
+    if (args.size() < 2) {
+        return failure("Usage: pwrite <file> <offset> <content>");
+    }
+    std::string path = resolve(args[0]);
+    if (!insideRoot(path)) {
+        return outsideRoot(path);
+    }
+    int64_t offset = 0;
+    if (!parseSize(args[1], offset)) {
+        return failure("Invalid offset: " + args[1]);
+    }
+    return writeFileRange(path, offset, content) ? success() : failure("Failed to write: " + path);
+}
+
+CommandResult CommandProcessor::truncate(const std::vector<std::string>& args) {
+    if (args.size() < 2) {
+        return failure("Usage: truncate <file> <size>");
+    }
+    std::string path = resolve(args[0]);
+    if (!insideRoot(path)) {
+        return outsideRoot(path);
+    }
+    int64_t size = 0;
+    if (!parseSize(args[1], size)) {
+        return failure("Invalid size: " + args[1]);
+    }
+    return truncateFile(path, size) ? success() : failure("Failed to truncate: " + path);
+}
+
+CommandResult CommandProcessor::rename(const std::vector<std::string>& args) {
+    if (args.size() < 2) {
+        return failure("Missing file name");
+    }
+    std::string oldPath = resolve(args[0]);
+    std::string newPath = resolve(args[1]);
+    if (!insideRoot(oldPath)) {
+        return outsideRoot(oldPath);
+    }
+    if (!insideRoot(newPath)) {
+        return outsideRoot(newPath);
+    }
+    if (isRoot(oldPath)) {
+        return failure("Cannot rename " + config.rootPath);
+    }
+    return renameItem(oldPath, newPath) ? success() : failure("Failed to rename: " + oldPath);
+}
+
+CommandResult CommandProcessor::list(const std::vector<std::string>& args) {
+    std::string path = resolve(args.empty() ? std::string() : args[0]);
+    if (!insideRoot(path)) {
+        return outsideRoot(path);
+    }
+    if (!isDirectory(path)) {
+        return failure("No such directory: " + path);
+    }
+    // 每行一项：类型、大小、名称
+    std::string output;
+    for (const FileItem& item : getDirectoryInfo(path).items) {
+        output += item.type == FileType::Directory ? "d " : "- ";
+        output += std::to_string(item.size) + " " + item.name + "\n";
+    }
+    return success(output);
+}
+
+CommandResult CommandProcessor::usage(const std::vector<std::string>& args) {
+    std::string path = resolve(args.empty() ? std::string() : args[0]);
+    if (!insideRoot(path)) {
+        return outsideRoot(path);
+    }
+    int64_t totalSize = 0;
+    int64_t fileCount = 0;
+    if (!getDiskUsage(path, totalSize, fileCount)) {
+        return failure("No such file or directory: " + path);
+    }
+    return success(std::to_string(totalSize) + " " + std::to_string(fileCount) + "\n");
+}
+
+// 宿主机文件与虚拟文件之间分块复制，内存占用与文件大小无关
+static const size_t COPY_CHUNK = 1 << 20;
+
+CommandResult CommandProcessor::importFile(const std::vector<std::string>& args) {
+    if (args.size() < 2) {
+        return failure("Usage: import <host file> <file>");
+    }
+    std::ifstream in(args[0], std::ios::binary);
+    if (!in) {
+        return failure("Cannot open host file: " + args[0]);
+    }
+    std::string path = resolve(args[1]);
+    if (!insideRoot(path)) {
+        return outsideRoot(path);
+    }
+    FileHandle file;
+    if (!file.open(path, FileHandle::Write | FileHandle::Create | FileHandle::Truncate)) {
+        return failure("Failed to open: " + path);
+    }
+    std::vector<char> buffer(COPY_CHUNK);
+    while (in) {
+        in.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        if (in.gcount() > 0 && !file.write(buffer.data(), static_cast<size_t>(in.gcount()))) {
+            return failure("Failed to write: " + path);
+        }
+    }
+    return file.close() ? success() : failure("Failed to write: " + path);
+}
+
+CommandResult CommandProcessor::exportFile(const std::vector<std::string>& args) {
+    if (args.size() < 2) {
+        return failure("Usage: export <file> <host file>");
+    }
+    std::string path = resolve(args[0]);
+    if (!insideRoot(path)) {
+        return outsideRoot(path);
+    }
+    FileHandle file;
+    if (!file.open(path, FileHandle::Read)) {
+        return failure("No such file: " + path);
+    }
+    std::ofstream out(args[1], std::ios::binary | std::ios::trunc);
+    if (!out) {
+        return failure("Cannot create host file: " + args[1]);
+    }
+    std::vector<char> buffer(COPY_CHUNK);
+    int64_t count;
+    while ((count = file.read(buffer.data(), buffer.size())) > 0) {
+        out.write(buffer.data(), count);
+    }
+    if (count < 0) {
+        return failure("Failed to read: " + path);
+    }
+    return out ? success() : failure("Failed to write host file: " + args[1]);
+}
+
+CommandResult CommandProcessor::statistics() {
+    // 块缓存的命中、未命中、淘汰和写回块数；日志的事务、组提交和检查点次数
+    BlockCacheStats stats = getCacheStats();
+    JournalStats journalStats = getJournalStats();
+    return success("cache hits " + std::to_string(stats.hits) + " misses " + std::to_string(stats.misses)
+        + " evictions " + std::to_string(stats.evictions) + " writebacks " + std::to_string(stats.writebacks) + "\n"
+        + "journal transactions " + std::to_string(journalStats.transactions) + " commits " + std::to_string(journalStats.commits)
+        + " checkpoints " + std::to_string(journalStats.checkpoints) + " bytes " + std::to_string(journalStats.bytes) + "\n");
+}
+
+CommandResult CommandProcessor::check(const std::vector<std::string>& args) {
+    // fsck [--repair] [--threads N]
+    bool repair = false;
+    int threads = 0;
+    for (size_t i = 0; i < args.size(); ++i) {
+        if (args[i] == "--repair") {
+            repair = true;
+        }
+        else if (args[i] == "--threads" && i + 1 < args.size()) {
+            threads = std::atoi(args[++i].c_str());
+        }
+        else {
+            return failure("Usage: fsck [--repair] [--threads N]");
+        }
+    }
+    FsckReport report = checkFileSystem(repair, threads);
+    std::string text = "fsck " + std::to_string(report.inodes) + " inodes " + std::to_string(report.directories)
+        + " directories " + std::to_string(report.usedBlocks) + " blocks " + std::to_string(report.detachedTrees)
+        + " detached problems " + std::to_string(report.problems())
+        + " repairs " + std::to_string(report.repairs) + " threads " + std::to_string(report.threads)
+        + " ms " + std::to_string(static_cast<long long>(report.seconds * 1000)) + "\n";
+    for (const std::string& message : report.messages) {
+        text += message + "\n";
+    }
+    // 没有修复时发现问题即失败，脚本可以据此判断
+    if (!report.clean() && !repair) {
+        return failure(text);
+    }
+    return success(text);
+}
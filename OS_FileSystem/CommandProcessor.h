@@ -0,0 +1,46 @@
+﻿#pragma once
+#include <string>
+#include <vector>
+
+// 一条命令的执行结果
+struct CommandResult {
+    bool ok = false;           // 是否成功
+    std::string output;        // 输出（read 的文件内容、ls 的列表等）
+    std::string error;         // 失败原因
+};
+
+// 命令处理器：不依赖界面，执行与图形界面相同的命令集
+// （mkdir、cd、touch、rm、read、write、rename，另有按偏移写入的 append、pwrite、truncate，
+// ls、du、stats、fsck，以及与宿主机文件互相复制的 import、export），供命令行和脚本使用
+class CommandProcessor {
+public:
+    // 执行一行命令，空行和以 # 开头的注释行直接返回成功
+    CommandResult execute(const std::string& line);
+    // 命令行中的第一个词（命令名）
+    static std::string commandName(const std::string& line);
+
+private:
+    // 把参数解析为虚拟全路径（相对路径基于当前路径）
+    std::string resolve(const std::string& path) const;
+    // 路径是否在虚拟根目录内
+    bool insideRoot(const std::string& fullPath) const;
+    // 路径是否就是虚拟根目录本身（不能删除或重命名）
+    bool isRoot(const std::string& fullPath) const;
+
+    CommandResult makeDirectory(const std::vector<std::string>& args);
+    CommandResult changeDirectory(const std::vector<std::string>& args);
+    CommandResult touch(const std::vector<std::string>& args);
+    CommandResult remove(const std::vector<std::string>& args);
+    CommandResult read(const std::vector<std::string>& args);
+    CommandResult write(const std::vector<std::string>& args, const std::string& content);
+    CommandResult append(const std::vector<std::string>& args, const std::string& content);
+    CommandResult writeAt(const std::vector<std::string>& args, const std::string& content);
+    CommandResult truncate(const std::vector<std::string>& args);
+    CommandResult rename(const std::vector<std::string>& args);
+    CommandResult list(const std::vector<std::string>& args);
+    CommandResult usage(const std::vector<std::string>& args);
+    CommandResult importFile(const std::vector<std::string>& args);
+    CommandResult exportFile(const std::vector<std::string>& args);
+    CommandResult statistics();
+    CommandResult check(const std::vector<std::string>& args);
+};
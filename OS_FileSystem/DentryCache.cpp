@@ -0,0 +1,40 @@
+﻿#include "DentryCache.h"
+#include <cstring>
+#include <mutex>
+#include <shared_mutex>
+
+// 定义全局的目录项缓存
+DentryCache dentryCache;
+
+void CachedDirectory::add(std::string_view name, int ino, int slot) {
+    if (names.size() <= static_cast<size_t>(slot)) {
+        names.resize(static_cast<size_t>(slot) + 1);
+    }
+    Name& stored = names[slot];
+    std::memcpy(stored.data(), name.data(), name.size());
+    stored[name.size()] = '\0';
+    entries.emplace(std::string_view(stored.data(), name.size()), Dentry{ ino, slot });
+}
+
+std::shared_ptr<CachedDirectory> DentryCache::find(int dirIno) {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    const std::shared_ptr<CachedDirectory>* cached = dirs_.find(dirIno);
+    return cached ? *cached : nullptr;
+}
+
+std::shared_ptr<CachedDirectory> DentryCache::insert(int dirIno, CachedDirectory&& dir) {
+    auto cached = std::make_shared<CachedDirectory>(std::move(dir));
+    std::lock_guard<std::shared_mutex> lock(mutex_);
+    dirs_.insert(dirIno, cached);
+    return cached;
+}
+
+void DentryCache::invalidate(int dirIno) {
+    std::lock_guard<std::shared_mutex> lock(mutex_);
+    dirs_.erase(dirIno);
+}
+
+void DentryCache::clear() {
+    std::lock_guard<std::shared_mutex> lock(mutex_);
+    dirs_.clear();
+}
@@ -0,0 +1,62 @@
+﻿#pragma once
+#include "Metadata.h"
+#include "ClockCache.h"
+#include <array>
+#include <deque>
+#include <memory>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <cstddef>
+#include <shared_mutex>
+
+// 缓存中的目录项：inode 号和它在目录数据中的槽位
+struct Dentry {
+    int ino;                   // inode 号
+    int slot;                  // 目录项槽位（第几个 DirEntry）
+};
+
+// 一个目录的全部目录项：名称哈希到 inode 号，另记录空槽，添加目录项时不必扫描。
+// 名称按槽位存放在 names 中（deque 在末尾追加时不移动已有元素），哈希表的键是指向它的
+// string_view，按路径组件查找时不必构造 std::string；因此只能移动不能复制
+struct CachedDirectory {
+    using Name = std::array<char, DIR_NAME_MAX + 1>;
+
+    std::unordered_map<std::string_view, Dentry> entries; // 名称 -> 目录项，键指向 names
+    std::deque<Name> names;                               // 槽位 -> 名称
+    std::vector<int> freeSlots;                           // 空槽位
+    int slotCount = 0;                                    // 槽位总数（含空槽）
+
+    CachedDirectory() = default;
+    CachedDirectory(CachedDirectory&&) = default;
+    CachedDirectory& operator=(CachedDirectory&&) = default;
+    CachedDirectory(const CachedDirectory&) = delete;
+    CachedDirectory& operator=(const CachedDirectory&) = delete;
+
+    // 记录槽位 slot 上名称为 name 的目录项，名称不超过 DIR_NAME_MAX；槽位上原有的目录项须已删除
+    void add(std::string_view name, int ino, int slot);
+};
+
+// 目录项缓存：目录第一次被访问时读入全部目录项，之后的查找、列目录都在内存中完成，
+// 创建、删除、重命名时原地更新，满时按 CLOCK 每次淘汰一个目录，一次大范围扫描不会挤掉常用的父目录。
+// 并发的只读操作可能同时读入目录，缓存本身加读写锁；目录以共享指针交出，
+// 被淘汰或失效后持有者手中的仍然有效。添加、删除目录项只在持有该目录 inode 的独占锁时进行，
+// 查找和列目录持有同一目录的共享锁，因此原地更新不会与读者冲突
+class DentryCache {
+public:
+    // 已缓存的目录，不在缓存中返回空指针
+    std::shared_ptr<CachedDirectory> find(int dirIno);
+    // 放入一个刚读入的目录
+    std::shared_ptr<CachedDirectory> insert(int dirIno, CachedDirectory&& dir);
+    // 目录 inode 被释放时调用
+    void invalidate(int dirIno);
+    void clear();
+
+private:
+    static const size_t MAX_DIRECTORIES = 4096;
+    std::shared_mutex mutex_;
+    ClockCache<int, std::shared_ptr<CachedDirectory>> dirs_{ MAX_DIRECTORIES }; // 目录 inode 号 -> 目录项
+};
+
+// 全局的目录项缓存
+extern DentryCache dentryCache;
@@ -0,0 +1,165 @@
+﻿#include "DirectoryTreeModel.h"
+#include "FileSystem.h"
+#include <algorithm>
+
+DirectoryTreeModel::DirectoryTreeModel(const std::string& rootPath, QObject* parent)
+    : QAbstractItemModel(parent), rootPath_(rootPath) {
+    std::unique_ptr<Node> top(new Node);
+    top->name = rootPath;
+    top->parent = &root_;
+    root_.children.push_back(std::move(top));
+    root_.fetched = true;
+}
+
+DirectoryTreeModel::~DirectoryTreeModel() {}
+
+DirectoryTreeModel::Node* DirectoryTreeModel::nodeOf(const QModelIndex& index) const {
+    return index.isValid() ? static_cast<Node*>(index.internalPointer()) : const_cast<Node*>(&root_);
+}
+
+int DirectoryTreeModel::rowOf(const Node* node) const {
+    const auto& siblings = node->parent->children;
+    for (size_t i = 0; i < siblings.size(); ++i) {
+        if (siblings[i].get() == node) {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
+QModelIndex DirectoryTreeModel::indexOf(Node* node) const {
+    if (node == &root_) {
+        return QModelIndex();
+    }
+    return createIndex(rowOf(node), 0, node);
+}
+
+QModelIndex DirectoryTreeModel::index(int row, int column, const QModelIndex& parent) const {
+    Node* node = nodeOf(parent);
+    if (column != 0 || row < 0 || row >= static_cast<int>(node->children.size())) {
+        return QModelIndex();
+    }
+    return createIndex(row, 0, node->children[row].get());
+}
+
+QModelIndex DirectoryTreeModel::parent(const QModelIndex& child) const {
+    if (!child.isValid()) {
+        return QModelIndex();
+    }
+    return indexOf(nodeOf(child)->parent);
+}
+
+int DirectoryTreeModel::rowCount(const QModelIndex& parent) const {
+    return static_cast<int>(nodeOf(parent)->children.size());
+}
+
+int DirectoryTreeModel::columnCount(const QModelIndex& parent) const {
+    return 1;
+}
+
+QVariant DirectoryTreeModel::data(const QModelIndex& index, int role) const {
+    if (!index.isValid() || role != Qt::DisplayRole) {
+        return QVariant();
+    }
+    return QString::fromStdString(nodeOf(index)->name);
+}
+
+QVariant DirectoryTreeModel::headerData(int section, Qt::Orientation orientation, int role) const {
+    if (orientation == Qt::Horizontal && role == Qt::DisplayRole && section == 0) {
+        return QString("文件目录");
+    }
+    return QVariant();
+}
+
+bool DirectoryTreeModel::hasChildren(const QModelIndex& parent) const {
+    Node* node = nodeOf(parent);
+    // 未读取的目录先显示展开标记，展开时再读取
+    return !node->fetched || !node->children.empty();
+}
+
+bool DirectoryTreeModel::canFetchMore(const QModelIndex& parent) const {
+    return !nodeOf(parent)->fetched;
+}
+
+void DirectoryTreeModel::fetchMore(const QModelIndex& parent) {
+    Node* node = nodeOf(parent);
+    if (node->fetched) {
+        return;
+    }
+    node->fetched = true;
+    syncChildren(node);
+}
+
+std::string DirectoryTreeModel::pathOf(const Node* node) const {
+    if (node->parent == &root_) {
+        return rootPath_;
+    }
+    std::string parentPath = pathOf(node->parent);
+    return parentPath + (parentPath.back() == '/' ? "" : "/") + node->name;
+}
+
+std::string DirectoryTreeModel::pathOf(const QModelIndex& index) const {
+    Node* node = nodeOf(index);
+    return node == &root_ ? rootPath_ : pathOf(node);
+}
+
+void DirectoryTreeModel::syncChildren(Node* node) {
+    std::vector<std::string> names = getSubdirectoryNames(pathOf(node));
+    QModelIndex parentIndex = indexOf(node);
+    auto& children = node->children;
+    // 两边都按名称排序，归并比较
+    size_t i = 0;
+    size_t j = 0;
+    while (i < children.size() || j < names.size()) {
+        if (j == names.size() || (i < children.size() && children[i]->name < names[j])) {
+            // 目录已不存在
+            beginRemoveRows(parentIndex, static_cast<int>(i), static_cast<int>(i));
+            children.erase(children.begin() + i);
+            endRemoveRows();
+        }
+        else if (i == children.size() || names[j] < children[i]->name) {
+            // 新目录
+            beginInsertRows(parentIndex, static_cast<int>(i), static_cast<int>(i));
+            std::unique_ptr<Node> child(new Node);
+            child->name = names[j];
+            child->parent = node;
+            children.insert(children.begin() + i, std::move(child));
+            endInsertRows();
+            ++i;
+            ++j;
+        }
+        else {
+            ++i;
+            ++j;
+        }
+    }
+}
+
+void DirectoryTreeModel::refreshDirectory(const std::string& path) {
+    std::string fullPath = simplifyPath(path);
+    std::string prefix = rootPath_.back() == '/' ? rootPath_ : rootPath_ + "/";
+    if (fullPath != rootPath_ && fullPath.compare(0, prefix.size(), prefix) != 0) {
+        return;
+    }
+    // 沿路径找到最深的已加载节点，路径上后面的目录可能是刚创建的
+    Node* node = root_.children.front().get();
+    size_t start = prefix.size();
+    while (start < fullPath.size() && node->fetched) {
+        size_t end = fullPath.find('/', start);
+        if (end == std::string::npos) {
+            end = fullPath.size();
+        }
+        std::string name = fullPath.substr(start, end - start);
+        auto it = std::find_if(node->children.begin(), node->children.end(),
+            [&](const std::unique_ptr<Node>& child) { return child->name == name; });
+        if (it == node->children.end()) {
+            break;
+        }
+        node = it->get();
+        start = end + 1;
+    }
+    // 未读取的目录展开时自然会读到最新内容
+    if (node->fetched) {
+        syncChildren(node);
+    }
+}
@@ -0,0 +1,47 @@
+﻿#pragma once
+#include <QAbstractItemModel>
+#include <memory>
+#include <string>
+#include <vector>
+
+// 目录树模型：只在展开时读取子目录，创建、删除、重命名后只刷新受影响的目录，
+// 不再每条命令都重建整棵树
+class DirectoryTreeModel : public QAbstractItemModel {
+    Q_OBJECT
+public:
+    DirectoryTreeModel(const std::string& rootPath, QObject* parent = nullptr);
+    ~DirectoryTreeModel();
+
+    QModelIndex index(int row, int column, const QModelIndex& parent = QModelIndex()) const override;
+    QModelIndex parent(const QModelIndex& child) const override;
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+    bool hasChildren(const QModelIndex& parent = QModelIndex()) const override;
+    bool canFetchMore(const QModelIndex& parent) const override;
+    void fetchMore(const QModelIndex& parent) override;
+
+    // 目录 path 的子目录发生变化后调用：只与已加载的部分比较，插入/删除有变化的行
+    void refreshDirectory(const std::string& path);
+    // 节点对应的虚拟路径
+    std::string pathOf(const QModelIndex& index) const;
+
+private:
+    struct Node {
+        std::string name;                             // 目录名（顶层节点为虚拟根路径）
+        Node* parent = nullptr;
+        std::vector<std::unique_ptr<Node>> children;  // 按名称排序的子目录
+        bool fetched = false;                         // 子目录是否已读取
+    };
+
+    Node* nodeOf(const QModelIndex& index) const;
+    QModelIndex indexOf(Node* node) const;
+    int rowOf(const Node* node) const;
+    std::string pathOf(const Node* node) const;
+    // 读取 node 的子目录并与已有的子节点比较，应用差异
+    void syncChildren(Node* node);
+
+    Node root_;           // 不可见的根，唯一的子节点是虚拟根目录
+    std::string rootPath_;
+};
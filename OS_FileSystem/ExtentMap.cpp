@@ -0,0 +1,118 @@
+﻿#include "ExtentMap.h"
+#include "Utilities.h"
+#include <algorithm>
+#include <mutex>
+#include <shared_mutex>
+
+// 定义全局的区段映射缓存
+ExtentMapCache extentCache;
+
+void ExtentMap::build(int firstBlock) {
+    extents_.clear();
+    blockCount_ = 0;
+    const int blockCount = getBlockCount();
+    int block = firstBlock;
+    // 最多走 blockCount 步，防止损坏的 FAT 链成环
+    while (block >= 0 && block < blockCount && blockCount_ < blockCount) {
+        if (!extents_.empty() && extents_.back().physical + extents_.back().length == block) {
+            extents_.back().length++;
+        }
+        else {
+            extents_.push_back({ blockCount_, block, 1 });
+        }
+        blockCount_++;
+        block = fat[block];
+    }
+}
+
+void ExtentMap::append(const std::vector<int>& blocks) {
+    for (int block : blocks) {
+        if (!extents_.empty() && extents_.back().physical + extents_.back().length == block) {
+            extents_.back().length++;
+        }
+        else {
+            extents_.push_back({ blockCount_, block, 1 });
+        }
+        blockCount_++;
+    }
+}
+
+void ExtentMap::truncate(int64_t blockCount) {
+    if (blockCount >= blockCount_) {
+        return;
+    }
+    while (!extents_.empty() && extents_.back().logical >= blockCount) {
+        extents_.pop_back();
+    }
+    if (!extents_.empty()) {
+        extents_.back().length = static_cast<int>(blockCount - extents_.back().logical);
+    }
+    blockCount_ = blockCount;
+}
+
+int ExtentMap::find(int64_t logical) const {
+    if (logical < 0 || logical >= blockCount_) {
+        return -1;
+    }
+    // 第一个起始逻辑块号大于 logical 的区段的前一个
+    auto it = std::upper_bound(extents_.begin(), extents_.end(), logical,
+        [](int64_t value, const Extent& extent) { return value < extent.logical; });
+    return static_cast<int>(it - extents_.begin()) - 1;
+}
+
+int ExtentMap::physicalBlock(int64_t logical) const {
+    int index = find(logical);
+    if (index < 0) {
+        return -1;
+    }
+    const Extent& extent = extents_[index];
+    return extent.physical + static_cast<int>(logical - extent.logical);
+}
+
+int ExtentMap::contiguousBlocks(int64_t logical) const {
+    int index = find(logical);
+    if (index < 0) {
+        return 0;
+    }
+    const Extent& extent = extents_[index];
+    return extent.length - static_cast<int>(logical - extent.logical);
+}
+
+std::shared_ptr<const ExtentMap> ExtentMapCache::get(int firstBlock) {
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        if (const std::shared_ptr<ExtentMap>* cached = maps_.find(firstBlock)) {
+            return *cached;
+        }
+    }
+    // 在锁外遍历 FAT 链，两个读者同时构建同一条链时后放入的覆盖先放入的，内容相同
+    auto map = std::make_shared<ExtentMap>();
+    map->build(firstBlock);
+    std::lock_guard<std::shared_mutex> lock(mutex_);
+    maps_.insert(firstBlock, map);
+    return map;
+}
+
+void ExtentMapCache::invalidate(int firstBlock) {
+    std::lock_guard<std::shared_mutex> lock(mutex_);
+    maps_.erase(firstBlock);
+}
+
+void ExtentMapCache::append(int firstBlock, const std::vector<int>& blocks) {
+    std::lock_guard<std::shared_mutex> lock(mutex_);
+    if (const std::shared_ptr<ExtentMap>* cached = maps_.find(firstBlock)) {
+        (*cached)->append(blocks);
+    }
+}
+
+void ExtentMapCache::truncate(int firstBlock, int64_t blockCount) {
+    std::lock_guard<std::shared_mutex> lock(mutex_);
+    if (const std::shared_ptr<ExtentMap>* cached = maps_.find(firstBlock)) {
+        (*cached)->truncate(blockCount);
+    }
+}
+
+void ExtentMapCache::clear() {
+    std::lock_guard<std::shared_mutex> lock(mutex_);
+    maps_.clear();
+}
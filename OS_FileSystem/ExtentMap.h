@@ -0,0 +1,64 @@
+﻿#pragma once
+#include "ClockCache.h"
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <memory>
+#include <shared_mutex>
+
+// 一段物理连续的块：逻辑块号 logical 起的 length 个块位于物理块 physical 起
+struct Extent {
+    int64_t logical;           // 起始逻辑块号
+    int physical;              // 起始物理块号
+    int length;                // 块数
+};
+
+// 文件的区段映射：把 FAT 链压缩成若干连续区段，按逻辑块号二分查找，
+// 随机访问不必再从首块开始逐跳遍历 FAT 链
+class ExtentMap {
+public:
+    // 沿 FAT 链遍历一次，构建区段映射
+    void build(int firstBlock);
+    // 块链末尾追加了 blocks（按链顺序）
+    void append(const std::vector<int>& blocks);
+    // 块链截断为前 blockCount 块
+    void truncate(int64_t blockCount);
+    // 逻辑块号对应的物理块号，超出文件范围返回 -1
+    int physicalBlock(int64_t logical) const;
+    // 从逻辑块号 logical 开始物理连续的块数，超出文件范围返回 0
+    int contiguousBlocks(int64_t logical) const;
+    // 文件占用的块数
+    int64_t blockCount() const { return blockCount_; }
+    const std::vector<Extent>& extents() const { return extents_; }
+
+private:
+    // logical 所在区段的下标，没有则返回 -1
+    int find(int64_t logical) const;
+
+    std::vector<Extent> extents_;
+    int64_t blockCount_ = 0;
+};
+
+// 区段映射缓存：首次访问文件时构建，文件的块链变化时失效，满时按 CLOCK 每次淘汰一个映射。
+// 并发的只读操作可能同时构建映射，缓存本身加读写锁；映射以共享指针交出，
+// 被淘汰后持有者手中的仍然有效。写入、追加、截断只在持有文件 inode 的独占锁时改变块链并就地更新映射，
+// 读者在使用映射期间持有同一 inode 的共享锁，因此就地更新不会与读者冲突
+class ExtentMapCache {
+public:
+    // 获取以 firstBlock 开头的块链的区段映射，不在缓存中则构建
+    std::shared_ptr<const ExtentMap> get(int firstBlock);
+    // 块链发生变化（写入、截断、删除）时调用
+    void invalidate(int firstBlock);
+    // 块链在末尾追加或截断时就地更新已缓存的映射，不必重新遍历整条链
+    void append(int firstBlock, const std::vector<int>& blocks);
+    void truncate(int firstBlock, int64_t blockCount);
+    void clear();
+
+private:
+    static const size_t MAX_ENTRIES = 4096;
+    std::shared_mutex mutex_;
+    ClockCache<int, std::shared_ptr<ExtentMap>> maps_{ MAX_ENTRIES }; // 首块号 -> 区段映射
+};
+
+// 全局的区段映射缓存
+extern ExtentMapCache extentCache;
@@ -0,0 +1,182 @@
+﻿#include "FileHandle.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+FileHandle::~FileHandle() {
+    if (!close()) {
+        std::cerr << "Discarding " << writeBuffer_.size() << " unwritten bytes" << std::endl;
+    }
+}
+
+bool FileHandle::open(const std::string& path, int flags) {
+    // 原来打开的文件还有没能写出的数据时不丢弃，保持原样由调用者处理
+    if (!close()) {
+        return false;
+    }
+    FileId file = lookupFileId(path);
+    if (file.ino == -1 && (flags & Create)) {
+        createFile(path);
+        file = lookupFileId(path);
+    }
+    if (file.ino == -1) {
+        return false;
+    }
+    if ((flags & Truncate) && !truncateFileAt(file, 0)) {
+        return false;
+    }
+    file_ = file;
+    flags_ = flags;
+    position_ = 0;
+    readLength_ = 0;
+    nextSequential_ = -1;
+    readAhead_ = 0;
+    writeBuffer_.clear();
+    return true;
+}
+
+bool FileHandle::readBufferValid() const {
+    return readLength_ > 0 && readVersion_ == fileDataVersion(file_.ino);
+}
+
+int64_t FileHandle::read(char* buffer, size_t length) {
+    if (!isOpen() || !(flags_ & Read)) {
+        return -1;
+    }
+    // 先写出自己还没写的数据，读到的才是最新内容
+    if (!flush()) {
+        return -1;
+    }
+    // 紧接上一次读取就是顺序读，预读窗口翻倍；否则不预读
+    if (position_ == nextSequential_) {
+        readAhead_ = readAhead_ == 0 ? MIN_READ_AHEAD : std::min(readAhead_ * 2, MAX_READ_AHEAD);
+    }
+    else {
+        readAhead_ = 0;
+    }
+    int64_t done = readThrough(position_, buffer, length);
+    if (done < 0) {
+        return -1;
+    }
+    position_ += done;
+    nextSequential_ = position_;
+    return done;
+}
+
+int64_t FileHandle::readThrough(int64_t position, char* buffer, size_t length) {
+    size_t done = 0;
+    if (readBufferValid() && position >= readStart_ && position < readStart_ + static_cast<int64_t>(readLength_)) {
+        size_t from = static_cast<size_t>(position - readStart_);
+        done = std::min(length, readLength_ - from);
+        std::memcpy(buffer, readBuffer_.data() + from, done);
+        if (done == length) {
+            return static_cast<int64_t>(done);
+        }
+    }
+    position += static_cast<int64_t>(done);
+    size_t rest = length - done;
+    // 剩下的部分不比预读窗口小（或不预读）时直接读到调用者的缓冲区
+    if (rest >= readAhead_) {
+        int64_t count = readFileAt(file_, position, buffer + done, rest);
+        return count < 0 ? -1 : static_cast<int64_t>(done) + count;
+    }
+    readBuffer_.resize(readAhead_);
+    readVersion_ = fileDataVersion(file_.ino);
+    int64_t count = readFileAt(file_, position, readBuffer_.data(), readAhead_);
+    if (count < 0) {
+        readLength_ = 0;
+        return -1;
+    }
+    readStart_ = position;
+    readLength_ = static_cast<size_t>(count);
+    size_t copied = std::min(rest, readLength_);
+    std::memcpy(buffer + done, readBuffer_.data(), copied);
+    return static_cast<int64_t>(done + copied);
+}
+
+bool FileHandle::write(const char* data, size_t length) {
+    if (!isOpen() || !(flags_ & Write)) {
+        return false;
+    }
+    if (flags_ & Append) {
+        position_ = size();
+    }
+    // 与写缓冲不连续或放不下时先写出缓冲，缓冲不超过 MAX_WRITE_BEHIND
+    bool contiguous = position_ == writeStart_ + static_cast<int64_t>(writeBuffer_.size());
+    if (!writeBuffer_.empty() && (!contiguous || writeBuffer_.size() + length > MAX_WRITE_BEHIND)) {
+        if (!flush()) {
+            return false;
+        }
+    }
+    if (length >= MAX_WRITE_BEHIND) {
+        // 大块写入不经过写缓冲
+        if (!writeFileAt(file_, position_, data, length)) {
+            return false;
+        }
+    }
+    else {
+        if (writeBuffer_.empty()) {
+            writeStart_ = position_;
+        }
+        if (writeBuffer_.size() + length > writeBuffer_.capacity()) {
+            writeBuffer_.reserve(std::min(std::max(writeBuffer_.capacity() * 2, writeBuffer_.size() + length), MAX_WRITE_BEHIND));
+        }
+        writeBuffer_.insert(writeBuffer_.end(), data, data + length);
+    }
+    position_ += static_cast<int64_t>(length);
+    return true;
+}
+
+int64_t FileHandle::seek(int64_t offset, SeekOrigin origin) {
+    if (!isOpen()) {
+        return -1;
+    }
+    int64_t base = origin == SeekOrigin::Begin ? 0 : (origin == SeekOrigin::Current ? position_ : size());
+    if (base + offset < 0) {
+        return -1;
+    }
+    position_ = base + offset;
+    return position_;
+}
+
+int64_t FileHandle::size() const {
+    if (!isOpen()) {
+        return -1;
+    }
+    int64_t stored = getFileSize(file_);
+    if (writeBuffer_.empty()) {
+        return stored;
+    }
+    return std::max(stored, writeStart_ + static_cast<int64_t>(writeBuffer_.size()));
+}
+
+bool FileHandle::flush() {
+    if (writeBuffer_.empty()) {
+        return true;
+    }
+    bool written = writeFileAt(file_, writeStart_, writeBuffer_.data(), writeBuffer_.size());
+    if (!written) {
+        // 保留写缓冲和 writeStart_，之后可以重试 flush 或 close
+        std::cerr << "Failed to write file data at offset: " << writeStart_ << std::endl;
+        return false;
+    }
+    writeBuffer_.clear();
+    return true;
+}
+
+bool FileHandle::close() {
+    if (!isOpen()) {
+        return true;
+    }
+    // 写出失败时句柄保持打开，数据留在写缓冲中
+    if (!flush()) {
+        return false;
+    }
+    file_ = FileId();
+    flags_ = 0;
+    readLength_ = 0;
+    readBuffer_.clear();
+    readBuffer_.shrink_to_fit();
+    writeBuffer_.shrink_to_fit();
+    return true;
+}
@@ -0,0 +1,73 @@
+﻿#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "FileSystem.h"
+
+// 流式文件句柄：按位置读写虚拟磁盘中的文件，内存占用有上限，适合读写大文件。
+// 连续顺序读时预读窗口从 MIN_READ_AHEAD 起逐次翻倍到 MAX_READ_AHEAD，随机读不预读；
+// 连续的写入先攒在写缓冲里，攒满 MAX_WRITE_BEHIND、不再连续、读、flush 或 close 时合并成一次写。
+// 句柄本身不加锁，不能在多个线程间共用；打开期间文件被删除后读写失败（即使 inode 号已分配给别的文件）
+class FileHandle {
+public:
+    // 打开方式，可以组合
+    enum OpenFlags {
+        Read = 1,       // 读
+        Write = 2,      // 写
+        Create = 4,     // 文件不存在时创建
+        Truncate = 8,   // 打开时清空
+        Append = 16     // 每次写入都追加到文件末尾
+    };
+    // seek 的基准位置
+    enum class SeekOrigin { Begin, Current, End };
+
+    static constexpr size_t MIN_READ_AHEAD = 64 << 10;
+    static constexpr size_t MAX_READ_AHEAD = 4 << 20;
+    static constexpr size_t MAX_WRITE_BEHIND = 4 << 20;
+
+    FileHandle() = default;
+    ~FileHandle();
+    FileHandle(const FileHandle&) = delete;
+    FileHandle& operator=(const FileHandle&) = delete;
+
+    // 打开文件，已打开的先关闭；原文件的写缓冲写不出去时失败，原文件保持打开
+    bool open(const std::string& path, int flags = Read);
+    bool isOpen() const { return file_.ino != -1; }
+
+    // 从当前位置读取最多 length 字节，返回读到的字节数，到达文件末尾返回 0，失败返回 -1
+    int64_t read(char* buffer, size_t length);
+    // 在当前位置写入（Append 方式写到文件末尾）
+    bool write(const char* data, size_t length);
+    bool write(const std::string& data) { return write(data.data(), data.size()); }
+    // 移动当前位置，可以移到文件末尾之后（之后写入时中间填 0），返回新位置，失败返回 -1
+    int64_t seek(int64_t offset, SeekOrigin origin = SeekOrigin::Begin);
+    int64_t tell() const { return position_; }
+    // 文件大小，包括还在写缓冲中的数据
+    int64_t size() const;
+
+    // 写出写缓冲中的数据，失败时数据留在写缓冲中，可以重试
+    bool flush();
+    // 写出写缓冲并关闭；写出失败时返回 false，句柄保持打开，可以重试
+    bool close();
+
+private:
+    // 读取 [position, position + length)，length 不超过预读窗口时先把一个窗口读进读缓冲
+    int64_t readThrough(int64_t position, char* buffer, size_t length);
+    // 读缓冲是否仍然有效（期间这个文件没有写入）
+    bool readBufferValid() const;
+
+    FileId file_;
+    int flags_ = 0;
+    int64_t position_ = 0;
+
+    std::vector<char> readBuffer_;   // 预读缓冲
+    int64_t readStart_ = 0;          // 读缓冲对应的文件偏移
+    size_t readLength_ = 0;          // 读缓冲中的有效字节数
+    uint64_t readVersion_ = 0;       // 填充读缓冲时的文件数据写入计数
+    int64_t nextSequential_ = -1;    // 上一次读取结束的位置，下一次从这里开始读视为顺序读
+    size_t readAhead_ = 0;           // 当前的预读窗口，0 表示不预读
+
+    std::vector<char> writeBuffer_;  // 写缓冲
+    int64_t writeStart_ = 0;         // 写缓冲对应的文件偏移
+};
@@ -6,10 +6,18 @@
 #include <QFileDialog>
 #include <QTextEdit>
 #include <QInputDialog>
+#include <QDateTime>
 #include <FileSystem.h>
+#include "VirtualPath.h"
 #include <sstream>
+#include <memory>
 #include "FileContentView.h"
 
+// 纳秒时间戳转换为 QDateTime，用于显示
+static QDateTime toDateTime(int64_t timeNs) {
+    return QDateTime::fromMSecsSinceEpoch(timeNs / 1000000);
+}
+
 FileMainWindow::FileMainWindow(QWidget* parent)
     : QMainWindow(parent)
 {
@@ -17,12 +25,15 @@ FileMainWindow::FileMainWindow(QWidget* parent)
     Init();
     updateDirectoryView();
 
-    // 初始化文件系统监控器
-    fileSystemWatcher = new QFileSystemWatcher(this);
-    connect(fileSystemWatcher, &QFileSystemWatcher::directoryChanged, this, &FileMainWindow::onDirectoryChanged);
-    // 使用实际路径进行监控
-    std::string actualPath = getFullPath(config.currentPath);
-    fileSystemWatcher->addPath(QString::fromStdString(actualPath));
+    // 定期刷新后台操作的进度显示
+    progressTimer = new QTimer(this);
+    connect(progressTimer, &QTimer::timeout, this, &FileMainWindow::updateOperationStatus);
+    progressTimer->start(PROGRESS_INTERVAL_MS);
+
+    // 定期做检查点，把元数据写回原位置并清空日志
+    syncTimer = new QTimer(this);
+    connect(syncTimer, &QTimer::timeout, []() { syncFileSystem(); });
+    syncTimer->start(SYNC_INTERVAL_MS);
 }
 
 
@@ -44,15 +55,20 @@ void FileMainWindow::InitWidget()
 
     // 界面分为两部分，左侧显示文件目录结构，右侧为另一部分。右侧的最上方一行显示当前路径，
     // 下面主要部分显示当前目录的文件(类似windows文件管理器)，最下方可以输入代码(就像linux一样输入makedir等等操作)
+    // 文件系统操作都在后台工作线程中执行
+    operations = new OperationQueue(this);
+
     QHBoxLayout* mainLayout = new QHBoxLayout(centralWidget);
     // 设置主布局的间距和边距
     mainLayout->setSpacing(10);
     mainLayout->setContentsMargins(10, 10, 10, 10);
 
-    // 左侧目录树
-    QTreeWidget* directoryTree = new QTreeWidget(centralWidget);
-    directoryTree->setHeaderLabel("文件目录");
+    // 左侧目录树：子目录在展开时才读取
+    directoryModel = new DirectoryTreeModel(config.rootPath, this);
+    directoryTree = new QTreeView(centralWidget);
+    directoryTree->setModel(directoryModel);
     directoryTree->setObjectName("directoryTree");
+    directoryTree->expand(directoryModel->index(0, 0));
     mainLayout->addWidget(directoryTree);
 
     // 右侧
@@ -132,6 +148,19 @@ void FileMainWindow::InitWidget()
 
     rightLayout->addLayout(shortcutButtonLayout);
 
+    // 后台操作状态和取消按钮
+    QHBoxLayout* statusLayout = new QHBoxLayout();
+    statusLayout->setSpacing(10);
+    statusLayout->setContentsMargins(0, 0, 0, 0);
+    statusLabel = new QLabel("就绪", centralWidget);
+    QPushButton* cancelButton = new QPushButton("取消操作", centralWidget);
+    connect(cancelButton, &QPushButton::clicked, [=]() {
+        operations->cancelAll();
+    });
+    statusLayout->addWidget(statusLabel, 1);
+    statusLayout->addWidget(cancelButton);
+    rightLayout->addLayout(statusLayout);
+
     // 确认和退出按钮
     QHBoxLayout* buttonLayout = new QHBoxLayout();
     // 设置按钮布局的间距和边距
@@ -154,18 +183,9 @@ void FileMainWindow::InitWidget()
 }
 
 void FileMainWindow::updateDirectoryView() {
-    // 更新左侧目录树和右侧文件列表
+    // 左侧目录树在命令处理时按变化刷新，这里只更新右侧文件列表
     Directory dirInfo = getDirectoryInfo(config.currentPath);
 
-    // 更新左侧目录树
-    QTreeWidget* directoryTree = findChild<QTreeWidget*>("directoryTree");
-    if (directoryTree) {
-        directoryTree->clear();
-        QTreeWidgetItem* rootItem = new QTreeWidgetItem(directoryTree);
-        rootItem->setText(0, QString::fromStdString(config.rootPath));
-        addSubDirectories(rootItem, config.rootPath);
-    }
-
     // 更新右侧文件列表
     QTreeWidget* fileList = findChild<QTreeWidget*>("fileList");
     if (fileList) {
@@ -175,8 +195,8 @@ void FileMainWindow::updateDirectoryView() {
             treeItem->setText(0, QString::fromStdString(item.name));
             treeItem->setText(1, item.type == FileType::File ? "文件" : "目录");
             treeItem->setText(2, QString::number(item.size));
-            treeItem->setText(3, item.createTime.toString());
-            treeItem->setText(4, item.modifyTime.toString());
+            treeItem->setText(3, toDateTime(item.createTime).toString());
+            treeItem->setText(4, toDateTime(item.modifyTime).toString());
             fileList->addTopLevelItem(treeItem);
         }
     }
@@ -185,29 +205,35 @@ void FileMainWindow::updateDirectoryView() {
     if (currentPathEdit) {
         currentPathEdit->setText(QString::fromStdString(config.currentPath));
     }
+}
 
-    // 更新文件系统监控器的监控路径
-    if (fileSystemWatcher) {
-        QStringList paths = fileSystemWatcher->directories();
-        if (!paths.isEmpty()) {
-            fileSystemWatcher->removePaths(paths);
-        }
-        // 使用实际路径进行监控
-        std::string actualPath = getFullPath(config.currentPath);
-        fileSystemWatcher->addPath(QString::fromStdString(actualPath));
+// 显示正在执行的后台操作和进度
+void FileMainWindow::updateOperationStatus() {
+    QString name;
+    std::shared_ptr<OperationProgress> progress = operations->current(&name);
+    if (!progress) {
+        statusLabel->setText("就绪");
+        return;
+    }
+    QString text = "正在执行：" + name;
+    if (progress->total > 0) {
+        text += QString(" (%1/%2)").arg(progress->done.load()).arg(progress->total.load());
+    }
+    int pending = operations->pendingCount();
+    if (pending > 0) {
+        text += QString("，排队 %1 个").arg(pending);
     }
+    statusLabel->setText(text);
 }
 
-void FileMainWindow::addSubDirectories(QTreeWidgetItem* parentItem, const std::string& parentPath) {
-    Directory subDirInfo = getDirectoryInfo(parentPath);
-    for (const auto& item : subDirInfo.items) {
-        if (item.type == FileType::Directory) {
-            QTreeWidgetItem* subItem = new QTreeWidgetItem(parentItem);
-            subItem->setText(0, QString::fromStdString(item.name));
-            std::string subVirtualPath = parentPath + "/" + item.name;
-            addSubDirectories(subItem, subVirtualPath);
-        }
-    }
+// 路径的父目录
+static std::string parentPathOf(const std::string& path) {
+    return std::string(VirtualPath(path, config.currentPath).parent());
+}
+
+// 把命令参数解析为虚拟全路径：相对路径基于当前路径，"~" 表示虚拟根目录
+static std::string resolveArgument(const std::string& argument) {
+    return argument == "~" ? config.rootPath : getFullPath(argument);
 }
 
 void FileMainWindow::on_confirmButton_clicked() {
@@ -220,14 +246,9 @@ void FileMainWindow::on_confirmButton_clicked() {
 }
 
 void FileMainWindow::on_exitButton_clicked() {
-    // 保存文件系统到磁盘
-    std::ofstream fatFile("fat.bin", std::ios::binary);
-    fatFile.write(reinterpret_cast<const char*>(fat.data()), fat.size() * sizeof(int));
-    fatFile.close();
-
-    std::ofstream bitmapFile("bitmap.bin", std::ios::binary);
-    bitmapFile.write(reinterpret_cast<const char*>(&bitmap), sizeof(bitmap));
-    bitmapFile.close();
+    // 等已提交的操作执行完，再停止日志提交并做检查点
+    operations->shutdown();
+    unmountFileSystem();
 
     this->close();
 }
@@ -254,29 +275,24 @@ void FileMainWindow::handleCommand(const std::string& command) {
     if (tokens[0] == "mkdir") {
         if (tokens.size() > 1) {
             std::string relativePath = tokens[1];
-            std::string fullVirtualPath;
-            if (relativePath[0] == '/') {
-                fullVirtualPath = relativePath;
-            }
-            else {
-                if (config.currentPath.back() == '/') {
-                    fullVirtualPath = config.currentPath + relativePath;
-                }
-                else {
-                    fullVirtualPath = config.currentPath + "/" + relativePath;
-                }
-            }
+            std::string fullVirtualPath = resolveArgument(relativePath);
             // 查看是否存在同名文件夹，有的话提示用户，并不创建
-			if (QDir(QString::fromStdString(getFullPath(fullVirtualPath))).exists()) {
+			if (isDirectory(fullVirtualPath)) {
 				QMessageBox::warning(this, "提示", "该目录已存在");
 			}
             else {
-                if (createDirectory(fullVirtualPath)) {
-                    QMessageBox::information(this, "成功", "目录创建成功");
-                }
-                else {
-                    QMessageBox::warning(this, "错误", "目录创建失败");
-                }
+                operations->submit(QString::fromStdString(command), [=](OperationProgress&) {
+                    return createDirectory(fullVirtualPath);
+                }, [=](bool ok, bool) {
+                    if (ok) {
+                        directoryModel->refreshDirectory(parentPathOf(fullVirtualPath));
+                        updateDirectoryView();
+                        QMessageBox::information(this, "成功", "目录创建成功");
+                    }
+                    else {
+                        QMessageBox::warning(this, "错误", "目录创建失败");
+                    }
+                });
             }
         }
         else {
@@ -285,57 +301,15 @@ void FileMainWindow::handleCommand(const std::string& command) {
     }
     else if (tokens[0] == "cd") {
         if (tokens.size() > 1) {
-            std::string relativePath = tokens[1];
-            std::string newVirtualPath;
-            if (relativePath == ".") {
-                // 输入 cd . 时路径不变
-                newVirtualPath = config.currentPath;
-            }
-            else if (relativePath == "..") {
-                // 输入 cd .. 时退回上一级
-                size_t pos = config.currentPath.rfind('/');
-                if (pos != std::string::npos) {
-                    newVirtualPath = config.currentPath.substr(0, pos);
-                }
-                if (newVirtualPath.empty()) {
-                    newVirtualPath = "/";
-                }
-                // 检查新路径是否在 /home 目录内
-                if (newVirtualPath.length() < config.rootPath.length() || newVirtualPath.substr(0, config.rootPath.length()) != config.rootPath) {
-                    QMessageBox::warning(this, "错误", "不能跳出 /home 目录");
-                    return;
-                }
-            }
-            else if (relativePath == "~") {
-                // 输入 cd ~ 回到 /home
-                newVirtualPath = "/home";
-            }
-            else {
-                if (relativePath[0] == '/') {
-                    newVirtualPath = relativePath;
-                }
-                else {
-                    if (config.currentPath.back() == '/') {
-                        newVirtualPath = config.currentPath + relativePath;
-                    }
-                    else {
-                        newVirtualPath = config.currentPath + "/" + relativePath;
-                    }
-                }
-            }
-            // 简化路径
-            newVirtualPath = simplifyPath(newVirtualPath);
-
+            std::string newVirtualPath = resolveArgument(tokens[1]);
             // 检查新路径是否在 /home 目录内
-            if (newVirtualPath.length() < config.rootPath.length() || newVirtualPath.substr(0, config.rootPath.length()) != config.rootPath) {
+            if (!VirtualPath(newVirtualPath, "/").isWithin(config.rootPath)) {
                 QMessageBox::warning(this, "错误", "不能跳出 /home 目录");
                 return;
             }
 
-            std::string newActualPath = getFullPath(newVirtualPath);
-            QDir dir(QString::fromStdString(newActualPath));
-            if (dir.exists()) {
-                config.currentPath = newVirtualPath;
+            if (isDirectory(newVirtualPath)) {
+                setCurrentPath(newVirtualPath);
                 if (currentPathEdit) {
                     currentPathEdit->setText(QString::fromStdString(config.currentPath));
                 }
@@ -352,29 +326,23 @@ void FileMainWindow::handleCommand(const std::string& command) {
     else if (tokens[0] == "touch") {
         if (tokens.size() > 1) {
             std::string relativePath = tokens[1];
-            std::string fullVirtualPath;
-            if (relativePath[0] == '/') {
-                fullVirtualPath = relativePath;
-            }
-            else {
-                if (config.currentPath.back() == '/') {
-                    fullVirtualPath = config.currentPath + relativePath;
-                }
-                else {
-                    fullVirtualPath = config.currentPath + "/" + relativePath;
-                }
-            }
+            std::string fullVirtualPath = resolveArgument(relativePath);
 			// 查看是否存在同名文件，有的话提示用户，并不创建
-			if (QFile::exists(QString::fromStdString(getFullPath(fullVirtualPath)))) {
+			if (pathExists(fullVirtualPath)) {
 				QMessageBox::warning(this, "提示", "该文件已存在");
 			}
             else {
-                if (createFile(fullVirtualPath)) {
-                    QMessageBox::information(this, "成功", "文件创建成功");
-                }
-                else {
-                    QMessageBox::warning(this, "错误", "文件创建失败");
-                }
+                operations->submit(QString::fromStdString(command), [=](OperationProgress&) {
+                    return createFile(fullVirtualPath);
+                }, [=](bool ok, bool) {
+                    if (ok) {
+                        updateDirectoryView();
+                        QMessageBox::information(this, "成功", "文件创建成功");
+                    }
+                    else {
+                        QMessageBox::warning(this, "错误", "文件创建失败");
+                    }
+                });
             }
         }
         else {
@@ -384,24 +352,27 @@ void FileMainWindow::handleCommand(const std::string& command) {
     else if (tokens[0] == "rm") {
         if (tokens.size() > 1) {
             std::string relativePath = tokens[1];
-            std::string fullVirtualPath;
-            if (relativePath[0] == '/') {
-                fullVirtualPath = relativePath;
-            }
-            else {
-                if (config.currentPath.back() == '/') {
-                    fullVirtualPath = config.currentPath + relativePath;
+            std::string fullVirtualPath = resolveArgument(relativePath);
+            // 名称立即消失，大目录的块在文件系统的释放线程中回收；收集子树仍可能要一会儿，在后台执行
+            bool wasDirectory = isDirectory(fullVirtualPath);
+            operations->submit(QString::fromStdString(command), [=](OperationProgress& progress) {
+                return deleteItem(fullVirtualPath, &progress);
+            }, [=](bool ok, bool cancelled) {
+                if (wasDirectory) {
+                    directoryModel->refreshDirectory(parentPathOf(fullVirtualPath));
+                    directoryModel->refreshDirectory(fullVirtualPath);
+                }
+                updateDirectoryView();
+                if (ok) {
+                    QMessageBox::information(this, "成功", "文件/目录删除成功");
+                }
+                else if (cancelled) {
+                    QMessageBox::information(this, "提示", "删除已取消");
                 }
                 else {
-                    fullVirtualPath = config.currentPath + "/" + relativePath;
+                    QMessageBox::warning(this, "错误", "文件/目录删除失败");
                 }
-            }
-            if (deleteItem(fullVirtualPath)) {
-                QMessageBox::information(this, "成功", "文件/目录删除成功");
-            }
-            else {
-                QMessageBox::warning(this, "错误", "文件/目录删除失败");
-            }
+            });
         }
         else {
             QMessageBox::warning(this, "错误", "缺少文件/目录名参数");
@@ -410,27 +381,21 @@ void FileMainWindow::handleCommand(const std::string& command) {
     else if (tokens[0] == "read") {
         if (tokens.size() > 1) {
             std::string relativePath = tokens[1];
-            std::string fullVirtualPath;
-            if (relativePath[0] == '/') {
-                fullVirtualPath = relativePath;
-            }
-            else {
-                if (config.currentPath.back() == '/') {
-                    fullVirtualPath = config.currentPath + relativePath;
+            std::string fullVirtualPath = resolveArgument(relativePath);
+            auto content = std::make_shared<std::string>();
+            operations->submit(QString::fromStdString(command), [=](OperationProgress&) {
+                *content = readFileContent(fullVirtualPath);
+                return !content->empty();
+            }, [=](bool ok, bool) {
+                if (ok) {
+                    // 传递false参数，表示只读模式
+                    FileContentView* view = new FileContentView(relativePath, *content, false);
+                    view->show();
                 }
                 else {
-                    fullVirtualPath = config.currentPath + "/" + relativePath;
+                    QMessageBox::warning(this, "错误", "文件为空");
                 }
-            }
-            std::string content = readFileContent(fullVirtualPath);
-            if (!content.empty()) {
-                // 传递false参数，表示只读模式
-                FileContentView* view = new FileContentView(relativePath, content, false);
-                view->show();
-            }
-            else {
-                QMessageBox::warning(this, "错误", "文件为空");
-            }
+            });
         }
         else {
             QMessageBox::warning(this, "错误", "缺少文件名参数");
@@ -439,36 +404,32 @@ void FileMainWindow::handleCommand(const std::string& command) {
     else if (tokens[0] == "write") {
         if (tokens.size() > 1) {
             std::string relativePath = tokens[1];
-            std::string fullVirtualPath;
-            if (relativePath[0] == '/') {
-                fullVirtualPath = relativePath;
-            }
-            else {
-                fullVirtualPath = config.currentPath + (config.currentPath.back() == '/' ? "" : "/") + relativePath;
-            }
-
-            // 读取现有文件内容
-            std::string content = readFileContent(fullVirtualPath);
-
-            // 打开编辑窗口
-            // 传递true参数，表示可编辑模式
-            FileContentView* editor = new FileContentView(relativePath, content, true);
-            connect(editor, &FileContentView::contentSaved, [=](const std::string& newContent) {
-                // 保存修改后的内容
-                if (writeFileContent(fullVirtualPath, newContent)) {
-                    QMessageBox::information(this, "成功", "文件保存成功");
-					// 更新 inode 信息
-					Inode inode = loadInode(relativePath);
-					inode.size = newContent.size();
-					inode.modifyTime = QDateTime::currentDateTime();
-					saveInode(relativePath, inode);
-					updateDirectoryView(); // 更新目录视图
-                }
-                else {
-                    QMessageBox::warning(this, "错误", "文件保存失败");
-                }
+            std::string fullVirtualPath = resolveArgument(relativePath);
+
+            // 在后台读取现有文件内容，读完后打开编辑窗口
+            auto content = std::make_shared<std::string>();
+            operations->submit(QString::fromStdString(command), [=](OperationProgress&) {
+                *content = readFileContent(fullVirtualPath);
+                return true;
+            }, [=](bool, bool) {
+                // 传递true参数，表示可编辑模式
+                FileContentView* editor = new FileContentView(relativePath, *content, true);
+                connect(editor, &FileContentView::contentSaved, [=](const std::string& newContent) {
+                    // 只重写与打开时内容不同的部分，inode 的大小和修改时间只更新一次
+                    operations->submit(QString::fromStdString("save " + fullVirtualPath), [=](OperationProgress&) {
+                        return updateFileContent(fullVirtualPath, *content, newContent);
+                    }, [=](bool ok, bool) {
+                        if (ok) {
+                            QMessageBox::information(this, "成功", "文件保存成功");
+                            updateDirectoryView(); // 更新目录视图
+                        }
+                        else {
+                            QMessageBox::warning(this, "错误", "文件保存失败");
+                        }
+                    });
                 });
-            editor->show();
+                editor->show();
+            });
         }
         else {
             QMessageBox::warning(this, "错误", "缺少文件名参数");
@@ -478,66 +439,28 @@ void FileMainWindow::handleCommand(const std::string& command) {
         if (tokens.size() > 2) {
             std::string oldRelativePath = tokens[1];
             std::string newRelativePath = tokens[2];
-            std::string oldFullVirtualPath;
-            std::string newFullVirtualPath;
-
-            if (oldRelativePath[0] == '/') {
-                oldFullVirtualPath = oldRelativePath;
-            }
-            else {
-                if (config.currentPath.back() == '/') {
-                    oldFullVirtualPath = config.currentPath + oldRelativePath;
-                }
-                else {
-                    oldFullVirtualPath = config.currentPath + "/" + oldRelativePath;
-                }
-            }
-
-            if (newRelativePath[0] == '/') {
-                newFullVirtualPath = newRelativePath;
-            }
-            else {
-                if (config.currentPath.back() == '/') {
-                    newFullVirtualPath = config.currentPath + newRelativePath;
+            std::string oldFullVirtualPath = resolveArgument(oldRelativePath);
+            std::string newFullVirtualPath = resolveArgument(newRelativePath);
+
+            bool wasDirectory = isDirectory(oldFullVirtualPath);
+            operations->submit(QString::fromStdString(command), [=](OperationProgress&) {
+                return renameItem(oldFullVirtualPath, newFullVirtualPath);
+            }, [=](bool ok, bool) {
+                if (ok) {
+                    if (wasDirectory) {
+                        directoryModel->refreshDirectory(parentPathOf(oldFullVirtualPath));
+                        directoryModel->refreshDirectory(parentPathOf(newFullVirtualPath));
+                    }
+                    updateDirectoryView();
+                    QMessageBox::information(this, "成功", "文件/目录重命名成功");
                 }
                 else {
-                    newFullVirtualPath = config.currentPath + "/" + newRelativePath;
+                    QMessageBox::warning(this, "错误", "文件/目录重命名失败");
                 }
-            }
-
-            if (renameItem(oldFullVirtualPath, newFullVirtualPath)) {
-                QMessageBox::information(this, "成功", "文件/目录重命名成功");
-            }
-            else {
-                QMessageBox::warning(this, "错误", "文件/目录重命名失败");
-            }
+            });
         }
         else {
             QMessageBox::warning(this, "错误", "缺少文件名参数");
         }
     }
 }
-
-
-// 处理文件系统变化事件
-void FileMainWindow::onDirectoryChanged(const QString& path) {
-    updateDirectoryView();
-}
-
-bool FileMainWindow::writeFileContent(const std::string& path, const std::string& content) {
-    std::string fullPath = getFullPath(path);
-    QFile file(QString::fromStdString(fullPath));
-    if (file.open(QIODevice::WriteOnly | QIODevice::Text)) {
-        QTextStream out(&file);
-        out << QString::fromStdString(content);
-        file.close();
-
-        // 更新 inode 中的文件大小和修改时间
-        Inode inode = loadInode(path);
-        inode.size = content.size();
-        inode.modifyTime = QDateTime::currentDateTime();
-        saveInode(path, inode);
-        return true;
-    }
-    return false;
-}
\ No newline at end of file
@@ -4,9 +4,13 @@
 #include <QLineEdit>
 #include <QTreeWidget>
 #include <QTreeWidgetItem>
-#include <QFileSystemWatcher> 
+#include <QTreeView>
+#include <QTimer>
+#include <QLabel>
 #include "ui_FileMainWindow.h"
 #include "Utilities.h"
+#include "DirectoryTreeModel.h"
+#include "OperationQueue.h"
 #include <string>
 
 class FileMainWindow : public QMainWindow
@@ -21,18 +25,23 @@ private slots:
     void on_confirmButton_clicked();
     void on_exitButton_clicked();
     void on_commandInput_returnPressed();
-    void onDirectoryChanged(const QString& path);
-    bool writeFileContent(const std::string& path, const std::string& content);
+    void updateOperationStatus();
 private:
     Ui::FileMainWindowClass ui;
     void Init();
     void InitWidget();
     void updateDirectoryView();
-    void addSubDirectories(QTreeWidgetItem* parentItem, const std::string& parentPath);
     const int WINDOW_WIDTH = 1280;
     const int WINDOW_HEIGHT = 720;
     void handleCommand(const std::string& command);
     QLineEdit* currentPathEdit; // 当前路径显示框
     QLineEdit* commandInput; // 命令输入框
-    QFileSystemWatcher* fileSystemWatcher;
+    QTreeView* directoryTree; // 左侧目录树
+    DirectoryTreeModel* directoryModel; // 目录树模型
+    QTimer* syncTimer; // 元数据定期写回定时器
+    const int SYNC_INTERVAL_MS = 5000;
+    OperationQueue* operations; // 后台操作队列
+    QLabel* statusLabel; // 后台操作状态
+    QTimer* progressTimer; // 进度显示刷新定时器
+    const int PROGRESS_INTERVAL_MS = 200;
 };
\ No newline at end of file
@@ -1,183 +1,1589 @@
 ﻿#include "FileSystem.h"
-#include <QFile>
-#include <QDir>
-#include <QTextStream>
+#include "BlockDevice.h"
+#include "BlockCache.h"
+#include "ExtentMap.h"
+#include "DentryCache.h"
+#include "VirtualPath.h"
+#include "NameCache.h"
+#include "Journal.h"
+#include "FileSystemChecker.h"
 #include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <iterator>
+#include <cstring>
+#include <mutex>
+#include <shared_mutex>
+#include <atomic>
+#include <thread>
+#include <condition_variable>
+#include <chrono>
+#include <deque>
+#include <array>
 
-// 定义全局的FAT表和位图
+// 定义全局的FAT表、位图和inode表
 FAT fat;
 Bitmap bitmap;
+InodeTable inodeTable;
 
-void formatFileSystem() {
-    fat.assign(BLOCK_COUNT, -1);
-    bitmap.reset();
-    // 初始化根目录
-    Directory root;
-    root.path = "/";
-    // 保存到磁盘
-    std::ofstream fatFile("fat.bin", std::ios::binary);
-    fatFile.write(reinterpret_cast<const char*>(fat.data()), fat.size() * sizeof(int));
-    fatFile.close();
+// 文件系统锁：读写锁。普通的公开函数（包括创建、删除、改名、写入文件）共享持有，
+// 彼此之间靠 inode 锁互斥；删除和移动目录、挂载、格式化、一致性检查独占持有。
+// 共享持有时目录不会被删除或移动，目录的路径和父目录链不变，子树统计可以沿父目录链
+// 逐条记录原子地累加，位图按组加锁，日志按复合事务收集各线程的修改。
+// 不可重入：公开函数之间不互相调用，共用的部分放在静态辅助函数里
+static std::shared_mutex fsMutex;
+using FileSystemLock = std::lock_guard<std::shared_mutex>;
+using FileSystemReadLock = std::shared_lock<std::shared_mutex>;
+
+// inode 锁：按 inode 号分到固定个数的槽。目录的锁保护它的目录项（和目录项缓存），
+// 文件的锁保护它的数据、块链和大小。持有 inode 锁时不解析路径（解析要逐级加锁），
+// 日志事务在加 inode 锁之前开始、在释放之后结束（提交要等全部进行中的操作结束）
+static const int INODE_LOCK_SLOTS = 1024;
+static std::shared_mutex inodeLocks[INODE_LOCK_SLOTS];
+
+// 一个操作持有的一组 inode 锁：按槽号排序后依次加锁避免死锁，同一槽只锁一次，
+// 其中有独占请求就独占
+class InodeLocks {
+public:
+    InodeLocks() = default;
+    InodeLocks(std::initializer_list<std::pair<int, bool>> inodes) { lock(inodes); }
+    ~InodeLocks() { unlock(); }
+    InodeLocks(const InodeLocks&) = delete;
+    InodeLocks& operator=(const InodeLocks&) = delete;
+
+    // 每项为 (inode 号, 是否独占)
+    void lock(std::initializer_list<std::pair<int, bool>> inodes) {
+        unlock();
+        for (const auto& request : inodes) {
+            size_t slot = static_cast<unsigned>(request.first) % INODE_LOCK_SLOTS;
+            auto it = std::find_if(held_.begin(), held_.begin() + count_, [&](const Slot& s) { return s.first == slot; });
+            if (it != held_.begin() + count_) {
+                it->second = it->second || request.second;
+            }
+            else {
+                held_[count_++] = { slot, request.second };
+            }
+        }
+        std::sort(held_.begin(), held_.begin() + count_);
+        for (size_t i = 0; i < count_; ++i) {
+            if (held_[i].second) {
+                inodeLocks[held_[i].first].lock();
+            }
+            else {
+                inodeLocks[held_[i].first].lock_shared();
+            }
+        }
+    }
+    // 只保留 ino 所在的槽，其余提前释放
+    void keepOnly(int ino) {
+        size_t slot = static_cast<unsigned>(ino) % INODE_LOCK_SLOTS;
+        size_t kept = 0;
+        for (size_t i = 0; i < count_; ++i) {
+            if (held_[i].first == slot) {
+                held_[kept++] = held_[i];
+            }
+            else {
+                release(held_[i]);
+            }
+        }
+        count_ = kept;
+    }
+    void unlock() {
+        for (size_t i = 0; i < count_; ++i) {
+            release(held_[i]);
+        }
+        count_ = 0;
+    }
 
-    std::ofstream bitmapFile("bitmap.bin", std::ios::binary);
-    bitmapFile.write(reinterpret_cast<const char*>(&bitmap), sizeof(bitmap));
-    bitmapFile.close();
+private:
+    using Slot = std::pair<size_t, bool>;
+    static void release(const Slot& slot) {
+        if (slot.second) {
+            inodeLocks[slot.first].unlock();
+        }
+        else {
+            inodeLocks[slot.first].unlock_shared();
+        }
+    }
+    std::array<Slot, 3> held_;   // 一个操作最多涉及三个 inode（改名：两个父目录和自身）
+    size_t count_ = 0;
+};
+
+// 文件数据的写入计数，流式句柄据此判断预读缓冲是否失效。按 inode 号分到固定个数的槽里，
+// 写一个文件只让同一槽的句柄重新读取，不必为每个 inode 常驻一个计数
+static const int DATA_VERSION_SLOTS = 4096;
+static std::atomic<uint64_t> dataVersions[DATA_VERSION_SLOTS];
+
+static void bumpDataVersion(int ino) {
+    dataVersions[static_cast<unsigned>(ino) % DATA_VERSION_SLOTS].fetch_add(1, std::memory_order_relaxed);
 }
 
-// 创建目录
-bool createDirectory(const std::string& path) {
-    std::string fullPath = getFullPath(path);
-    QDir dir(QString::fromStdString(fullPath));
-    if (dir.exists()) {
+static void bumpAllDataVersions() {
+    for (std::atomic<uint64_t>& version : dataVersions) {
+        version.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+// 日志超过这个大小时做检查点
+static const uint64_t CHECKPOINT_BYTES = 32 << 20;
+
+// 提交者之间串行（提交线程、缓冲已满的操作、检查点）。调用者持有文件系统锁（共享或独占）
+// 且不在日志事务中
+static std::mutex commitMutex;
+
+// 持有 commitMutex 且挡住了新操作时调用：封装复合事务，把未钉住的脏块（文件数据）交给磁盘。
+// 放开之后的操作释放这些块时会丢弃缓存中的脏数据，所以要在放开之前写出
+static bool sealTransaction() {
+    journal.seal();
+    return !journal.hasPending() || blockCache.flush();
+}
+
+// 持有 commitMutex 时调用：文件数据刷盘后写日志并刷盘，最后解除已提交事务对目录块的钉住。
+// 崩溃后元数据引用的文件数据一定已经在盘上
+static bool writeJournal() {
+    if (!journal.hasPending()) {
+        return true;
+    }
+    if (!disk.flush() || !journal.commit()) {
         return false;
     }
-    return dir.mkpath(".");
+    blockCache.unpin(journal.committedSequence());
+    return true;
 }
 
-// 创建文件
-bool createFile(const std::string& path) {
-    std::string fullPath = getFullPath(path);
-    QFile file(QString::fromStdString(fullPath));
-    if (file.open(QIODevice::WriteOnly)) {
-        int block = allocateBlock();
-        if (block != -1) {
-            bitmap.set(block);
-            if (block < fat.size()) {
-                fat[block] = -1;
-            }
-            else {
-                std::cerr << "FAT table out of range for block: " << block << std::endl;
-                file.close();
-                return false;
-            }
-            Inode inode;
-            inode.firstBlock = block;
-            inode.size = 0; // 初始大小为 0
-            inode.createTime = QDateTime::currentDateTime();
-            inode.modifyTime = inode.createTime;
-            saveInode(path, inode);
-            return true;
+// 组提交：只在封装时挡住新操作，写日志和 fsync 时其他操作照常进行
+static bool commitJournal() {
+    std::lock_guard<std::mutex> lock(commitMutex);
+    journal.quiesce();
+    bool ok = sealTransaction();
+    journal.resume();
+    return writeJournal() && ok;
+}
+
+// 检查点：提交日志后把块缓存和元数据区写回原位置，然后清空日志，期间挡住新操作
+static bool checkpoint() {
+    if (!journal.isOpen()) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(commitMutex);
+    journal.quiesce();
+    bool ok = sealTransaction();
+    ok = writeJournal() && ok;
+    ok = blockCache.flush() && ok;
+    ok = disk.flush() && ok;
+    ok = metadata.sync() && ok;
+    // 没有全部写回时保留日志，下次挂载时重放
+    if (ok) {
+        journal.countCheckpoint();
+        ok = journal.reset();
+    }
+    journal.resume();
+    return ok;
+}
+
+// 组提交，日志过大时做检查点；只能在事务之外调用
+static void commitAndMaybeCheckpoint() {
+    commitJournal();
+    if (journal.size() >= CHECKPOINT_BYTES) {
+        checkpoint();
+    }
+}
+
+// 一个公开操作的全部修改加入正在运行的复合事务，在持有文件系统锁之后、加 inode 锁之前构造。
+// 按间隔组提交，复合事务过大时由结束的操作立即提交
+class JournalTransaction {
+public:
+    JournalTransaction() {
+        // 钉住的目录块太多时先提交，事务中途不能提交（要等其他操作结束）
+        if (!journal.inTransaction() && blockCache.mostlyPinned()) {
+            commitJournal();
+        }
+        journal.begin();
+    }
+    ~JournalTransaction() {
+        if (journal.end() && !journal.inTransaction()) {
+            commitAndMaybeCheckpoint();
+        }
+    }
+    JournalTransaction(const JournalTransaction&) = delete;
+    JournalTransaction& operator=(const JournalTransaction&) = delete;
+};
+
+// 提交线程：每隔 config.commitIntervalMs 提交一次日志，共享持有文件系统锁，与各操作并行
+static std::thread committer;
+static std::mutex committerMutex;
+static std::condition_variable committerWake;
+static bool committerStop = false;
+
+static void committerLoop() {
+    std::unique_lock<std::mutex> wait(committerMutex);
+    while (!committerStop) {
+        committerWake.wait_for(wait, std::chrono::milliseconds(std::max(1, config.commitIntervalMs)));
+        if (committerStop) {
+            break;
+        }
+        wait.unlock();
+        {
+            FileSystemReadLock lock(fsMutex);
+            commitAndMaybeCheckpoint();
+        }
+        wait.lock();
+    }
+}
+
+static void stopCommitter() {
+    if (!committer.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> wait(committerMutex);
+        committerStop = true;
+    }
+    committerWake.notify_all();
+    committer.join();
+    committerStop = false;
+}
+
+// 卷文件（元数据和磁盘镜像）在宿主机上的路径
+static std::string volumeFilePath(const char* name) {
+    return config.realRootPath + "/" + name;
+}
+
+// 宿主机上的文件是否存在
+static bool hostFileExists(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    return file.good();
+}
+
+// 宿主机的临时目录
+static std::string hostTempDir() {
+    for (const char* name : { "TMPDIR", "TEMP", "TMP" }) {
+        const char* value = std::getenv(name);
+        if (value && *value) {
+            return value;
         }
-        file.close();
     }
-    return false;
+    return "/tmp";
 }
 
-// 删除文件/目录
-bool deleteItem(const std::string& path) {
-    std::string fullPath = getFullPath(path);
-    QFileInfo fileInfo(QString::fromStdString(fullPath));
-    if (fileInfo.isDir()) {
-        QDir dir(QString::fromStdString(fullPath));
-        return dir.removeRecursively();
+// 容纳 size 字节需要的块数，空文件也占用一个块
+static size_t blocksFor(int64_t size, int64_t blockSize) {
+    return std::max<size_t>(1, static_cast<size_t>((size + blockSize - 1) / blockSize));
+}
+
+// 把 inode 的块链调整为 blocksNeeded 块：不够时紧接在最后一块之后追加，多余的块释放
+static bool resizeChain(const Inode& inode, size_t blocksNeeded) {
+    std::shared_ptr<const ExtentMap> map = extentCache.get(inode.firstBlock);
+    size_t current = static_cast<size_t>(map->blockCount());
+    if (current == blocksNeeded) {
+        return true;
+    }
+    int last = map->physicalBlock(static_cast<int64_t>(std::min(current, blocksNeeded)) - 1);
+    if (current < blocksNeeded) {
+        std::vector<int> newBlocks = allocateBlocks(static_cast<int>(blocksNeeded - current), last + 1);
+        if (newBlocks.empty()) {
+            return false;
+        }
+        fat[last] = newBlocks.front();
+        // 块链只在末尾变化，就地更新区段映射
+        extentCache.append(inode.firstBlock, newBlocks);
     }
     else {
-        // 先加载 inode 信息
-        Inode inode = loadInode(path);
-
-		QFile file(QString::fromStdString(fullPath));
-        if (file.remove()) {
-            // 释放物理块
-            int block = inode.firstBlock;
-            while (block != -1 && block < BLOCK_COUNT) {
-                int nextBlock = fat[block];
-                bitmap.reset(block);
-                fat[block] = -1;
-                block = nextBlock;
-            }
+        releaseBlocks(fat[last]);
+        fat[last] = -1;
+        extentCache.truncate(inode.firstBlock, static_cast<int64_t>(blocksNeeded));
+    }
+    return true;
+}
+
+// 读取 inode 数据 [offset, offset + length) 到 buffer，返回读到的字节数：通过区段映射定位起始块，
+// 每段物理连续的块交给块缓存一次读完
+static size_t readDataInto(const Inode& inode, int64_t offset, char* buffer, size_t length) {
+    if (inode.firstBlock < 0 || offset < 0 || offset >= inode.size) {
+        return 0;
+    }
+    length = std::min(length, static_cast<size_t>(inode.size - offset));
+    const int64_t blockSize = getBlockSize();
+    std::shared_ptr<const ExtentMap> map = extentCache.get(inode.firstBlock);
+    size_t done = 0;
+    while (done < length) {
+        int64_t position = offset + static_cast<int64_t>(done);
+        int64_t logical = position / blockSize;
+        size_t inBlock = static_cast<size_t>(position % blockSize);
+        int physical = map->physicalBlock(logical);
+        if (physical < 0) {
+            std::cerr << "Block chain is shorter than inode size." << std::endl;
+            break;
+        }
+        size_t chunk = std::min(static_cast<size_t>(map->contiguousBlocks(logical) * blockSize) - inBlock, length - done);
+        if (!blockCache.read(physical, buffer + done, inBlock, chunk)) {
+            std::cerr << "Failed to read block: " << physical << std::endl;
+            break;
+        }
+        done += chunk;
+    }
+    return done;
+}
+
+static std::string readData(const Inode& inode, int64_t offset, size_t length) {
+    if (inode.firstBlock < 0 || offset < 0 || offset >= inode.size) {
+        return "";
+    }
+    std::string content(std::min(length, static_cast<size_t>(inode.size - offset)), '\0');
+    content.resize(readDataInto(inode, offset, &content[0], content.size()));
+    return content;
+}
+
+// 在 offset 处写入数据，块链必须已经足够长；每段物理连续的块交给块缓存一次写完
+static bool writeData(const Inode& inode, int64_t offset, const char* data, size_t length) {
+    const int64_t blockSize = getBlockSize();
+    std::shared_ptr<const ExtentMap> map = extentCache.get(inode.firstBlock);
+    size_t done = 0;
+    while (done < length) {
+        int64_t position = offset + static_cast<int64_t>(done);
+        int64_t logical = position / blockSize;
+        size_t inBlock = static_cast<size_t>(position % blockSize);
+        int physical = map->physicalBlock(logical);
+        if (physical < 0) {
+            std::cerr << "Block chain is shorter than write range." << std::endl;
+            return false;
+        }
+        size_t chunk = std::min(static_cast<size_t>(map->contiguousBlocks(logical) * blockSize) - inBlock, length - done);
+        // 目录数据是元数据的一部分，记入日志并在缓存中钉住到日志提交；文件数据一般不记日志。
+        // 释放尚未提交就被重新分配的块例外：它在释放提交之前不能写回，
+        // 只能连同数据一起记入日志，否则崩溃后文件已经引用它，数据却不在盘上
+        bool logged = inode.type == FileType::Directory;
+        if (!logged && blockCache.hasFences()) {
+            chunk = std::min(chunk, static_cast<size_t>(blockSize) - inBlock);
+            logged = blockCache.isFenced(physical);
+        }
+        uint64_t pin = 0;
+        if (logged && journal.inTransaction()) {
+            journal.logData(physical, inBlock, data + done, chunk);
+            pin = journal.currentSequence();
+        }
+        if (!blockCache.write(physical, data + done, inBlock, chunk, pin)) {
+            std::cerr << "Failed to write block: " << physical << std::endl;
+            return false;
+        }
+        done += chunk;
+    }
+    return true;
+}
 
-            // 删除对应的 inode 文件
-            std::string inodePath = config.realRootPath + "/inode/" +
-                getFullPath(path).substr(config.realRootPath.length()) + ".inode";
-            QFile inodeFile(QString::fromStdString(inodePath));
-            if (inodeFile.exists() && !inodeFile.remove()) {
-                std::cerr << "Failed to remove inode file: " << inodePath << std::endl;
+// 创建一个新 inode 并分配首块，失败返回 -1
+static int createInode(FileType type, int parent) {
+    int ino = allocateInode();
+    if (ino == -1) {
+        std::cerr << "No free inode." << std::endl;
+        return -1;
+    }
+    // 按父目录分散首块的查找起点：各线程在不同目录中创建时落在位图的不同组
+    int block = allocateBlock(static_cast<int>(static_cast<uint64_t>(parent) * 2654435761u % static_cast<uint64_t>(getBlockCount())));
+    if (block == -1) {
+        removeInode(ino);
+        return -1;
+    }
+    fat[block] = -1;
+    Inode inode;
+    inode.type = type;
+    inode.permissions = type == FileType::Directory ? DEFAULT_DIR_PERMISSIONS : DEFAULT_FILE_PERMISSIONS;
+    inode.linkCount = 1;
+    inode.firstBlock = block;
+    inode.parent = parent;
+    inode.size = 0; // 初始大小为 0
+    inode.createTime = currentTimeNs();
+    inode.modifyTime = inode.createTime;
+    inode.subtreeSize = 0;
+    inode.subtreeFiles = type == FileType::File ? 1 : 0;
+    inode.subtreeInodes = 1;
+    inode.generation = inodeTable.get(ino).generation;
+    saveInode(ino, inode);
+    return ino;
+}
+
+// 把子树大小、文件数和 inode 数的变化沿父目录链一直累加到根目录，代价为 O(深度)。
+// 每条记录在记录锁内原子地累加，不需要目录锁：并发的操作各自累加，互不覆盖
+static void propagateSubtree(int dirIno, int64_t sizeDelta, int64_t filesDelta, int64_t inodesDelta) {
+    if (sizeDelta == 0 && filesDelta == 0 && inodesDelta == 0) {
+        return;
+    }
+    int ino = dirIno;
+    while (ino >= 0) {
+        int parent = -1;
+        inodeTable.update(ino, [&](DiskInode& record) {
+            record.subtreeSize += sizeDelta;
+            record.subtreeFiles += static_cast<int32_t>(filesDelta);
+            record.subtreeInodes += static_cast<int32_t>(inodesDelta);
+            parent = record.parent;
+        });
+        if (ino == ROOT_INODE) {
+            break;
+        }
+        ino = parent;
+    }
+}
+
+// 获取目录的缓存：不在缓存中时一次读出整个目录项区并建立名称哈希。
+// 以下目录项函数都要求调用者持有目录的 inode 锁，修改的要独占
+static std::shared_ptr<CachedDirectory> loadDirectory(int dirIno) {
+    if (std::shared_ptr<CachedDirectory> cached = dentryCache.find(dirIno)) {
+        return cached;
+    }
+    Inode dir = loadInode(dirIno);
+    std::string data = readData(dir, 0, static_cast<size_t>(dir.size));
+    CachedDirectory result;
+    result.slotCount = static_cast<int>(data.size() / sizeof(DirEntry));
+    result.entries.reserve(result.slotCount);
+    result.names.resize(result.slotCount);
+    for (int slot = 0; slot < result.slotCount; ++slot) {
+        DirEntry entry;
+        std::memcpy(&entry, data.data() + slot * sizeof(DirEntry), sizeof(DirEntry));
+        if (entry.ino == -1) {
+            result.freeSlots.push_back(slot);
+        }
+        else {
+            entry.name[DIR_NAME_MAX] = '\0';
+            result.add(std::string_view(entry.name, std::strlen(entry.name)), entry.ino, slot);
+        }
+    }
+    return dentryCache.insert(dirIno, std::move(result));
+}
+
+// 目录中全部子项的 (名称, inode 号)
+static std::vector<std::pair<std::string, int>> listEntries(int dirIno) {
+    std::shared_ptr<const CachedDirectory> dir = loadDirectory(dirIno);
+    std::vector<std::pair<std::string, int>> entries;
+    entries.reserve(dir->entries.size());
+    for (const auto& entry : dir->entries) {
+        entries.emplace_back(entry.first, entry.second.ino);
+    }
+    return entries;
+}
+
+// 在目录中查找名称，返回 inode 号，不存在返回 -1
+static int lookupEntry(int dirIno, std::string_view name) {
+    std::shared_ptr<const CachedDirectory> dir = loadDirectory(dirIno);
+    auto it = dir->entries.find(name);
+    return it == dir->entries.end() ? -1 : it->second.ino;
+}
+
+// 向目录中添加目录项：优先复用空槽，否则追加到末尾
+static bool addEntry(int dirIno, std::string_view name, int ino) {
+    if (name.empty() || name.size() > DIR_NAME_MAX || name.find('/') != std::string_view::npos) {
+        return false;
+    }
+    std::shared_ptr<CachedDirectory> dirCache = loadDirectory(dirIno);
+    CachedDirectory& cached = *dirCache;
+    int slot = cached.freeSlots.empty() ? cached.slotCount : cached.freeSlots.back();
+    Inode dir = loadInode(dirIno);
+    int64_t offset = static_cast<int64_t>(slot) * static_cast<int64_t>(sizeof(DirEntry));
+    if (slot == cached.slotCount) {
+        dir.size = offset + static_cast<int64_t>(sizeof(DirEntry));
+        if (!resizeChain(dir, blocksFor(dir.size, getBlockSize()))) {
+            return false;
+        }
+    }
+    DirEntry entry = {};
+    entry.ino = ino;
+    std::memcpy(entry.name, name.data(), name.size());
+    if (!writeData(dir, offset, reinterpret_cast<const char*>(&entry), sizeof(entry))) {
+        return false;
+    }
+    // 只改大小和修改时间，子树统计可能正被其他操作累加
+    inodeTable.update(dirIno, [&](DiskInode& record) {
+        record.size = dir.size;
+        record.modifyTime = currentTimeNs();
+    });
+    // 原地更新缓存
+    if (slot == cached.slotCount) {
+        cached.slotCount++;
+    }
+    else {
+        cached.freeSlots.pop_back();
+    }
+    cached.add(name, ino, slot);
+    return true;
+}
+
+// 从目录中删除名称对应的目录项（留下空槽）
+static bool removeEntry(int dirIno, std::string_view name) {
+    std::shared_ptr<CachedDirectory> dirCache = loadDirectory(dirIno);
+    CachedDirectory& cached = *dirCache;
+    auto it = cached.entries.find(name);
+    if (it == cached.entries.end()) {
+        return false;
+    }
+    int slot = it->second.slot;
+    Inode dir = loadInode(dirIno);
+    DirEntry empty = {};
+    empty.ino = -1;
+    if (!writeData(dir, static_cast<int64_t>(slot) * static_cast<int64_t>(sizeof(DirEntry)), reinterpret_cast<const char*>(&empty), sizeof(empty))) {
+        return false;
+    }
+    inodeTable.update(dirIno, [&](DiskInode& record) { record.modifyTime = currentTimeNs(); });
+    cached.entries.erase(it);
+    cached.freeSlots.push_back(slot);
+    return true;
+}
+
+// inode 是否是已分配的目录。不报错：查找和加锁之间文件可能已被删除
+static bool isDirectoryInode(int ino) {
+    Inode inode;
+    return ino >= 0 && ino < inodeTable.size() && decodeInode(inodeTable.get(ino), inode)
+        && inode.type == FileType::Directory;
+}
+
+// 从根目录沿路径的前 depth 个组件逐级查找，返回 inode 号，不存在返回 -1。
+// 每一级在目录的共享锁内查找并把结果（包括不存在）记入路径缓存，与修改这一项的操作有先后，
+// 缓存中不会留下过时的结果。中间一级必须是目录：目录在共享持有文件系统锁时不会被删除或移动，
+// 文件则可能随时被删除，经过文件的路径不存在，也不缓存
+static int walkPath(const VirtualPath& path, size_t depth) {
+    int ino = ROOT_INODE;
+    for (size_t i = 0; i < depth; ++i) {
+        InodeLocks lock({ { ino, false } });
+        int child = lookupEntry(ino, path.component(i));
+        nameCache.insert(path.prefix(i + 1), child);
+        if (child == -1 || (i + 1 < depth && !isDirectoryInode(child))) {
+            return -1;
+        }
+        ino = child;
+    }
+    return ino;
+}
+
+// 解析路径的前 depth 个组件：先查路径缓存，未命中时逐级查找。调用者不能持有 inode 锁
+static int resolvePath(const VirtualPath& path, size_t depth) {
+    if (depth == 0) {
+        return ROOT_INODE;
+    }
+    int ino;
+    if (nameCache.find(path.prefix(depth), ino)) {
+        return ino;
+    }
+    return walkPath(path, depth);
+}
+
+// 锁住路径对应的 inode 和它的父目录（根目录没有父目录，parent 为 -1）。查找和加锁之间
+// 目录项可能被删除或改名，加锁后确认仍指向它，否则按新的查找结果重试。
+// 返回 inode 号，不存在返回 -1（不持有锁）
+static int lockPath(const VirtualPath& path, bool parentExclusive, bool exclusive, InodeLocks& locks, int& parent) {
+    if (path.isRoot()) {
+        parent = -1;
+        locks.lock({ { ROOT_INODE, exclusive } });
+        return ROOT_INODE;
+    }
+    parent = resolvePath(path, path.depth() - 1);
+    if (!isDirectoryInode(parent)) {
+        return -1;
+    }
+    while (true) {
+        int ino = resolvePath(path, path.depth());
+        if (ino == -1) {
+            return -1;
+        }
+        locks.lock({ { parent, parentExclusive }, { ino, exclusive } });
+        if (lookupEntry(parent, path.name()) == ino) {
+            return ino;
+        }
+        locks.unlock();
+        nameCache.invalidate(path.str());
+    }
+}
+
+// 路径对应的 inode 号，不存在返回 -1
+static int lookupInode(const std::string& path) {
+    VirtualPath fullPath = fullPathOf(path);
+    return resolvePath(fullPath, fullPath.depth());
+}
+
+// 目录中全部子项的 inode 号：在缓存中时直接取，否则直接解析目录数据，不为将要释放的目录建立缓存
+static std::vector<int> childInodes(int dirIno, const Inode& dir) {
+    std::vector<int> children;
+    if (std::shared_ptr<const CachedDirectory> cached = dentryCache.find(dirIno)) {
+        children.reserve(cached->entries.size());
+        for (const auto& entry : cached->entries) {
+            children.push_back(entry.second.ino);
+        }
+        return children;
+    }
+    std::string data = readData(dir, 0, static_cast<size_t>(dir.size));
+    for (size_t offset = 0; offset + sizeof(DirEntry) <= data.size(); offset += sizeof(DirEntry)) {
+        int32_t ino;
+        std::memcpy(&ino, data.data() + offset + offsetof(DirEntry, ino), sizeof(ino));
+        if (ino != -1) {
+            children.push_back(ino);
+        }
+    }
+    return children;
+}
+
+// 按后序（子项在前）收集子树中的全部 inode。只收集 parent 指向所在目录的已分配子项：
+// 后台释放中途崩溃后，目录项可能指向已经释放甚至被重新分配的 inode
+static void collectSubtree(int ino, std::vector<int>& inodes) {
+    Inode inode;
+    if (decodeInode(inodeTable.get(ino), inode) && inode.type == FileType::Directory) {
+        for (int child : childInodes(ino, inode)) {
+            Inode childInode;
+            if (child >= 0 && child < inodeTable.size() && decodeInode(inodeTable.get(child), childInode)
+                && childInode.parent == ino) {
+                collectSubtree(child, inodes);
             }
-            return true;
         }
+    }
+    inodes.push_back(ino);
+}
+
+// 批量释放一组 inode（目录的子项须在组内靠前或已经释放）：收集全部块链后排序，
+// 按连续段整字清除位图、整段重置 FAT，inode 一次串进空闲链表
+static void releaseInodes(const std::vector<int>& inodes) {
+    std::vector<int> blocks;
+    const int blockCount = getBlockCount();
+    for (int ino : inodes) {
+        Inode inode;
+        if (!decodeInode(inodeTable.get(ino), inode)) {
+            continue;
+        }
+        for (int block = inode.firstBlock; block >= 0 && block < blockCount; block = fat[block]) {
+            blocks.push_back(block);
+        }
+        // inode 号和块都可能被重新分配，丢弃它们的缓存
+        extentCache.invalidate(inode.firstBlock);
+        bumpDataVersion(ino);
+        if (inode.type == FileType::Directory) {
+            dentryCache.invalidate(ino);
+        }
+    }
+    std::sort(blocks.begin(), blocks.end());
+    blocks.erase(std::unique(blocks.begin(), blocks.end()), blocks.end());
+    // 与 releaseBlocks 相同：释放提交之前块的新内容不能写回，记过日志的块重放时不能覆盖新用途
+    const uint64_t sequence = journal.currentSequence();
+    for (int block : blocks) {
+        blockCache.discard(block, sequence);
+        journal.revoke(block);
+    }
+    for (size_t i = 0; i < blocks.size();) {
+        size_t j = i + 1;
+        while (j < blocks.size() && blocks[j] == blocks[j - 1] + 1) {
+            ++j;
+        }
+        bitmap.resetRange(blocks[i], static_cast<int>(j - i));
+        fat.fillRun(blocks[i], static_cast<int>(j - i), -1);
+        i = j;
+    }
+    inodeTable.release(inodes);
+}
+
+// 释放 inode 及其全部块，目录连同整棵子树
+static void releaseInode(int ino) {
+    std::vector<int> inodes;
+    collectSubtree(ino, inodes);
+    releaseInodes(inodes);
+}
+
+// 子树中的 inode 数（文件和目录）超过这个值时在后台释放
+static const int64_t BACKGROUND_DELETE_INODES = 4096;
+// 后台释放每批（一次加锁、一个事务）释放的 inode 数
+static const size_t RECLAIM_BATCH = 4096;
+
+// 后台释放：大子树从目录树上摘下（子树根的 parent 置为 DETACHED_PARENT，并记入超级块的列表）
+// 后交给释放线程，按后序分批释放，批与批之间其他操作照常进行。
+// 崩溃或退出时没有释放完的子树在下次挂载时按超级块中的列表找回，不用扫描 inode 表。
+// 一致性检查期间暂停，检查器看到的摘下的子树不会在检查中途变化
+static std::thread reaper;
+static std::mutex reaperMutex;
+static std::condition_variable reaperWake;
+static std::deque<int> detachedRoots;    // 等待释放的子树根
+static bool reaperBusy = false;          // 正在释放队首的子树
+static int reaperPauses = 0;
+static std::atomic<bool> reaperStop{ false };
+
+// 把摘下的子树根记入超级块，列表已满时返回 false。调用者持有文件系统锁并在事务中
+static bool recordDetachedRoot(int root) {
+    Superblock& sb = metadata.superblock();
+    if (sb.detachedCount >= MAX_DETACHED_ROOTS) {
         return false;
     }
+    sb.detachedRoots[sb.detachedCount++] = root;
+    metadata.markSuperblockDirty();
+    return true;
 }
 
-// 获取目录信息
-Directory getDirectoryInfo(const std::string& path) {
-    Directory dirInfo;
-    std::string actualPath = getFullPath(path);
-    dirInfo.path = actualPath;
-    QDir dir(QString::fromStdString(actualPath));
-    QFileInfoList fileList = dir.entryInfoList(QDir::AllEntries | QDir::NoDotAndDotDot);
-    for (const auto& fileInfo : fileList) {
-        std::string fullPath = fileInfo.absoluteFilePath().toStdString();
-        // 检查文件或目录是否在自定义文件系统范围内
-        if (fullPath.find(config.realRootPath) == 0) {
-            FileItem item;
-            item.name = fileInfo.fileName().toStdString();
-            item.type = fileInfo.isDir() ? FileType::Directory : FileType::File;
-            if (item.type == FileType::Directory) {
-                // 递归计算文件夹大小
-                QDir subDir(fileInfo.absoluteFilePath());
-                QFileInfoList subFileList = subDir.entryInfoList(QDir::AllEntries | QDir::NoDotAndDotDot);
-                qint64 totalSize = 0;
-                for (const auto& subFileInfo : subFileList) {
-                    totalSize += subFileInfo.size();
+// 从超级块的列表中去掉子树根，与释放它的最后一批在同一事务中
+static void forgetDetachedRoot(int root) {
+    Superblock& sb = metadata.superblock();
+    for (int i = 0; i < sb.detachedCount; ++i) {
+        if (sb.detachedRoots[i] == root) {
+            sb.detachedRoots[i] = sb.detachedRoots[--sb.detachedCount];
+            metadata.markSuperblockDirty();
+            return;
+        }
+    }
+}
+
+// root 是否仍是摘下的子树根；一致性检查可能已经把它当作损坏的 inode 释放
+static bool isDetachedRoot(int root) {
+    Inode inode;
+    return root >= 0 && root < inodeTable.size() && decodeInode(inodeTable.get(root), inode)
+        && inode.parent == DETACHED_PARENT;
+}
+
+// 分批释放以 root 为根的摘下的子树，被要求停止时返回 false
+static bool reclaimSubtree(int root) {
+    std::vector<int> inodes;
+    {
+        FileSystemReadLock lock(fsMutex);
+        if (isDetachedRoot(root)) {
+            collectSubtree(root, inodes);
+        }
+    }
+    if (inodes.empty()) {
+        FileSystemLock lock(fsMutex);
+        if (!isDetachedRoot(root)) {
+            JournalTransaction transaction;
+            forgetDetachedRoot(root);
+        }
+        return true;
+    }
+    std::vector<int> batch;
+    for (size_t begin = 0; begin < inodes.size(); begin += RECLAIM_BATCH) {
+        if (reaperStop) {
+            return false;
+        }
+        size_t end = std::min(inodes.size(), begin + RECLAIM_BATCH);
+        batch.assign(inodes.begin() + begin, inodes.begin() + end);
+        FileSystemLock lock(fsMutex);
+        JournalTransaction transaction;
+        releaseInodes(batch);
+        // 后序的最后一项就是子树根
+        if (end == inodes.size()) {
+            forgetDetachedRoot(root);
+        }
+    }
+    return true;
+}
+
+static void reaperLoop() {
+    std::unique_lock<std::mutex> wait(reaperMutex);
+    while (true) {
+        reaperWake.wait(wait, [] { return reaperStop || (!detachedRoots.empty() && reaperPauses == 0); });
+        if (reaperStop) {
+            break;
+        }
+        int root = detachedRoots.front();
+        reaperBusy = true;
+        wait.unlock();
+        bool finished = reclaimSubtree(root);
+        wait.lock();
+        reaperBusy = false;
+        if (finished) {
+            detachedRoots.pop_front();
+        }
+        reaperWake.notify_all();
+    }
+}
+
+// 把摘下的子树交给释放线程，必要时启动它
+static void queueReclaim(int root) {
+    std::lock_guard<std::mutex> wait(reaperMutex);
+    detachedRoots.push_back(root);
+    if (!reaper.joinable()) {
+        reaper = std::thread(reaperLoop);
+    }
+    reaperWake.notify_all();
+}
+
+// 停止释放线程（当前一批释放完为止），未释放完的子树留到下次挂载。不能在持有文件系统锁时调用
+static void stopReaper() {
+    if (reaper.joinable()) {
+        reaperStop = true;
+        reaperWake.notify_all();
+        reaper.join();
+        reaperStop = false;
+    }
+    std::lock_guard<std::mutex> wait(reaperMutex);
+    detachedRoots.clear();
+}
+
+// 暂停释放线程，等正在释放的子树释放完；不能在持有文件系统锁时调用
+static void pauseReaper() {
+    std::unique_lock<std::mutex> wait(reaperMutex);
+    reaperPauses++;
+    reaperWake.wait(wait, [] { return !reaperBusy; });
+}
+
+static void resumeReaper() {
+    std::lock_guard<std::mutex> wait(reaperMutex);
+    reaperPauses--;
+    reaperWake.notify_all();
+}
+
+// 打开卷的日志。封装事务前把内存中的空闲块数和空闲 inode 链表写入超级块，并入同一条记录
+static bool openJournal() {
+    if (!journal.open(volumeFilePath("journal.bin"))) {
+        return false;
+    }
+    journal.setSealHook([] {
+        bitmap.storeFreeCount();
+        inodeTable.storeFreeList();
+    });
+    return true;
+}
+
+// 格式化卷，调用者持有文件系统锁。几何参数不合法时不改动原来的卷，返回 false
+static bool formatVolume(int blockSize, int blockCount) {
+    // 创建元数据映射区（超级块 | FAT | 位图 | inode 表）
+    int inodeCount = std::max(1, blockCount / BLOCKS_PER_INODE);
+    if (!metadata.create(volumeFilePath("meta.bin"), blockSize, blockCount, inodeCount)) {
+        std::cerr << "Failed to create metadata file." << std::endl;
+        return false;
+    }
+    attachMetadata();
+    fat.assign(-1);
+    bitmap.reset();
+    inodeTable.format();
+    extentCache.clear();
+    dentryCache.clear();
+    nameCache.clear();
+
+    // 创建并预分配虚拟磁盘镜像
+    if (!disk.create(volumeFilePath("disk.img"), blockSize, blockCount)) {
+        std::cerr << "Failed to create disk image." << std::endl;
+        metadata.close();
+        return false;
+    }
+    blockCache.attach(&disk, config.cacheSize);
+    if (!openJournal()) {
+        disk.close();
+        metadata.close();
+        return false;
+    }
+    // 初始化根目录，空闲链表保证它得到 0 号 inode
+    if (createInode(FileType::Directory, ROOT_INODE) != ROOT_INODE) {
+        std::cerr << "Failed to create root directory." << std::endl;
+        return false;
+    }
+    // 格式化的修改不记日志，直接写回并清空旧卷留下的日志
+    return checkpoint();
+}
+
+bool formatFileSystem(int blockSize, int blockCount) {
+    stopReaper();
+    FileSystemLock lock(fsMutex);
+    return formatVolume(blockSize, blockCount);
+}
+
+// 依次创建路径上不存在的各级目录，路径已存在（包括同时被其他操作创建）时返回 false。
+// 每次只锁一级目录：先共享查找，不存在时再独占并重新查找
+static bool makeDirectories(const VirtualPath& fullPath) {
+    if (resolvePath(fullPath, fullPath.depth()) != -1) {
+        return false;
+    }
+    int ino = ROOT_INODE;
+    bool created = false;
+    for (size_t i = 0; i < fullPath.depth(); ++i) {
+        std::string_view name = fullPath.component(i);
+        int child;
+        {
+            InodeLocks lock({ { ino, false } });
+            child = lookupEntry(ino, name);
+        }
+        created = false;
+        if (child == -1) {
+            InodeLocks lock({ { ino, true } });
+            child = lookupEntry(ino, name);
+            if (child == -1) {
+                child = createInode(FileType::Directory, ino);
+                if (child == -1) {
+                    return false;
                 }
-                item.size = totalSize;
-            }
-            else {
-                item.size = fileInfo.size();
+                if (!addEntry(ino, name, child)) {
+                    releaseInode(child);
+                    return false;
+                }
+                nameCache.insert(fullPath.prefix(i + 1), child);
+                propagateSubtree(ino, 0, 0, 1);
+                created = true;
             }
-            item.createTime = fileInfo.birthTime();
-            item.modifyTime = fileInfo.lastModified();
-            item.inode = -1;
-            dirInfo.items.push_back(item);
         }
+        if (!created && !isDirectoryInode(child)) {
+            return false;
+        }
+        ino = child;
+    }
+    return created;
+}
+
+bool mountFileSystem() {
+    stopReaper();
+    FileSystemLock lock(fsMutex);
+    std::vector<int> detached;
+    // 重新挂载前给上一个卷做检查点
+    if (journal.isOpen()) {
+        checkpoint();
+        journal.close();
+    }
+    extentCache.clear();
+    dentryCache.clear();
+    nameCache.clear();
+    // 只有元数据文件或磁盘镜像不存在、或者明确要求时才格式化。
+    // 已有的卷打不开（版本不符、文件损坏、暂时无法访问）时挂载失败，不能擦掉它
+    if (config.forceFormat || !hostFileExists(volumeFilePath("meta.bin"))
+        || !hostFileExists(volumeFilePath("disk.img"))) {
+        if (!formatVolume(config.blockSize, config.blockCount)) {
+            return false;
+        }
+    }
+    // 几何参数从超级块读取，只建立内存映射，FAT 表、位图和 inode 表按需换页，无需整体读入
+    else {
+        if (!metadata.open(volumeFilePath("meta.bin"))) {
+            std::cerr << "Failed to open the volume in " << config.realRootPath
+                << "; it was left untouched, use --format to reformat it." << std::endl;
+            return false;
+        }
+        if (!disk.open(volumeFilePath("disk.img"), metadata.blockSize(), metadata.blockCount())) {
+            std::cerr << "Failed to open disk image." << std::endl;
+            metadata.close();
+            return false;
+        }
+        // 重放日志中已提交的事务，要在根据元数据建立内存索引之前；
+        // 日志打不开时不能在没有重放的元数据上建立索引
+        if (!openJournal()) {
+            disk.close();
+            metadata.close();
+            return false;
+        }
+        int recovered = journal.replay(metadata, disk);
+        if (recovered > 0) {
+            std::cerr << "Recovered " << recovered << " transactions from the journal." << std::endl;
+        }
+        attachMetadata();
+        blockCache.attach(&disk, config.cacheSize);
+        if (journal.size() > 0) {
+            checkpoint();
+        }
+        // 找回上次没有释放完的子树
+        const Superblock& sb = metadata.superblock();
+        for (int i = 0; i < std::min(sb.detachedCount, MAX_DETACHED_ROOTS); ++i) {
+            detached.push_back(sb.detachedRoots[i]);
+        }
+    }
+    if (!metadata.isOpen() || !disk.isOpen() || !journal.isOpen()) {
+        return false;
+    }
+    if (!committer.joinable()) {
+        committer = std::thread(committerLoop);
+    }
+    // 进程正常退出时做检查点
+    static bool exitHookRegistered = false;
+    if (!exitHookRegistered) {
+        std::atexit(unmountFileSystem);
+        exitHookRegistered = true;
+    }
+    for (int root : detached) {
+        queueReclaim(root);
+    }
+    // 虚拟根目录不存在时创建
+    VirtualPath rootPath = fullPathOf(config.rootPath);
+    if (!isDirectoryInode(resolvePath(rootPath, rootPath.depth()))) {
+        JournalTransaction transaction;
+        makeDirectories(rootPath);
+    }
+    return true;
+}
+
+int lookupPath(const std::string& path) {
+    FileSystemReadLock lock(fsMutex);
+    return lookupInode(path);
+}
+
+bool pathExists(const std::string& path) {
+    FileSystemReadLock lock(fsMutex);
+    return lookupInode(path) != -1;
+}
+
+bool isDirectory(const std::string& path) {
+    FileSystemReadLock lock(fsMutex);
+    return isDirectoryInode(lookupInode(path));
+}
+
+// 创建目录（同时创建不存在的上级目录）
+bool createDirectory(const std::string& path) {
+    FileSystemReadLock lock(fsMutex);
+    JournalTransaction transaction;
+    return makeDirectories(fullPathOf(path));
+}
+
+// 创建文件：分配 inode 和首块，并在父目录中添加目录项。只独占父目录，不同目录中的创建并行
+bool createFile(const std::string& path) {
+    FileSystemReadLock lock(fsMutex);
+    JournalTransaction transaction;
+    VirtualPath fullPath = fullPathOf(path);
+    if (fullPath.isRoot()) {
+        return false;
+    }
+    std::string_view name = fullPath.name();
+    int parent = resolvePath(fullPath, fullPath.depth() - 1);
+    if (!isDirectoryInode(parent)) {
+        return false;
+    }
+    InodeLocks locks({ { parent, true } });
+    if (lookupEntry(parent, name) != -1) {
+        return false;
+    }
+    int ino = createInode(FileType::File, parent);
+    if (ino == -1) {
+        return false;
+    }
+    if (!addEntry(parent, name, ino)) {
+        releaseInode(ino);
+        return false;
+    }
+    nameCache.insert(fullPath.str(), ino);
+    propagateSubtree(parent, 0, 1, 1);
+    return true;
+}
+
+// 删除文件：共享持有文件系统锁，独占父目录和文件本身。不是文件时返回 -1，由调用者按目录删除
+static int deleteFile(const VirtualPath& fullPath, OperationProgress* progress) {
+    FileSystemReadLock lock(fsMutex);
+    JournalTransaction transaction;
+    InodeLocks locks;
+    int parent;
+    int ino = lockPath(fullPath, true, true, locks, parent);
+    if (ino == -1) {
+        return 0;
+    }
+    Inode inode = loadInode(ino);
+    if (inode.type != FileType::File) {
+        return -1;
+    }
+    if (progress) {
+        progress->total = inode.subtreeFiles;
+    }
+    if (!removeEntry(parent, fullPath.name())) {
+        return 0;
+    }
+    nameCache.insert(fullPath.str(), -1);
+    propagateSubtree(parent, -inode.subtreeSize, -inode.subtreeFiles, -inode.subtreeInodes);
+    releaseInode(ino);
+    if (progress) {
+        progress->done = inode.subtreeFiles;
+    }
+    return 1;
+}
+
+// 删除文件/目录：一个事务中从父目录删除目录项、扣除子树统计，名称立即消失。
+// 子树不大时在同一事务中批量释放全部块和 inode，否则把子树摘下交给释放线程在后台分批释放。
+// 文件只锁父目录和自身；目录的子树统计和路径要整体变化，独占文件系统锁
+bool deleteItem(const std::string& path, OperationProgress* progress) {
+    VirtualPath fullPath = fullPathOf(path);
+    if (fullPath.isRoot() || (progress && progress->cancelled)) {
+        return false;
+    }
+    int deleted = deleteFile(fullPath, progress);
+    if (deleted != -1) {
+        return deleted == 1;
+    }
+    // 是目录：放开后独占文件系统锁重新查找，期间它可能已被删除或换成了文件
+    FileSystemLock lock(fsMutex);
+    JournalTransaction transaction;
+    int ino = resolvePath(fullPath, fullPath.depth());
+    if (ino == -1 || ino == ROOT_INODE || (progress && progress->cancelled)) {
+        return false;
+    }
+    Inode inode = loadInode(ino);
+    // 进度按文件数计算，总数直接取自 inode 上的子树统计
+    if (progress) {
+        progress->total = inode.subtreeFiles;
+    }
+    if (!removeEntry(inode.parent, fullPath.name())) {
+        return false;
+    }
+    if (inode.type == FileType::Directory) {
+        nameCache.invalidateTree(fullPath.str());
+    }
+    nameCache.insert(fullPath.str(), -1);
+    propagateSubtree(inode.parent, -inode.subtreeSize, -inode.subtreeFiles, -inode.subtreeInodes);
+    // 超级块中的列表已满时退回同步释放
+    if (inode.type == FileType::Directory && inode.subtreeInodes > BACKGROUND_DELETE_INODES
+        && recordDetachedRoot(ino)) {
+        inode.parent = DETACHED_PARENT;
+        saveInode(ino, inode);
+        queueReclaim(ino);
+    }
+    else {
+        releaseInode(ino);
+    }
+    if (progress) {
+        progress->done = inode.subtreeFiles;
+    }
+    return true;
+}
+
+// 获取目录信息：一次读出全部目录项，每项的元数据只是一次 inode 表查找
+Directory getDirectoryInfo(const std::string& path) {
+    FileSystemReadLock lock(fsMutex);
+    Directory dirInfo;
+    VirtualPath fullPath = fullPathOf(path);
+    dirInfo.path = fullPath.toString();
+    int dirIno = resolvePath(fullPath, fullPath.depth());
+    if (!isDirectoryInode(dirIno)) {
+        return dirInfo;
+    }
+    // 持有目录的共享锁时子项不会被删除
+    InodeLocks locks({ { dirIno, false } });
+    // 按名称排序显示
+    std::vector<std::pair<std::string, int>> entries = listEntries(dirIno);
+    std::sort(entries.begin(), entries.end());
+    dirInfo.items.reserve(entries.size());
+    for (const auto& entry : entries) {
+        Inode inode = loadInode(entry.second);
+        FileItem item;
+        item.name = entry.first;
+        item.type = inode.type;
+        // 目录的大小和文件数直接取自 inode 上的子树统计
+        item.size = inode.subtreeSize;
+        item.fileCount = inode.subtreeFiles;
+        item.createTime = inode.createTime;
+        item.modifyTime = inode.modifyTime;
+        item.inode = entry.second;
+        dirInfo.items.push_back(item);
     }
     return dirInfo;
 }
 
+bool getDiskUsage(const std::string& path, int64_t& totalSize, int64_t& fileCount) {
+    FileSystemReadLock lock(fsMutex);
+    InodeLocks locks;
+    int parent;
+    int ino = lockPath(fullPathOf(path), false, false, locks, parent);
+    if (ino == -1) {
+        return false;
+    }
+    Inode inode = loadInode(ino);
+    totalSize = inode.subtreeSize;
+    fileCount = inode.subtreeFiles;
+    return true;
+}
+
+std::vector<std::string> getSubdirectoryNames(const std::string& path) {
+    FileSystemReadLock lock(fsMutex);
+    std::vector<std::string> names;
+    int dirIno = lookupInode(path);
+    if (!isDirectoryInode(dirIno)) {
+        return names;
+    }
+    InodeLocks locks({ { dirIno, false } });
+    for (const auto& entry : listEntries(dirIno)) {
+        if (loadInode(entry.second).type == FileType::Directory) {
+            names.push_back(entry.first);
+        }
+    }
+    std::sort(names.begin(), names.end());
+    return names;
+}
+
 // 打开文件进行编辑
+// 文件内容在虚拟磁盘中，先导出到临时文件，编辑结束后再写回
 bool openFileForEdit(const std::string& path) {
-    std::string fullPath = getFullPath(path);
-    QFile file(QString::fromStdString(fullPath));
-    if (file.open(QIODevice::ReadWrite | QIODevice::Text)) {
-        std::string command = "notepad.exe \"" + fullPath + "\""; // 适用于 Windows 系统
-        int result = std::system(command.c_str());
-        file.close();
-        return result == 0;
+    std::string tempPath = hostTempDir() + "/" + path.substr(path.rfind('/') + 1);
+    std::ofstream out(tempPath, std::ios::binary);
+    if (!out) {
+        return false;
+    }
+    std::string content = readFileContent(path);
+    out.write(content.data(), content.size());
+    out.close();
+
+    std::string command = "notepad.exe \"" + tempPath + "\""; // 适用于 Windows 系统
+    int result = std::system(command.c_str());
+    if (result != 0) {
+        return false;
+    }
+    std::ifstream in(tempPath, std::ios::binary);
+    std::string newContent((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    in.close();
+    std::remove(tempPath.c_str());
+    return writeFileContent(path, newContent);
+}
+
+// 读取文件类型的 inode，未分配（如已被删除）或不是文件时返回 false
+static bool loadFileInode(int ino, Inode& inode) {
+    if (ino < 0 || ino >= inodeTable.size() || !decodeInode(inodeTable.get(ino), inode)) {
+        return false;
     }
-    return false;
+    return inode.type == FileType::File && inode.firstBlock >= 0;
+}
+
+// 按文件标识读取 inode：inode 号已被释放并重新分配给别的文件时代数不同，返回 false
+static bool loadFileInode(FileId file, Inode& inode) {
+    return loadFileInode(file.ino, inode) && inode.generation == file.generation;
+}
+
+// 锁住路径对应的文件并读取 inode：确认目录项后只保留文件自身的锁（exclusive 为 true 时独占），
+// 同一目录中的创建和删除不必等文件读写结束。不存在或不是文件返回 -1（不持有锁）
+static int lockFile(const std::string& path, bool exclusive, InodeLocks& locks, Inode& inode) {
+    int parent;
+    int ino = lockPath(fullPathOf(path), false, exclusive, locks, parent);
+    if (ino == -1 || !loadFileInode(ino, inode)) {
+        locks.unlock();
+        return -1;
+    }
+    locks.keepOnly(ino);
+    return ino;
 }
 
 // 读取文件内容
 std::string readFileContent(const std::string& path) {
-    std::string fullPath = getFullPath(path);
-    QFile file(QString::fromStdString(fullPath));
-    if (file.open(QIODevice::ReadOnly | QIODevice::Text)) {
-        QTextStream in(&file);
-        QString content = in.readAll();
-        file.close();
-        return content.toStdString();
+    return readFileRange(path, 0, std::string::npos);
+}
+
+// 读取文件 [offset, offset + length) 范围的内容
+std::string readFileRange(const std::string& path, int64_t offset, size_t length) {
+    FileSystemReadLock lock(fsMutex);
+    InodeLocks locks;
+    Inode inode;
+    if (lockFile(path, false, locks, inode) == -1) {
+        return "";
     }
-    return "";
+    return readData(inode, offset, length);
 }
 
-bool renameItem(const std::string& oldPath, const std::string& newPath) {
-    std::string oldFullPath = getFullPath(oldPath);
-    std::string newFullPath = getFullPath(newPath);
-    QFile file(QString::fromStdString(oldFullPath));
-    if (file.rename(QString::fromStdString(newFullPath))) {
-        // 判断是文件还是文件夹，如果是文件夹，则直接return true,无需处理inode
-        QFileInfo fileInfo(QString::fromStdString(newFullPath));
-        if (fileInfo.isDir()) {
-            return true;
+// 更新 inode 中的文件大小和修改时间并保存，大小的变化累加到各级父目录
+static void commitFileSize(int ino, Inode& inode, int64_t size) {
+    int64_t sizeDelta = size - inode.size;
+    inode.size = size;
+    inode.subtreeSize = size;
+    inode.modifyTime = currentTimeNs();
+    saveInode(ino, inode);
+    if (sizeDelta != 0) {
+        propagateSubtree(inode.parent, sizeDelta, 0, 0);
+    }
+}
+
+// 把 [from, to) 填 0：扩展文件时新块和截断后残留在末块里的旧数据都不能露出来
+static bool zeroData(const Inode& inode, int64_t from, int64_t to) {
+    static const char zeros[64 * 1024] = {};
+    while (from < to) {
+        size_t chunk = static_cast<size_t>(std::min<int64_t>(to - from, sizeof(zeros)));
+        if (!writeData(inode, from, zeros, chunk)) {
+            return false;
         }
-        // 重命名inode文件
-        std::string oldInodePath = config.realRootPath + "/inode/" + getFullPath(oldPath).substr(config.realRootPath.length()) + ".inode";
-        std::string newInodePath = config.realRootPath + "/inode/" + getFullPath(newPath).substr(config.realRootPath.length()) + ".inode";
-        QFile inodeFile(QString::fromStdString(oldInodePath));
-        if (inodeFile.rename(QString::fromStdString(newInodePath))) {
+        from += static_cast<int64_t>(chunk);
+    }
+    return true;
+}
+
+
+// 在 offset 处写入 length 字节，truncate 为 true 时文件大小设为 offset + length（多余的块释放）。
+// 块链只在变长或变短时调整，原有的块只改动写入范围覆盖的部分，最后只更新一次 inode
+static bool writeRange(int ino, Inode& inode, int64_t offset, const char* data, size_t length, bool truncate) {
+    bumpDataVersion(ino);
+    int64_t end = offset + static_cast<int64_t>(length);
+    int64_t newSize = truncate ? end : std::max(inode.size, end);
+    if (newSize != inode.size && !resizeChain(inode, blocksFor(newSize, getBlockSize()))) {
+        std::cerr << "No free block for inode: " << ino << std::endl;
+        return false;
+    }
+    // 跳过文件末尾写入时，中间的空洞读出来是 0
+    if (offset > inode.size && !zeroData(inode, inode.size, offset)) {
+        return false;
+    }
+    if (!writeData(inode, offset, data, length)) {
+        return false;
+    }
+    commitFileSize(ino, inode, newSize);
+    return true;
+}
+
+
+// 写入文件内容：复用已有的块链，不够时追加新块，多余的块释放
+bool writeFileContent(const std::string& path, const std::string& content) {
+    FileSystemReadLock lock(fsMutex);
+    JournalTransaction transaction;
+    InodeLocks locks;
+    Inode inode;
+    int ino = lockFile(path, true, locks, inode);
+    return ino != -1 && writeRange(ino, inode, 0, content.data(), content.size(), true);
+}
+
+bool writeFileRange(const std::string& path, int64_t offset, const std::string& data, bool truncate) {
+    FileSystemReadLock lock(fsMutex);
+    JournalTransaction transaction;
+    InodeLocks locks;
+    Inode inode;
+    int ino = lockFile(path, true, locks, inode);
+    return ino != -1 && offset >= 0 && writeRange(ino, inode, offset, data.data(), data.size(), truncate);
+}
+
+// 取文件大小和写入在同一次加锁内完成，并发追加不会互相覆盖
+bool appendFile(const std::string& path, const std::string& data) {
+    FileSystemReadLock lock(fsMutex);
+    JournalTransaction transaction;
+    InodeLocks locks;
+    Inode inode;
+    int ino = lockFile(path, true, locks, inode);
+    return ino != -1 && writeRange(ino, inode, inode.size, data.data(), data.size(), false);
+}
+
+bool truncateFile(const std::string& path, int64_t size) {
+    FileSystemReadLock lock(fsMutex);
+    JournalTransaction transaction;
+    InodeLocks locks;
+    Inode inode;
+    int ino = lockFile(path, true, locks, inode);
+    return ino != -1 && size >= 0 && writeRange(ino, inode, size, nullptr, 0, true);
+}
+
+// a、b 前 length 字节中相同前缀的长度，先按 4 KB 整段用 memcmp 比较
+static size_t commonPrefix(const char* a, const char* b, size_t length) {
+    const size_t chunk = 4096;
+    size_t same = 0;
+    while (same + chunk <= length && std::memcmp(a + same, b + same, chunk) == 0) {
+        same += chunk;
+    }
+    while (same < length && a[same] == b[same]) {
+        ++same;
+    }
+    return same;
+}
+
+// a、b 前 length 字节中相同后缀的长度
+static size_t commonSuffix(const char* a, const char* b, size_t length) {
+    const size_t chunk = 4096;
+    size_t same = 0;
+    while (same + chunk <= length && std::memcmp(a + length - same - chunk, b + length - same - chunk, chunk) == 0) {
+        same += chunk;
+    }
+    while (same < length && a[length - same - 1] == b[length - same - 1]) {
+        ++same;
+    }
+    return same;
+}
+
+// 按与原内容的差异保存：去掉相同的前缀和后缀，长度不变时只重写中间不同的区间，
+// 长度变化时从第一个不同的字节重写到末尾。文件当前大小与原内容不符（期间被其他操作改过）时整体重写
+bool updateFileContent(const std::string& path, const std::string& original, const std::string& content) {
+    FileSystemReadLock lock(fsMutex);
+    JournalTransaction transaction;
+    InodeLocks locks;
+    Inode inode;
+    int ino = lockFile(path, true, locks, inode);
+    if (ino == -1) {
+        return false;
+    }
+    if (inode.size != static_cast<int64_t>(original.size())) {
+        return writeRange(ino, inode, 0, content.data(), content.size(), true);
+    }
+    size_t prefix = commonPrefix(original.data(), content.data(), std::min(original.size(), content.size()));
+    if (original.size() == content.size()) {
+        if (prefix == content.size()) {
             return true;
         }
+        size_t suffix = commonSuffix(original.data() + prefix, content.data() + prefix, content.size() - prefix);
+        return writeRange(ino, inode, static_cast<int64_t>(prefix), content.data() + prefix, content.size() - prefix - suffix, false);
+    }
+    return writeRange(ino, inode, static_cast<int64_t>(prefix), content.data() + prefix, content.size() - prefix, true);
+}
+
+FileId lookupFileId(const std::string& path) {
+    FileSystemReadLock lock(fsMutex);
+    FileId file;
+    InodeLocks locks;
+    Inode inode;
+    int ino = lockFile(path, false, locks, inode);
+    if (ino != -1) {
+        file.ino = ino;
+        file.generation = inode.generation;
     }
-    return false;
-}
\ No newline at end of file
+    return file;
+}
+
+int64_t getFileSize(FileId file) {
+    FileSystemReadLock lock(fsMutex);
+    InodeLocks locks({ { file.ino, false } });
+    Inode inode;
+    return loadFileInode(file, inode) ? inode.size : -1;
+}
+
+int64_t readFileAt(FileId file, int64_t offset, char* buffer, size_t length) {
+    FileSystemReadLock lock(fsMutex);
+    InodeLocks locks({ { file.ino, false } });
+    Inode inode;
+    if (!loadFileInode(file, inode) || offset < 0) {
+        return -1;
+    }
+    return static_cast<int64_t>(readDataInto(inode, offset, buffer, length));
+}
+
+bool writeFileAt(FileId file, int64_t offset, const char* data, size_t length) {
+    FileSystemReadLock lock(fsMutex);
+    JournalTransaction transaction;
+    InodeLocks locks({ { file.ino, true } });
+    Inode inode;
+    return loadFileInode(file, inode) && offset >= 0 && writeRange(file.ino, inode, offset, data, length, false);
+}
+
+bool truncateFileAt(FileId file, int64_t size) {
+    FileSystemReadLock lock(fsMutex);
+    JournalTransaction transaction;
+    InodeLocks locks({ { file.ino, true } });
+    Inode inode;
+    return loadFileInode(file, inode) && size >= 0 && writeRange(file.ino, inode, size, nullptr, 0, true);
+}
+
+uint64_t fileDataVersion(int ino) {
+    return dataVersions[static_cast<unsigned>(ino) % DATA_VERSION_SLOTS].load(std::memory_order_relaxed);
+}
+
+// 检查点：提交日志，把块缓存中的脏块和元数据脏页写回原位置，清空日志
+bool syncFileSystem() {
+    FileSystemReadLock lock(fsMutex);
+    return checkpoint();
+}
+
+void runLocked(const std::function<void()>& work) {
+    FileSystemLock lock(fsMutex);
+    work();
+}
+
+void unmountFileSystem() {
+    stopReaper();
+    stopCommitter();
+    FileSystemLock lock(fsMutex);
+    if (journal.isOpen()) {
+        checkpoint();
+    }
+}
+
+FsckReport checkFileSystem(bool repair, int threads) {
+    // 检查期间后台释放暂停，摘下的子树由检查器当作另外的根遍历
+    pauseReaper();
+    FsckReport report;
+    {
+        FileSystemLock lock(fsMutex);
+        // 检查器直接从磁盘镜像读取目录数据，先把块缓存和元数据写回
+        if (journal.isOpen() && checkpoint()) {
+            {
+                JournalTransaction transaction;
+                report = FileSystemChecker(threads).run(repair);
+            }
+            if (report.repairs > 0) {
+                // 修复绕过了各缓存，全部丢弃后做检查点
+                dentryCache.clear();
+                nameCache.clear();
+                extentCache.clear();
+                bumpAllDataVersions();
+                checkpoint();
+            }
+        }
+        else {
+            report.messages.push_back("File system is not mounted or could not be synced");
+        }
+    }
+    resumeReaper();
+    return report;
+}
+
+BlockCacheStats getCacheStats() {
+    FileSystemReadLock lock(fsMutex);
+    return blockCache.stats();
+}
+
+JournalStats getJournalStats() {
+    FileSystemReadLock lock(fsMutex);
+    return journal.stats();
+}
+
+// 重命名/移动文件：共享持有文件系统锁，独占两个父目录和文件本身。
+// 不是文件时返回 -1，由调用者按目录移动
+static int renameFile(const VirtualPath& oldFullPath, const VirtualPath& newFullPath) {
+    FileSystemReadLock lock(fsMutex);
+    JournalTransaction transaction;
+    int oldParent = resolvePath(oldFullPath, oldFullPath.depth() - 1);
+    int newParent = resolvePath(newFullPath, newFullPath.depth() - 1);
+    if (!isDirectoryInode(oldParent) || !isDirectoryInode(newParent)) {
+        return 0;
+    }
+    InodeLocks locks;
+    int ino;
+    while (true) {
+        ino = resolvePath(oldFullPath, oldFullPath.depth());
+        if (ino == -1) {
+            return 0;
+        }
+        locks.lock({ { oldParent, true }, { newParent, true }, { ino, true } });
+        if (lookupEntry(oldParent, oldFullPath.name()) == ino) {
+            break;
+        }
+        // 查找和加锁之间被删除或改名，按新的查找结果重试
+        locks.unlock();
+        nameCache.invalidate(oldFullPath.str());
+    }
+    Inode inode = loadInode(ino);
+    if (inode.type != FileType::File) {
+        return -1;
+    }
+    if (lookupEntry(newParent, newFullPath.name()) != -1 || !addEntry(newParent, newFullPath.name(), ino)) {
+        return 0;
+    }
+    removeEntry(oldParent, oldFullPath.name());
+    nameCache.insert(oldFullPath.str(), -1);
+    nameCache.insert(newFullPath.str(), ino);
+    propagateSubtree(oldParent, -inode.subtreeSize, -inode.subtreeFiles, -inode.subtreeInodes);
+    propagateSubtree(newParent, inode.subtreeSize, inode.subtreeFiles, inode.subtreeInodes);
+    inode.parent = newParent;
+    saveInode(ino, inode);
+    return 1;
+}
+
+// 重命名/移动文件或目录：只需在两个目录之间移动目录项。
+// 目录搬走整棵子树，路径和子树统计都要整体变化，独占文件系统锁
+bool renameItem(const std::string& oldPath, const std::string& newPath) {
+    VirtualPath oldFullPath = fullPathOf(oldPath);
+    VirtualPath newFullPath = fullPathOf(newPath);
+    if (oldFullPath.isRoot() || newFullPath.isRoot()) {
+        return false;
+    }
+    int renamed = renameFile(oldFullPath, newFullPath);
+    if (renamed != -1) {
+        return renamed == 1;
+    }
+    // 是目录：放开后独占文件系统锁重新查找
+    FileSystemLock lock(fsMutex);
+    JournalTransaction transaction;
+    int ino = resolvePath(oldFullPath, oldFullPath.depth());
+    if (ino == -1 || ino == ROOT_INODE || newFullPath.isRoot() || resolvePath(newFullPath, newFullPath.depth()) != -1) {
+        return false;
+    }
+    int newParent = resolvePath(newFullPath, newFullPath.depth() - 1);
+    if (newParent == -1 || loadInode(newParent).type != FileType::Directory) {
+        return false;
+    }
+    // 目录不能移动到自己的子目录中
+    for (int p = newParent; p != ROOT_INODE; p = loadInode(p).parent) {
+        if (p == ino) {
+            return false;
+        }
+    }
+    Inode inode = loadInode(ino);
+    if (!addEntry(newParent, newFullPath.name(), ino)) {
+        return false;
+    }
+    removeEntry(inode.parent, oldFullPath.name());
+    // 目录搬走了整棵子树；新路径下原先缓存的负项也不再成立
+    if (inode.type == FileType::Directory) {
+        nameCache.invalidateTree(oldFullPath.str());
+        nameCache.invalidateTree(newFullPath.str());
+    }
+    nameCache.insert(oldFullPath.str(), -1);
+    nameCache.insert(newFullPath.str(), ino);
+    // 子树统计从原父目录链移到新父目录链
+    propagateSubtree(inode.parent, -inode.subtreeSize, -inode.subtreeFiles, -inode.subtreeInodes);
+    propagateSubtree(newParent, inode.subtreeSize, inode.subtreeFiles, inode.subtreeInodes);
+    inode.parent = newParent;
+    saveInode(ino, inode);
+    return true;
+}
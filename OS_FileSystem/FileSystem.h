@@ -1,10 +1,41 @@
 ﻿#pragma once
 #include "Utilities.h"
+#include "BlockCache.h"
+#include "Journal.h"
+#include "FileSystemChecker.h"
 #include <fstream>
+#include <atomic>
+#include <functional>
 #include <Utilities.h>
 
-// 格式化文件系统
-void formatFileSystem();
+// 长操作的进度和取消标志：执行操作的线程更新进度，其他线程读取进度或请求取消
+struct OperationProgress {
+    std::atomic<int64_t> done{ 0 };        // 已完成的项数
+    std::atomic<int64_t> total{ 0 };       // 总项数，0 表示未知
+    std::atomic<bool> cancelled{ false };  // 是否已请求取消
+};
+
+// 文件系统的公开函数都是线程安全的（内部加锁），可以在工作线程中调用：
+// 只读的函数（查找、列目录、读取、统计）可以在多个线程中同时执行；创建、删除、改名文件和读写文件
+// 只锁涉及的目录和文件，不同目录、不同文件上的操作也同时执行。删除和移动目录依次执行。
+// 相对路径基于调用时的当前路径（见 setCurrentPath）
+
+// 格式化文件系统，块大小和块数量写入超级块。块大小须为不小于 512 的 2 的幂，块数量须为正数，
+// 不合法时输出原因、不改动原来的卷并返回 false
+bool formatFileSystem(int blockSize = DEFAULT_BLOCK_SIZE, int blockCount = DEFAULT_BLOCK_COUNT);
+
+// 挂载 config.realRootPath 下的卷，卷文件不存在或要求重新格式化（config.forceFormat）时先格式化。
+// 已有的卷打不开（如格式版本不符）时返回 false，不会自动格式化
+bool mountFileSystem();
+
+// 路径对应的 inode 号，不存在返回 -1
+int lookupPath(const std::string& path);
+
+// 路径是否存在
+bool pathExists(const std::string& path);
+
+// 路径是否为目录
+bool isDirectory(const std::string& path);
 
 // 创建目录
 bool createDirectory(const std::string& path);
@@ -12,17 +43,91 @@ bool createDirectory(const std::string& path);
 // 创建文件
 bool createFile(const std::string& path);
 
-// 删除文件/目录
-bool deleteItem(const std::string& path);
+// 删除文件/目录，名称立即消失。文件数超过几千的目录在后台分批释放块和 inode，
+// 释放完之前空闲块数不会增加。progress 不为空时报告进度，开始前已请求取消则返回 false
+bool deleteItem(const std::string& path, OperationProgress* progress = nullptr);
 
 // 获取目录信息
 Directory getDirectoryInfo(const std::string& path);
 
+// 文件/目录占用的总大小和文件数（取自 inode 上维护的子树统计，O(1)），路径不存在返回 false
+bool getDiskUsage(const std::string& path, int64_t& totalSize, int64_t& fileCount);
+
+// 获取目录下所有子目录的名称（按名称排序），不计算大小，用于目录树
+std::vector<std::string> getSubdirectoryNames(const std::string& path);
+
 // 打开文件进行编辑
 bool openFileForEdit(const std::string& path);
 
 // 读取文件内容
 std::string readFileContent(const std::string& path);
 
+// 读取文件从 offset 开始的 length 字节（超出文件末尾的部分被截掉）
+std::string readFileRange(const std::string& path, int64_t offset, size_t length);
+
+// 写入文件内容（覆盖原内容）
+bool writeFileContent(const std::string& path, const std::string& content);
+
+// 在 offset 处写入 data，不改动其余内容（pwrite）：写到末尾之后时扩展文件，跳过的部分填 0；
+// truncate 为 true 时文件在写入范围末尾截断。只重写覆盖到的块，只更新一次 inode
+bool writeFileRange(const std::string& path, int64_t offset, const std::string& data, bool truncate = false);
+
+// 追加到文件末尾
+bool appendFile(const std::string& path, const std::string& data);
+
+// 把文件截断或扩展（填 0）到 size 字节
+bool truncateFile(const std::string& path, int64_t size);
+
+// 保存编辑结果：original 是编辑前读到的内容，只重写与它不同的部分
+bool updateFileContent(const std::string& path, const std::string& original, const std::string& content);
+
+// 以下按文件标识访问文件数据，供流式文件句柄（FileHandle）使用。
+// 文件已被删除（inode 号可能已分配给别的文件，代数不同）或不是文件时失败
+
+// 文件标识：inode 号和它的分配代数
+struct FileId {
+    int ino = -1;
+    uint32_t generation = 0;
+};
+
+// 路径对应的文件标识，不存在或不是文件时 ino 为 -1
+FileId lookupFileId(const std::string& path);
+
+// 文件大小，失败返回 -1
+int64_t getFileSize(FileId file);
+
+// 读取 [offset, offset + length) 到 buffer，返回读到的字节数（从文件末尾开始读为 0），失败返回 -1
+int64_t readFileAt(FileId file, int64_t offset, char* buffer, size_t length);
+
+// 在 offset 处写入 length 字节，写到末尾之后时扩展文件（跳过的部分填 0），只改动覆盖到的块
+bool writeFileAt(FileId file, int64_t offset, const char* data, size_t length);
+
+// 把文件截断或扩展（填 0）到 size 字节
+bool truncateFileAt(FileId file, int64_t size);
+
+// inode 的文件数据写入计数，这个文件每次写入、改变块链或被删除时增加，用于判断读缓冲是否失效。
+// 计数按 inode 号分槽共用，别的文件的写入偶尔也会让它增加
+uint64_t fileDataVersion(int ino);
+
 // 重命名文件/目录
-bool renameItem(const std::string& oldPath, const std::string& newPath);
\ No newline at end of file
+bool renameItem(const std::string& oldPath, const std::string& newPath);
+
+// 检查点：提交日志，把块缓存中的脏块和元数据脏页写回磁盘后清空日志
+bool syncFileSystem();
+
+// 独占文件系统锁执行 work，不开日志事务。给绕过公开函数直接改 FAT、位图和 inode 表的代码
+// （基准测试）挡住提交线程和后台释放线程；work 中不能调用公开函数（锁不可重入）
+void runLocked(const std::function<void()>& work);
+
+// 停止日志提交线程并做检查点，进程正常退出时自动调用
+void unmountFileSystem();
+
+// 一致性检查（fsck），repair 为 true 时同时修复；threads 为 0 时使用硬件线程数。
+// 检查期间持有文件系统锁，开始前做一次检查点
+FsckReport checkFileSystem(bool repair = false, int threads = 0);
+
+// 块缓存的命中统计
+BlockCacheStats getCacheStats();
+
+// 元数据日志的统计
+JournalStats getJournalStats();
\ No newline at end of file
@@ -0,0 +1,578 @@
+﻿#include "FileSystemChecker.h"
+#include "Utilities.h"
+#include "BlockDevice.h"
+#include "BlockCache.h"
+#include "Journal.h"
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+int64_t FsckReport::problems() const {
+    return corruptInodes + danglingEntries + duplicateEntries + parentMismatches + orphanInodes
+        + badChains + crossLinks + sizeMismatches + subtreeMismatches
+        + unmarkedBlocks + orphanBlocks + staleFatEntries + freeCountMismatches + detachedListMismatches;
+}
+
+FileSystemChecker::FileSystemChecker(int threads)
+    : threads_(threads > 0 ? threads : std::max(1, static_cast<int>(std::thread::hardware_concurrency()))) {
+}
+
+template <typename Work>
+void FileSystemChecker::parallelFor(int64_t count, int64_t align, Work&& work) {
+    int64_t per = std::max<int64_t>(align, (count + threads_ - 1) / threads_);
+    per = (per + align - 1) / align * align;
+    std::vector<std::thread> workers;
+    for (int64_t begin = per; begin < count; begin += per) {
+        workers.emplace_back([&work, begin, per, count] { work(begin, std::min(begin + per, count)); });
+    }
+    // 第一段在当前线程执行
+    work(0, std::min(per, count));
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+bool FileSystemChecker::note(int64_t& counter) {
+    counter++;
+    return report_.messages.size() < FsckReport::MAX_MESSAGES;
+}
+
+FsckReport FileSystemChecker::run(bool repair) {
+    auto start = std::chrono::steady_clock::now();
+    repair_ = repair;
+    blockSize_ = getBlockSize();
+    blockCount_ = getBlockCount();
+    report_ = FsckReport();
+    report_.threads = threads_;
+    order_.clear();
+
+    loadInodes();
+    if (walkTree()) {
+        checkDetachedList();
+        claimBlocks();
+        checkChains();
+        checkSubtrees();
+        checkBlocks();
+    }
+
+    inodes_.clear();
+    inodes_.shrink_to_fit();
+    owner_ = std::vector<std::atomic<int>>();
+    order_.clear();
+    order_.shrink_to_fit();
+    report_.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return report_;
+}
+
+// 并行解码 inode 表
+void FileSystemChecker::loadInodes() {
+    inodes_.assign(static_cast<size_t>(inodeTable.size()), InodeInfo());
+    parallelFor(inodeTable.size(), 4096, [this](int64_t begin, int64_t end) {
+        for (int64_t ino = begin; ino < end; ++ino) {
+            const DiskInode& record = inodeTable.get(static_cast<int>(ino));
+            InodeInfo& info = inodes_[ino];
+            Inode inode;
+            if (!decodeInode(record, inode)) {
+                info.corrupt = record.linkCount != 0;
+                continue;
+            }
+            info.allocated = true;
+            info.directory = inode.type == FileType::Directory;
+            info.firstBlock = inode.firstBlock;
+            info.parent = inode.parent;
+            info.size = inode.size;
+            info.subtreeSize = inode.subtreeSize;
+            info.subtreeFiles = inode.subtreeFiles;
+            info.subtreeInodes = inode.subtreeInodes;
+        }
+    });
+}
+
+// 读取目录的全部非空目录项，块链断开时只返回能读到的部分。
+// 与核心相同按字节偏移解析：块大小不是目录项大小的整数倍时（旧卷），目录项可能跨块，
+// 上一块末尾不完整的目录项留在缓冲区开头，与下一块拼起来
+std::vector<FileSystemChecker::Slot> FileSystemChecker::readDirectory(int dirIno) const {
+    const InodeInfo& dir = inodes_[dirIno];
+    std::vector<Slot> slots;
+    std::vector<char> buffer(static_cast<size_t>(blockSize_) + sizeof(DirEntry));
+    size_t carried = 0;           // 缓冲区开头不完整的目录项的字节数
+    int64_t position = 0;         // 缓冲区开头在目录数据中的偏移
+    int64_t remaining = dir.size;
+    int block = dir.firstBlock;
+    // 最多走 blockCount 步，防止成环的块链
+    for (int step = 0; remaining > 0 && step < blockCount_; ++step) {
+        size_t chunk = static_cast<size_t>(std::min<int64_t>(blockSize_, remaining));
+        if (block < 0 || block >= blockCount_ || !disk.readBlock(block, buffer.data() + carried, 0, chunk)) {
+            break;
+        }
+        size_t available = carried + chunk;
+        size_t complete = available - available % sizeof(DirEntry);
+        for (size_t at = 0; at < complete; at += sizeof(DirEntry)) {
+            int32_t ino;
+            std::memcpy(&ino, buffer.data() + at + offsetof(DirEntry, ino), sizeof(ino));
+            if (ino != -1) {
+                slots.push_back({ static_cast<int>((position + static_cast<int64_t>(at)) / static_cast<int64_t>(sizeof(DirEntry))), ino });
+            }
+        }
+        std::memmove(buffer.data(), buffer.data() + complete, available - complete);
+        carried = available - complete;
+        position += static_cast<int64_t>(complete);
+        remaining -= static_cast<int64_t>(chunk);
+        block = fat.get(block);
+    }
+    return slots;
+}
+
+// 从根目录逐层遍历目录树：每层的目录并行读取，再按目录和槽号的顺序依次核对目录项，
+// 同一个 inode 只算第一次出现的目录项
+bool FileSystemChecker::walkTree() {
+    if (inodes_.empty() || !inodes_[ROOT_INODE].allocated || !inodes_[ROOT_INODE].directory) {
+        note(report_.corruptInodes);
+        report_.messages.push_back("Root directory inode is invalid, nothing else can be checked");
+        return false;
+    }
+    // 摘下等待后台释放的子树不在目录树中，但仍须一致，当作另外的根
+    std::vector<int> level;
+    for (size_t ino = 0; ino < inodes_.size(); ++ino) {
+        InodeInfo& info = inodes_[ino];
+        if (ino == ROOT_INODE || (info.allocated && info.parent == DETACHED_PARENT)) {
+            info.reachable = true;
+            order_.push_back(static_cast<int>(ino));
+            if (info.directory) {
+                level.push_back(static_cast<int>(ino));
+            }
+            report_.detachedTrees += ino == ROOT_INODE ? 0 : 1;
+        }
+    }
+    while (!level.empty()) {
+        std::vector<std::vector<Slot>> contents(level.size());
+        parallelFor(static_cast<int64_t>(level.size()), 16, [&](int64_t begin, int64_t end) {
+            for (int64_t i = begin; i < end; ++i) {
+                contents[i] = readDirectory(level[i]);
+            }
+        });
+        std::vector<int> next;
+        for (size_t i = 0; i < level.size(); ++i) {
+            int dirIno = level[i];
+            for (const Slot& slot : contents[i]) {
+                if (slot.ino < 0 || slot.ino >= static_cast<int>(inodes_.size()) || !inodes_[slot.ino].allocated) {
+                    if (note(report_.danglingEntries)) {
+                        report_.messages.push_back("Directory " + std::to_string(dirIno) + " slot " + std::to_string(slot.slot)
+                            + " refers to unallocated inode " + std::to_string(slot.ino));
+                    }
+                    clearEntry(dirIno, slot.slot);
+                    continue;
+                }
+                InodeInfo& child = inodes_[slot.ino];
+                if (child.reachable) {
+                    if (note(report_.duplicateEntries)) {
+                        report_.messages.push_back("Directory " + std::to_string(dirIno) + " slot " + std::to_string(slot.slot)
+                            + " refers to inode " + std::to_string(slot.ino) + " which is already linked");
+                    }
+                    clearEntry(dirIno, slot.slot);
+                    continue;
+                }
+                child.reachable = true;
+                child.treeParent = dirIno;
+                order_.push_back(slot.ino);
+                if (child.directory) {
+                    next.push_back(slot.ino);
+                }
+                if (child.parent != dirIno) {
+                    if (note(report_.parentMismatches)) {
+                        report_.messages.push_back("Inode " + std::to_string(slot.ino) + " has parent " + std::to_string(child.parent)
+                            + " but is linked from directory " + std::to_string(dirIno));
+                    }
+                    if (repair_) {
+                        Inode inode = loadInode(slot.ino);
+                        inode.parent = dirIno;
+                        saveInode(slot.ino, inode);
+                        child.parent = dirIno;
+                        report_.repairs++;
+                    }
+                }
+            }
+        }
+        level.swap(next);
+    }
+
+    // 损坏的 inode 既不在空闲链表中也不能使用，孤立的 inode 的块交给后面的块核对释放
+    for (size_t ino = 0; ino < inodes_.size(); ++ino) {
+        const InodeInfo& info = inodes_[ino];
+        if (info.corrupt) {
+            if (note(report_.corruptInodes)) {
+                report_.messages.push_back("Inode " + std::to_string(ino) + " has a bad checksum or version");
+            }
+        }
+        else if (info.allocated) {
+            report_.inodes++;
+            report_.directories += info.directory ? 1 : 0;
+            if (!info.reachable && note(report_.orphanInodes)) {
+                report_.messages.push_back("Inode " + std::to_string(ino) + " is not linked from any directory");
+            }
+        }
+        if (repair_ && (info.corrupt || (info.allocated && !info.reachable))) {
+            inodeTable.release(static_cast<int>(ino));
+            report_.repairs++;
+        }
+    }
+    return true;
+}
+
+// 超级块中的摘下子树列表须与 parent 为 DETACHED_PARENT 的 inode 一致，挂载时只按列表恢复后台释放
+void FileSystemChecker::checkDetachedList() {
+    Superblock& sb = metadata.superblock();
+    std::vector<int> listed(sb.detachedRoots, sb.detachedRoots + std::max(0, std::min(sb.detachedCount, MAX_DETACHED_ROOTS)));
+    std::vector<int> actual;
+    for (size_t ino = 0; ino < inodes_.size(); ++ino) {
+        const InodeInfo& info = inodes_[ino];
+        if (info.allocated && info.parent == DETACHED_PARENT) {
+            actual.push_back(static_cast<int>(ino));
+        }
+    }
+    bool mismatch = listed.size() != static_cast<size_t>(sb.detachedCount);
+    for (int ino : actual) {
+        if (std::find(listed.begin(), listed.end(), ino) == listed.end()) {
+            mismatch = true;
+            if (note(report_.detachedListMismatches)) {
+                report_.messages.push_back("Detached subtree root " + std::to_string(ino) + " is missing from the superblock");
+            }
+        }
+    }
+    for (size_t i = 0; i < listed.size(); ++i) {
+        int ino = listed[i];
+        if (std::find(actual.begin(), actual.end(), ino) == actual.end()
+            || std::find(listed.begin(), listed.begin() + i, ino) != listed.begin() + i) {
+            mismatch = true;
+            if (note(report_.detachedListMismatches)) {
+                report_.messages.push_back("Superblock lists inode " + std::to_string(ino) + " as a detached subtree root but it is not one");
+            }
+        }
+    }
+    if (mismatch && repair_) {
+        // 放不下的子树根留作孤立的子树，下次检查时仍会报告
+        sb.detachedCount = static_cast<int32_t>(std::min<size_t>(actual.size(), MAX_DETACHED_ROOTS));
+        std::copy(actual.begin(), actual.begin() + sb.detachedCount, sb.detachedRoots);
+        metadata.markSuperblockDirty();
+        report_.repairs++;
+    }
+}
+
+// 按 inode 号分段并行遍历目录树中每个 inode 的块链，认领经过的块。
+// 块已被编号更大的 inode 认领时抢过来，已被编号更小的认领时停下；
+// 块链合并后后面的块都相同，所以最终每个块都归属于经过它的编号最小的 inode
+void FileSystemChecker::claimBlocks() {
+    owner_ = std::vector<std::atomic<int>>(static_cast<size_t>(blockCount_));
+    parallelFor(blockCount_, 4096, [this](int64_t begin, int64_t end) {
+        for (int64_t block = begin; block < end; ++block) {
+            owner_[block].store(-1, std::memory_order_relaxed);
+        }
+    });
+    parallelFor(static_cast<int64_t>(inodes_.size()), 4096, [this](int64_t begin, int64_t end) {
+        for (int64_t i = begin; i < end; ++i) {
+            InodeInfo& info = inodes_[i];
+            if (!info.reachable) {
+                continue;
+            }
+            const int ino = static_cast<int>(i);
+            int block = info.firstBlock;
+            while (block >= 0 && block < blockCount_) {
+                int current = owner_[block].load(std::memory_order_relaxed);
+                bool stop = false;
+                while (true) {
+                    // 回到自己认领过的块是成环，遇到编号更小的是共用，都交给 checkChains 判断
+                    if (current == ino || (current != -1 && current < ino)) {
+                        stop = true;
+                        break;
+                    }
+                    if (owner_[block].compare_exchange_weak(current, ino, std::memory_order_relaxed)) {
+                        break;
+                    }
+                }
+                if (stop) {
+                    break;
+                }
+                info.claimed++;
+                block = fat.get(block);
+            }
+        }
+    });
+}
+
+int FileSystemChecker::chainBlock(int firstBlock, int64_t index) const {
+    int block = firstBlock;
+    for (int64_t i = 0; i < index && block >= 0 && block < blockCount_; ++i) {
+        block = fat.get(block);
+    }
+    return block >= 0 && block < blockCount_ ? block : -1;
+}
+
+// 沿块链找出属于自己的前缀（并行），再依次报告越界、成环、共用和大小不符并修复
+void FileSystemChecker::checkChains() {
+    parallelFor(static_cast<int64_t>(inodes_.size()), 4096, [this](int64_t begin, int64_t end) {
+        for (int64_t i = begin; i < end; ++i) {
+            InodeInfo& info = inodes_[i];
+            if (!info.reachable) {
+                continue;
+            }
+            int block = info.firstBlock;
+            while (block != -1) {
+                if (block < 0 || block >= blockCount_) {
+                    info.fault = ChainFault::BadBlock;
+                    break;
+                }
+                if (owner_[block].load(std::memory_order_relaxed) != static_cast<int>(i)) {
+                    info.fault = ChainFault::CrossLink;
+                    break;
+                }
+                // 属于自己的块都走过了还没有到链尾，说明又回到了走过的块
+                if (info.chainLength == info.claimed) {
+                    info.fault = ChainFault::Loop;
+                    break;
+                }
+                info.chainLength++;
+                info.lastBlock = block;
+                block = fat.get(block);
+            }
+        }
+    });
+
+    for (int ino : order_) {
+        InodeInfo& info = inodes_[ino];
+        if (info.fault != ChainFault::None) {
+            int64_t& counter = info.fault == ChainFault::CrossLink ? report_.crossLinks : report_.badChains;
+            if (note(counter)) {
+                const char* what = info.fault == ChainFault::BadBlock ? " refers to an out-of-range block"
+                    : (info.fault == ChainFault::Loop ? " loops back on itself" : " shares blocks with a lower inode");
+                report_.messages.push_back("Block chain of inode " + std::to_string(ino) + what
+                    + " after " + std::to_string(info.chainLength) + " blocks");
+            }
+            if (repair_) {
+                repairChain(ino);
+            }
+        }
+        report_.usedBlocks += info.chainLength;
+
+        int64_t needed = std::max<int64_t>(1, (info.size + blockSize_ - 1) / blockSize_);
+        if (info.chainLength == needed) {
+            continue;
+        }
+        if (note(report_.sizeMismatches)) {
+            report_.messages.push_back("Inode " + std::to_string(ino) + " has size " + std::to_string(info.size)
+                + " but " + std::to_string(info.chainLength) + " blocks");
+        }
+        if (!repair_ || info.chainLength == 0) {
+            continue;
+        }
+        Inode inode = loadInode(ino);
+        if (info.chainLength < needed) {
+            // 大小缩小到块链能容纳的字节数，目录保留完整的目录项
+            int64_t size = static_cast<int64_t>(info.chainLength) * blockSize_;
+            if (info.directory) {
+                size -= size % static_cast<int64_t>(sizeof(DirEntry));
+            }
+            inode.size = std::min(inode.size, size);
+        }
+        else {
+            // 释放多余的块，它们都只属于这个 inode
+            int last = chainBlock(info.firstBlock, needed - 1);
+            int tail = fat.get(last);
+            for (int block = tail; block != -1; block = fat.get(block)) {
+                owner_[block].store(-1, std::memory_order_relaxed);
+            }
+            fat[last] = -1;
+            releaseBlocks(tail);
+            report_.usedBlocks -= info.chainLength - needed;
+            info.chainLength = static_cast<int>(needed);
+            info.lastBlock = last;
+        }
+        saveInode(ino, inode);
+        info.size = inode.size;
+        report_.repairs++;
+    }
+}
+
+// 在属于自己的前缀末尾截断块链；首块就无效时换一个新块，内容清空
+void FileSystemChecker::repairChain(int ino) {
+    InodeInfo& info = inodes_[ino];
+    if (info.lastBlock != -1) {
+        fat[info.lastBlock] = -1;
+        info.fault = ChainFault::None;
+        report_.repairs++;
+        return;
+    }
+    int block = allocateBlock();
+    // 位图中空闲却已被引用的块不能用，分配时已把它标记为已分配
+    while (block != -1 && owner_[block].load(std::memory_order_relaxed) != -1) {
+        if (note(report_.unmarkedBlocks)) {
+            report_.messages.push_back("Block " + std::to_string(block) + " is in use but marked free");
+        }
+        report_.repairs++;
+        block = allocateBlock();
+    }
+    if (block == -1) {
+        report_.messages.push_back("No free block to rebuild inode " + std::to_string(ino));
+        return;
+    }
+    fat[block] = -1;
+    owner_[block].store(ino, std::memory_order_relaxed);
+    Inode inode = loadInode(ino);
+    inode.firstBlock = block;
+    inode.size = 0;
+    saveInode(ino, inode);
+    info.firstBlock = block;
+    info.size = 0;
+    info.chainLength = 1;
+    info.lastBlock = block;
+    info.fault = ChainFault::None;
+    report_.repairs++;
+}
+
+// 自底向上重算子树统计：文件为自身大小和 1，目录为子项之和，inode 数另加自身
+void FileSystemChecker::checkSubtrees() {
+    std::vector<int64_t> sizes(inodes_.size(), 0);
+    std::vector<int64_t> files(inodes_.size(), 0);
+    std::vector<int64_t> counts(inodes_.size(), 0);
+    for (auto it = order_.rbegin(); it != order_.rend(); ++it) {
+        int ino = *it;
+        const InodeInfo& info = inodes_[ino];
+        if (!info.directory) {
+            sizes[ino] = info.size;
+            files[ino] = 1;
+        }
+        counts[ino] += 1;
+        if (info.subtreeSize != sizes[ino] || info.subtreeFiles != files[ino] || info.subtreeInodes != counts[ino]) {
+            if (note(report_.subtreeMismatches)) {
+                report_.messages.push_back("Inode " + std::to_string(ino) + " records " + std::to_string(info.subtreeFiles)
+                    + " files of " + std::to_string(info.subtreeSize) + " bytes in " + std::to_string(info.subtreeInodes)
+                    + " inodes but holds " + std::to_string(files[ino]) + " files of " + std::to_string(sizes[ino])
+                    + " bytes in " + std::to_string(counts[ino]) + " inodes");
+            }
+            if (repair_) {
+                Inode inode = loadInode(ino);
+                inode.subtreeSize = sizes[ino];
+                inode.subtreeFiles = files[ino];
+                inode.subtreeInodes = counts[ino];
+                saveInode(ino, inode);
+                report_.repairs++;
+            }
+        }
+        if (info.treeParent != -1) {
+            sizes[info.treeParent] += sizes[ino];
+            files[info.treeParent] += files[ino];
+            counts[info.treeParent] += counts[ino];
+        }
+    }
+}
+
+// 块号范围按 64 的倍数分段并行核对归属、位图和 FAT，修复在汇总之后依次进行
+void FileSystemChecker::checkBlocks() {
+    std::mutex merge;
+    std::vector<int> unmarked, orphans, stale;
+    int64_t freeBits = 0;
+    parallelFor(blockCount_, 4096, [&](int64_t begin, int64_t end) {
+        std::vector<int> localUnmarked, localOrphans, localStale;
+        int64_t localFree = 0;
+        for (int64_t i = begin; i < end; ++i) {
+            int block = static_cast<int>(i);
+            bool owned = owner_[block].load(std::memory_order_relaxed) != -1;
+            bool marked = bitmap.test(block);
+            localFree += marked ? 0 : 1;
+            if (owned && !marked) {
+                localUnmarked.push_back(block);
+            }
+            if (!owned && marked) {
+                localOrphans.push_back(block);
+            }
+            if (!owned && fat.get(block) != -1) {
+                localStale.push_back(block);
+            }
+        }
+        std::lock_guard<std::mutex> lock(merge);
+        unmarked.insert(unmarked.end(), localUnmarked.begin(), localUnmarked.end());
+        orphans.insert(orphans.end(), localOrphans.begin(), localOrphans.end());
+        stale.insert(stale.end(), localStale.begin(), localStale.end());
+        freeBits += localFree;
+    });
+    std::sort(unmarked.begin(), unmarked.end());
+    std::sort(orphans.begin(), orphans.end());
+    std::sort(stale.begin(), stale.end());
+
+    for (int block : unmarked) {
+        if (note(report_.unmarkedBlocks)) {
+            report_.messages.push_back("Block " + std::to_string(block) + " is in use but marked free");
+        }
+        if (repair_) {
+            bitmap.set(block);
+            freeBits--;
+            report_.repairs++;
+        }
+    }
+    for (int block : orphans) {
+        if (note(report_.orphanBlocks)) {
+            report_.messages.push_back("Block " + std::to_string(block) + " is marked used but not referenced");
+        }
+        if (repair_) {
+            // 与 releaseBlocks 相同：丢弃缓存中的内容，撤销日志中更早的数据条目
+            blockCache.discard(block, journal.currentSequence());
+            journal.revoke(block);
+            bitmap.reset(block);
+            freeBits++;
+            report_.repairs++;
+        }
+    }
+    for (int block : stale) {
+        if (note(report_.staleFatEntries)) {
+            report_.messages.push_back("Unreferenced block " + std::to_string(block) + " still links to " + std::to_string(fat.get(block)));
+        }
+        if (repair_) {
+            fat[block] = -1;
+            report_.repairs++;
+        }
+    }
+
+    if (bitmap.freeCount() != freeBits) {
+        if (note(report_.freeCountMismatches)) {
+            report_.messages.push_back("Superblock records " + std::to_string(bitmap.freeCount()) + " free blocks but the bitmap has "
+                + std::to_string(freeBits));
+        }
+        if (repair_) {
+            // 超级块在封装日志事务时按内存中的计数更新
+            bitmap.setFreeCount(static_cast<int>(freeBits));
+            report_.repairs++;
+        }
+    }
+}
+
+// 把目录项改为空槽：目录数据记入日志，与 removeEntry 相同。
+// 目录项跨块时分段写；先确认最后一段所在的块在块链中（前面的块也就都在），不会只改一半
+void FileSystemChecker::clearEntry(int dirIno, int slot) {
+    if (!repair_) {
+        return;
+    }
+    const int64_t offset = static_cast<int64_t>(slot) * static_cast<int64_t>(sizeof(DirEntry));
+    const int64_t end = offset + static_cast<int64_t>(sizeof(DirEntry));
+    const int firstBlock = inodes_[dirIno].firstBlock;
+    if (chainBlock(firstBlock, (end - 1) / blockSize_) == -1) {
+        return;
+    }
+    DirEntry empty = {};
+    empty.ino = -1;
+    const char* data = reinterpret_cast<const char*>(&empty);
+    bool ok = true;
+    for (int64_t position = offset; position < end;) {
+        int block = chainBlock(firstBlock, position / blockSize_);
+        size_t inBlock = static_cast<size_t>(position % blockSize_);
+        size_t chunk = static_cast<size_t>(std::min<int64_t>(end - position, blockSize_ - static_cast<int64_t>(inBlock)));
+        const char* piece = data + (position - offset);
+        journal.logData(block, inBlock, piece, chunk);
+        ok = blockCache.write(block, piece, inBlock, chunk, journal.currentSequence()) && ok;
+        position += static_cast<int64_t>(chunk);
+    }
+    if (ok) {
+        report_.repairs++;
+    }
+}
@@ -0,0 +1,111 @@
+﻿#pragma once
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// 一致性检查的结果：各类问题的个数，以及前 MAX_MESSAGES 条问题的描述
+struct FsckReport {
+    int64_t inodes = 0;             // 已分配的 inode 数
+    int64_t directories = 0;        // 其中的目录数
+    int64_t usedBlocks = 0;         // 被目录树中的 inode 引用的块数
+    int64_t detachedTrees = 0;      // 已摘下、等待后台释放的子树（不算问题）
+    int64_t corruptInodes = 0;      // 校验和或版本错误的 inode 记录
+    int64_t danglingEntries = 0;    // 指向未分配 inode 的目录项
+    int64_t duplicateEntries = 0;   // 指向已被其他目录项引用的 inode 的目录项
+    int64_t parentMismatches = 0;   // parent 字段与所在目录不符
+    int64_t orphanInodes = 0;       // 已分配但不在目录树中的 inode
+    int64_t badChains = 0;          // 块号越界或成环的块链
+    int64_t crossLinks = 0;         // 与编号更小的 inode 共用块的块链
+    int64_t sizeMismatches = 0;     // 块链长度与大小不符
+    int64_t subtreeMismatches = 0;  // 子树统计与实际不符
+    int64_t unmarkedBlocks = 0;     // 被引用但位图中为空闲
+    int64_t orphanBlocks = 0;       // 位图中已分配但没有被引用（泄漏）
+    int64_t staleFatEntries = 0;    // 未被引用的块上残留的 FAT 链接
+    int64_t freeCountMismatches = 0; // 超级块中的空闲块数与位图不符
+    int64_t detachedListMismatches = 0; // 超级块中的摘下子树列表与实际不符
+    int64_t repairs = 0;            // 已修复的问题数
+    int threads = 0;                // 使用的线程数
+    double seconds = 0;             // 耗时
+    std::vector<std::string> messages;
+
+    static const size_t MAX_MESSAGES = 50;
+
+    // 问题总数
+    int64_t problems() const;
+    bool clean() const { return problems() == 0; }
+};
+
+// 文件系统一致性检查（fsck）：从根目录和各个摘下的子树根逐层遍历目录树（每层的目录并行读取），
+// 按 inode 号分段并行遍历块链、用原子操作认领块（编号小的 inode 优先，结果与线程数无关），
+// 最后把块号范围按 64 的倍数切成若干段，每个线程核对一段的归属、位图和 FAT。
+// 调用者须持有文件系统锁，并且块缓存和元数据已经写回（目录数据直接从磁盘镜像并行读取）；
+// 修复在调用者的日志事务中进行，之后调用者应清空各缓存
+class FileSystemChecker {
+public:
+    // threads 为 0 时使用硬件线程数
+    explicit FileSystemChecker(int threads = 0);
+
+    // 检查，repair 为 true 时同时修复：
+    // 删除无效和重复的目录项、修正 parent、释放损坏和孤立的 inode、重建超级块中的摘下子树列表、
+    // 在越界、成环或共用处截断块链、把大小调整到块链长度（或释放多余的块）、重算子树统计、按块的实际归属修正位图和 FAT
+    FsckReport run(bool repair);
+
+private:
+    // 块链的问题
+    enum class ChainFault { None, BadBlock, Loop, CrossLink };
+    // inode 的检查状态
+    struct InodeInfo {
+        bool allocated = false;
+        bool corrupt = false;
+        bool directory = false;
+        bool reachable = false;
+        int firstBlock = -1;
+        int parent = -1;
+        int treeParent = -1;         // 遍历时所在的目录
+        int64_t size = 0;
+        int64_t subtreeSize = 0;
+        int64_t subtreeFiles = 0;
+        int64_t subtreeInodes = 0;
+        int claimed = 0;             // 认领到的块数
+        int chainLength = 0;         // 块链中属于自己的前缀长度
+        int lastBlock = -1;          // 前缀的最后一块
+        ChainFault fault = ChainFault::None;
+    };
+    // 目录项：槽号和 inode 号
+    struct Slot {
+        int slot;
+        int ino;
+    };
+
+    // 把 [0, count) 切成最多 threads_ 段并行执行 work(begin, end)，
+    // 每段至少 align 项，除最后一段外长度是 align 的倍数
+    template <typename Work>
+    void parallelFor(int64_t count, int64_t align, Work&& work);
+
+    void loadInodes();
+    bool walkTree();
+    void checkDetachedList();
+    std::vector<Slot> readDirectory(int dirIno) const;
+    void claimBlocks();
+    void checkChains();
+    void repairChain(int ino);
+    void checkSubtrees();
+    void checkBlocks();
+    // 块链中第 index 块的块号，链不够长时返回 -1
+    int chainBlock(int firstBlock, int64_t index) const;
+    void clearEntry(int dirIno, int slot);
+    // 问题计数加一，返回是否还应记录描述
+    bool note(int64_t& counter);
+
+    int threads_;
+    bool repair_ = false;
+    int blockSize_ = 0;
+    int blockCount_ = 0;
+    FsckReport report_;
+    std::vector<InodeInfo> inodes_;
+    // 每个块的所属 inode，-1 表示没有被引用
+    std::vector<std::atomic<int>> owner_;
+    // 目录树的层序遍历顺序（根目录在前），用于自底向上计算子树统计
+    std::vector<int> order_;
+};
@@ -0,0 +1,102 @@
+﻿#include "FreeExtentIndex.h"
+#include <algorithm>
+#include <climits>
+
+void FreeExtentIndex::clear() {
+    byStart_.clear();
+    byLength_.clear();
+}
+
+// 短于 minLength 的空闲区（含拆分剩下的零头）不收录
+void FreeExtentIndex::add(int start, int length) {
+    if (length < minLength_) {
+        return;
+    }
+    byStart_.emplace(start, length);
+    byLength_.emplace(length, start);
+}
+
+void FreeExtentIndex::erase(std::map<int, int>::iterator it) {
+    byLength_.erase({ it->second, it->first });
+    byStart_.erase(it);
+}
+
+void FreeExtentIndex::insert(int start, int length) {
+    if (length <= 0) {
+        return;
+    }
+    int end = start + length;
+    // 与后一个空闲区合并
+    auto next = byStart_.lower_bound(start);
+    if (next != byStart_.end() && next->first <= end) {
+        end = std::max(end, next->first + next->second);
+        erase(next);
+    }
+    // 与前一个空闲区合并
+    auto it = byStart_.lower_bound(start);
+    if (it != byStart_.begin()) {
+        auto prev = std::prev(it);
+        if (prev->first + prev->second >= start) {
+            start = prev->first;
+            end = std::max(end, prev->first + prev->second);
+            erase(prev);
+        }
+    }
+    add(start, end - start);
+}
+
+void FreeExtentIndex::remove(int start, int length) {
+    if (length <= 0) {
+        return;
+    }
+    int end = start + length;
+    // 从可能覆盖 start 的空闲区开始，处理所有与 [start, end) 相交的空闲区
+    auto it = byStart_.upper_bound(start);
+    if (it != byStart_.begin() && std::prev(it)->first + std::prev(it)->second > start) {
+        --it;
+    }
+    while (it != byStart_.end() && it->first < end) {
+        int extentStart = it->first;
+        int extentEnd = it->first + it->second;
+        auto next = std::next(it);
+        erase(it);
+        if (extentStart < start) {
+            add(extentStart, start - extentStart);
+        }
+        if (extentEnd > end) {
+            add(end, extentEnd - end);
+        }
+        it = next;
+    }
+}
+
+int FreeExtentIndex::bestFit(int length) const {
+    auto it = byLength_.lower_bound({ length, INT_MIN });
+    return it == byLength_.end() ? -1 : it->second;
+}
+
+std::pair<int, int> FreeExtentIndex::largest() const {
+    if (byLength_.empty()) {
+        return { -1, 0 };
+    }
+    return { byLength_.rbegin()->second, byLength_.rbegin()->first };
+}
+
+int FreeExtentIndex::startOf(int block) const {
+    auto it = byStart_.upper_bound(block);
+    if (it == byStart_.begin()) {
+        return -1;
+    }
+    --it;
+    return block < it->first + it->second ? it->first : -1;
+}
+
+int FreeExtentIndex::runLengthAt(int block) const {
+    auto it = byStart_.upper_bound(block);
+    if (it == byStart_.begin()) {
+        return 0;
+    }
+    --it;
+    int end = it->first + it->second;
+    return block < end ? end - block : 0;
+}
@@ -0,0 +1,39 @@
+﻿#pragma once
+#include <map>
+#include <set>
+#include <utility>
+#include <cstddef>
+
+// 空闲区索引：与位图同步维护的空闲连续区集合。
+// 按起始块号和按长度各建一棵红黑树，最佳适配和最大空闲区查询都是 O(log N)。
+// 只收录不短于 minLength 的空闲区，更短的碎片留给逐块分配，索引大小不超过块数 / minLength
+class FreeExtentIndex {
+public:
+    void clear();
+    // 设置收录的最短空闲区，之后应 clear 重建
+    void setMinLength(int length) { minLength_ = length; }
+    int minLength() const { return minLength_; }
+    // 把 [start, start + length) 加入空闲区，并与相邻空闲区合并
+    void insert(int start, int length);
+    // 从空闲区中去掉 [start, start + length)，必要时拆分空闲区
+    void remove(int start, int length);
+
+    // 长度不小于 length 的最小空闲区的起始块号，没有则返回 -1
+    int bestFit(int length) const;
+    // 最大空闲区，没有空闲块时返回 {-1, 0}
+    std::pair<int, int> largest() const;
+    // block 所在空闲区从 block 开始的剩余长度，block 已占用或所在空闲区未收录时返回 0
+    int runLengthAt(int block) const;
+    // block 所在空闲区的起始块号，没有收录时返回 -1
+    int startOf(int block) const;
+    // 空闲区数量
+    size_t size() const { return byStart_.size(); }
+
+private:
+    void add(int start, int length);
+    void erase(std::map<int, int>::iterator it);
+
+    std::map<int, int> byStart_;                 // 起始块号 -> 长度
+    std::set<std::pair<int, int>> byLength_;     // (长度, 起始块号)
+    int minLength_ = 1;
+};
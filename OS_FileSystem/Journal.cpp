@@ -0,0 +1,419 @@
+﻿#include "Journal.h"
+#include "Metadata.h"
+#include "BlockDevice.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <unordered_map>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// 定义全局的元数据日志
+Journal journal;
+
+// 本线程句柄的嵌套深度
+static thread_local int transactionDepth = 0;
+
+Journal::~Journal() {
+    close();
+}
+
+bool Journal::open(const std::string& path) {
+    close();
+#ifdef _WIN32
+    HANDLE h = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr,
+        OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (h == INVALID_HANDLE_VALUE) {
+        std::cerr << "Failed to open journal: " << path << std::endl;
+        return false;
+    }
+    LARGE_INTEGER size;
+    GetFileSizeEx(h, &size);
+    handle_ = h;
+    fileSize_ = static_cast<uint64_t>(size.QuadPart);
+#else
+    fd_ = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd_ < 0) {
+        std::cerr << "Failed to open journal: " << path << std::endl;
+        return false;
+    }
+    fileSize_ = static_cast<uint64_t>(::lseek(fd_, 0, SEEK_END));
+#endif
+    std::lock_guard<std::mutex> lock(mutex_);
+    barrier_ = false;
+    handles_ = 0;
+    runningBytes_ = 0;
+    current_.clear();
+    pending_.clear();
+    changes_.clear();
+    loggedBlocks_.clear();
+    stats_ = JournalStats();
+    return true;
+}
+
+void Journal::close() {
+#ifdef _WIN32
+    if (handle_) {
+        CloseHandle(handle_);
+        handle_ = nullptr;
+    }
+#else
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+#endif
+}
+
+bool Journal::isOpen() const {
+#ifdef _WIN32
+    return handle_ != nullptr;
+#else
+    return fd_ >= 0;
+#endif
+}
+
+bool Journal::writeAt(const char* data, size_t length, uint64_t position) {
+    while (length > 0) {
+#ifdef _WIN32
+        OVERLAPPED ov = {};
+        ov.Offset = static_cast<DWORD>(position);
+        ov.OffsetHigh = static_cast<DWORD>(position >> 32);
+        DWORD done = 0;
+        if (!WriteFile(handle_, data, static_cast<DWORD>(std::min<size_t>(length, 1 << 30)), &done, &ov) || done == 0) {
+            return false;
+        }
+#else
+        ssize_t done = ::pwrite(fd_, data, length, static_cast<off_t>(position));
+        if (done <= 0) {
+            return false;
+        }
+#endif
+        data += done;
+        length -= done;
+        position += done;
+    }
+    return true;
+}
+
+bool Journal::readAt(char* buffer, size_t length, uint64_t position) const {
+    while (length > 0) {
+#ifdef _WIN32
+        OVERLAPPED ov = {};
+        ov.Offset = static_cast<DWORD>(position);
+        ov.OffsetHigh = static_cast<DWORD>(position >> 32);
+        DWORD done = 0;
+        if (!ReadFile(handle_, buffer, static_cast<DWORD>(std::min<size_t>(length, 1 << 30)), &done, &ov) || done == 0) {
+            return false;
+        }
+#else
+        ssize_t done = ::pread(fd_, buffer, length, static_cast<off_t>(position));
+        if (done <= 0) {
+            return false;
+        }
+#endif
+        buffer += done;
+        length -= done;
+        position += done;
+    }
+    return true;
+}
+
+void Journal::begin() {
+    if (transactionDepth++ > 0) {
+        return;
+    }
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        idle_.wait(lock, [this] { return !barrier_; });
+        handles_++;
+    }
+    metadata.recordChanges(true);
+}
+
+bool Journal::end() {
+    if (transactionDepth == 0 || --transactionDepth > 0) {
+        return false;
+    }
+    // 本线程的修改范围先取出来，加锁只为并入复合事务
+    std::vector<std::pair<size_t, size_t>> changes;
+    metadata.takeChanges(changes);
+    metadata.recordChanges(false);
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!changes.empty()) {
+        for (const auto& range : changes) {
+            runningBytes_ += range.second + sizeof(EntryHeader);
+        }
+        changes_.insert(changes_.end(), changes.begin(), changes.end());
+        stats_.transactions++;
+    }
+    if (--handles_ == 0) {
+        idle_.notify_all();
+    }
+    return runningBytes_ >= GROUP_COMMIT_BYTES;
+}
+
+bool Journal::inTransaction() const {
+    return transactionDepth > 0;
+}
+
+void Journal::quiesce() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    barrier_ = true;
+    idle_.wait(lock, [this] { return handles_ == 0; });
+}
+
+void Journal::resume() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    barrier_ = false;
+    idle_.notify_all();
+}
+
+void Journal::appendEntry(std::vector<char>& target, EntryKind kind, uint64_t offset, const char* data, size_t length) {
+    EntryHeader header = {};
+    header.kind = kind;
+    header.length = static_cast<uint32_t>(length);
+    header.offset = offset;
+    const char* bytes = reinterpret_cast<const char*>(&header);
+    target.insert(target.end(), bytes, bytes + sizeof(header));
+    if (length > 0) {
+        target.insert(target.end(), data, data + length);
+    }
+}
+
+void Journal::logData(int block, size_t offset, const char* data, size_t length) {
+    const size_t blockSize = static_cast<size_t>(metadata.blockSize());
+    std::lock_guard<std::mutex> lock(mutex_);
+    runningBytes_ += length;
+    // 按块拆开，撤销以块为单位
+    while (length > 0) {
+        block += static_cast<int>(offset / blockSize);
+        offset %= blockSize;
+        size_t chunk = std::min(length, blockSize - offset);
+        appendEntry(current_, DataEntry, static_cast<uint64_t>(block) * blockSize + offset, data, chunk);
+        loggedBlocks_.insert(block);
+        data += chunk;
+        length -= chunk;
+        offset += chunk;
+    }
+}
+
+void Journal::revoke(int block) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (loggedBlocks_.erase(block) > 0) {
+        appendEntry(current_, RevokeEntry, static_cast<uint64_t>(block), nullptr, 0);
+    }
+}
+
+void Journal::seal() {
+    if (sealHook_) {
+        std::vector<std::pair<size_t, size_t>> changes;
+        metadata.recordChanges(true);
+        sealHook_();
+        metadata.takeChanges(changes);
+        metadata.recordChanges(false);
+        std::lock_guard<std::mutex> lock(mutex_);
+        changes_.insert(changes_.end(), changes.begin(), changes.end());
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    runningBytes_ = 0;
+    if (changes_.empty() && current_.empty()) {
+        return;
+    }
+    // 同一范围可能被多个句柄改过多次（如同一 inode、同一位图字），排序合并后取最终内容；
+    // 句柄都已结束，元数据区此时的内容就是复合事务结束时的状态
+    std::sort(changes_.begin(), changes_.end());
+    // 记录头先占位，负载写完后再填
+    const size_t start = pending_.size();
+    pending_.resize(start + sizeof(RecordHeader));
+    size_t i = 0;
+    while (i < changes_.size()) {
+        size_t begin = changes_[i].first;
+        size_t end = begin + changes_[i].second;
+        while (++i < changes_.size() && changes_[i].first <= end) {
+            end = std::max(end, changes_[i].first + changes_[i].second);
+        }
+        appendEntry(pending_, MetadataEntry, begin, metadata.bytes(begin), end - begin);
+    }
+    // 元数据条目在前，目录数据和撤销条目按发生顺序在后；两类条目写的位置互不重叠
+    pending_.insert(pending_.end(), current_.begin(), current_.end());
+    current_.clear();
+
+    const char* payload = pending_.data() + start + sizeof(RecordHeader);
+    RecordHeader header = {};
+    header.magic = RECORD_MAGIC;
+    header.payloadLength = static_cast<uint32_t>(pending_.size() - start - sizeof(RecordHeader));
+    header.sequence = nextSequence_.fetch_add(1, std::memory_order_acq_rel);
+    header.payloadChecksum = crc32(payload, header.payloadLength);
+    header.headerChecksum = crc32(&header, offsetof(RecordHeader, headerChecksum));
+    std::memcpy(pending_.data() + start, &header, sizeof(header));
+    changes_.clear();
+    // 合并后的范围数组可能很大，提交后释放
+    if (changes_.capacity() > GROUP_COMMIT_BYTES / sizeof(changes_[0])) {
+        changes_.shrink_to_fit();
+    }
+}
+
+bool Journal::hasPending() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return !pending_.empty();
+}
+
+JournalStats Journal::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+void Journal::countCheckpoint() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.checkpoints++;
+}
+
+// 提交缓冲只在封装时追加，提交者之间由调用者串行，写文件时不持有 mutex_
+bool Journal::commit() {
+    std::vector<char> records;
+    uint64_t sequence;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (pending_.empty()) {
+            return true;
+        }
+        records.swap(pending_);
+        sequence = nextSequence_.load(std::memory_order_relaxed) - 1;
+    }
+    bool ok = isOpen() && writeAt(records.data(), records.size(), fileSize_);
+#ifdef _WIN32
+    ok = ok && FlushFileBuffers(handle_) != 0;
+#else
+    ok = ok && ::fdatasync(fd_) == 0;
+#endif
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!ok) {
+        // 放回提交缓冲，下次再试
+        records.insert(records.end(), pending_.begin(), pending_.end());
+        pending_.swap(records);
+        std::cerr << "Failed to commit journal." << std::endl;
+        return false;
+    }
+    fileSize_ += records.size();
+    stats_.bytes += records.size();
+    stats_.commits++;
+    // 提交缓冲的内存留给下次封装，大事务之后释放
+    if (pending_.empty() && records.capacity() <= GROUP_COMMIT_BYTES * 4) {
+        records.clear();
+        pending_.swap(records);
+    }
+    committedSequence_.store(sequence, std::memory_order_release);
+    return true;
+}
+
+bool Journal::reset() {
+    if (!isOpen()) {
+        return false;
+    }
+#ifdef _WIN32
+    LARGE_INTEGER zero = {};
+    bool ok = SetFilePointerEx(handle_, zero, nullptr, FILE_BEGIN) && SetEndOfFile(handle_) && FlushFileBuffers(handle_);
+#else
+    bool ok = ::ftruncate(fd_, 0) == 0 && ::fsync(fd_) == 0;
+#endif
+    if (!ok) {
+        std::cerr << "Failed to reset journal." << std::endl;
+        return false;
+    }
+    fileSize_ = 0;
+    std::lock_guard<std::mutex> lock(mutex_);
+    loggedBlocks_.clear();
+    return true;
+}
+
+int Journal::replay(MetadataRegion& region, BlockDevice& device) {
+    if (!isOpen() || fileSize_ == 0) {
+        return 0;
+    }
+    std::vector<char> log(static_cast<size_t>(fileSize_.load()));
+    if (!readAt(log.data(), log.size(), 0)) {
+        std::cerr << "Failed to read journal." << std::endl;
+        return 0;
+    }
+    // 第一遍：找出完整且校验通过、序号连续的记录，崩溃时写了一半的尾部在这里被截掉
+    struct Record {
+        uint64_t sequence;
+        size_t payload;
+        size_t length;
+    };
+    std::vector<Record> records;
+    size_t position = 0;
+    while (position + sizeof(RecordHeader) <= log.size()) {
+        RecordHeader header;
+        std::memcpy(&header, log.data() + position, sizeof(header));
+        if (header.magic != RECORD_MAGIC || header.headerChecksum != crc32(&header, offsetof(RecordHeader, headerChecksum))
+            || position + sizeof(header) + header.payloadLength > log.size()
+            || header.payloadChecksum != crc32(log.data() + position + sizeof(header), header.payloadLength)
+            || (!records.empty() && header.sequence != records.back().sequence + 1)) {
+            break;
+        }
+        records.push_back({ header.sequence, position + sizeof(header), header.payloadLength });
+        position += sizeof(header) + header.payloadLength;
+    }
+
+    auto forEachEntry = [&](const Record& record, auto&& visit) {
+        size_t at = record.payload;
+        const size_t end = record.payload + record.length;
+        while (at + sizeof(EntryHeader) <= end) {
+            EntryHeader entry;
+            std::memcpy(&entry, log.data() + at, sizeof(entry));
+            at += sizeof(entry);
+            if (at + entry.length > end) {
+                break;
+            }
+            visit(entry, log.data() + at);
+            at += entry.length;
+        }
+    };
+
+    // 第二遍：记下每个块最后一次被撤销的位置（所有记录中条目的顺序号）
+    std::unordered_map<uint64_t, uint64_t> revoked;
+    uint64_t ordinal = 0;
+    for (const Record& record : records) {
+        forEachEntry(record, [&](const EntryHeader& entry, const char*) {
+            ++ordinal;
+            if (entry.kind == RevokeEntry) {
+                revoked[entry.offset] = ordinal;
+            }
+        });
+    }
+
+    // 第三遍：按顺序重放，撤销之前的数据条目跳过
+    const uint64_t blockSize = static_cast<uint64_t>(device.blockSize());
+    bool ok = true;
+    ordinal = 0;
+    for (const Record& record : records) {
+        forEachEntry(record, [&](const EntryHeader& entry, const char* data) {
+            ++ordinal;
+            if (entry.kind == MetadataEntry) {
+                ok = region.apply(static_cast<size_t>(entry.offset), data, entry.length) && ok;
+            }
+            else if (entry.kind == DataEntry) {
+                uint64_t block = entry.offset / blockSize;
+                auto it = revoked.find(block);
+                if (it == revoked.end() || it->second < ordinal) {
+                    ok = device.writeBlock(static_cast<int>(block), data, static_cast<size_t>(entry.offset % blockSize), entry.length) && ok;
+                }
+            }
+        });
+    }
+    if (!ok) {
+        std::cerr << "Some journal entries could not be replayed." << std::endl;
+    }
+    if (!records.empty()) {
+        nextSequence_ = std::max(nextSequence_.load(), records.back().sequence + 1);
+        committedSequence_ = nextSequence_ - 1;
+    }
+    return static_cast<int>(records.size());
+}
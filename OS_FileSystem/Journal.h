@@ -0,0 +1,137 @@
+﻿#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+class MetadataRegion;
+class BlockDevice;
+
+// 日志统计
+struct JournalStats {
+    uint64_t transactions = 0;   // 提交的事务数
+    uint64_t commits = 0;        // 组提交次数（每次一个 fsync）
+    uint64_t checkpoints = 0;    // 检查点次数
+    uint64_t bytes = 0;          // 写入日志的字节数
+};
+
+// 元数据重做日志（预写日志）。
+// 一个公开操作（创建、删除、重命名、写入……）是一个句柄，多个线程的句柄同时加入正在运行的
+// 复合事务：句柄结束时把本线程修改的元数据范围并入复合事务，目录数据块中被修改的字节
+// （释放尚未提交就被重新分配的文件块，写入的数据也按目录块处理）在记录时直接追加。
+// 组提交时先挡住新句柄、等已开始的句柄全部结束（quiesce），把复合事务封装为一条记录
+// （元数据范围取此时的内容），放开新句柄后再写入日志文件、一次 fsync；
+// 元数据区和目录块在日志提交之前不会写到原位置（元数据区是写时复制映射，目录块在块缓存中被钉住），
+// 检查点把它们写回原位置后清空日志。挂载时重放日志中校验通过的事务，崩溃后元数据仍然一致。
+//
+// 日志文件由连续的记录组成：记录头（魔数、负载长度、序号、负载校验和、头校验和）+ 负载，
+// 负载是若干条目：条目头（类型、长度、偏移）+ 数据。
+// 目录块被释放后可能改作文件数据块，释放时写一条撤销条目，重放时跳过该块更早的数据条目
+class Journal {
+public:
+    Journal() = default;
+    ~Journal();
+    Journal(const Journal&) = delete;
+    Journal& operator=(const Journal&) = delete;
+
+    // 打开日志文件，不存在则创建
+    bool open(const std::string& path);
+    void close();
+    bool isOpen() const;
+
+    // 把日志中完整且校验通过的事务依次重放到元数据区和磁盘镜像，返回重放的事务数。
+    // 之后调用者应写回元数据区和磁盘镜像，再 reset
+    int replay(MetadataRegion& region, BlockDevice& device);
+    // 检查点之后清空日志
+    bool reset();
+
+    // 句柄可以在同一线程内嵌套。最外层的 begin 在封装期间等待，加入正在运行的复合事务；
+    // 最外层的 end 把本线程的元数据修改范围并入复合事务。
+    // 返回 true 表示复合事务已经足够大，应当立即提交
+    void begin();
+    bool end();
+    // 本线程是否在句柄中
+    bool inTransaction() const;
+    // 正在运行的复合事务的序号，用于钉住块缓存中的目录块
+    uint64_t currentSequence() const { return nextSequence_.load(std::memory_order_acquire); }
+    // 记录数据块的修改：块 block 的 offset 处的 length 字节（在句柄中调用）
+    void logData(int block, size_t offset, const char* data, size_t length);
+    // 块被释放：重放时该块更早的数据条目作废（在句柄中调用）
+    void revoke(int block);
+
+    // 挡住新句柄并等待已开始的句柄全部结束；resume 放开。调用者不能在句柄中
+    void quiesce();
+    void resume();
+    // 封装前调用的钩子（如把内存中的空闲计数写入超级块），它的修改并入本次记录
+    void setSealHook(std::function<void()> hook) { sealHook_ = std::move(hook); }
+    // 在 quiesce 和 resume 之间调用：把复合事务封装为一条记录放入提交缓冲，空事务不产生记录
+    void seal();
+
+    // 是否有已封装但未提交的记录
+    bool hasPending() const;
+    // 组提交：把提交缓冲写入日志文件并 fsync
+    bool commit();
+    // 已提交的最大事务序号
+    uint64_t committedSequence() const { return committedSequence_.load(std::memory_order_acquire); }
+    // 日志文件当前的字节数
+    uint64_t size() const { return fileSize_.load(std::memory_order_relaxed); }
+    JournalStats stats() const;
+    void countCheckpoint();
+
+    // 提交缓冲超过这个大小时立即提交
+    static constexpr size_t GROUP_COMMIT_BYTES = 1 << 20;
+
+private:
+    enum EntryKind : uint8_t {
+        MetadataEntry = 1,   // 元数据区：offset 为文件偏移
+        DataEntry = 2,       // 磁盘镜像：offset 为 块号 * 块大小 + 块内偏移
+        RevokeEntry = 3      // 撤销：offset 为块号，没有数据
+    };
+    struct RecordHeader {
+        uint32_t magic;
+        uint32_t payloadLength;
+        uint64_t sequence;
+        uint32_t payloadChecksum;
+        uint32_t headerChecksum;     // 前面各字段的 CRC32
+    };
+    struct EntryHeader {
+        uint8_t kind;
+        uint8_t reserved[3];
+        uint32_t length;
+        uint64_t offset;
+    };
+    static const uint32_t RECORD_MAGIC = 0x4C4E524A; // "JRNL"
+
+    static void appendEntry(std::vector<char>& target, EntryKind kind, uint64_t offset, const char* data, size_t length);
+    bool writeAt(const char* data, size_t length, uint64_t position);
+    bool readAt(char* buffer, size_t length, uint64_t position) const;
+
+#ifdef _WIN32
+    void* handle_ = nullptr;
+#else
+    int fd_ = -1;
+#endif
+    // 以下成员除原子量外都由 mutex_ 保护；fileSize_ 只由串行的提交者修改，可以随时读取
+    mutable std::mutex mutex_;
+    std::condition_variable idle_;              // 句柄数归零或封装结束时通知
+    bool barrier_ = false;                      // 正在封装，新句柄等待
+    int handles_ = 0;                           // 进行中的最外层句柄数
+    size_t runningBytes_ = 0;                   // 复合事务的估计大小
+    std::atomic<uint64_t> nextSequence_{ 1 };
+    std::atomic<uint64_t> committedSequence_{ 0 };
+    std::atomic<uint64_t> fileSize_{ 0 };
+    std::vector<char> current_;                 // 复合事务已记录的数据和撤销条目
+    std::vector<char> pending_;                 // 已封装、待提交的记录
+    std::vector<std::pair<size_t, size_t>> changes_;  // 复合事务修改的元数据范围
+    std::unordered_set<int> loggedBlocks_;      // 上次检查点以来记过数据条目的块
+    std::function<void()> sealHook_;
+    JournalStats stats_;
+};
+
+// 全局的元数据日志
+extern Journal journal;
@@ -0,0 +1,917 @@
+﻿#include "Metadata.h"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <intrin.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+// 定义全局的元数据区
+MetadataRegion metadata;
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+bool MappedFile::open(const std::string& path, size_t size, bool create) {
+    close();
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr,
+        create ? CREATE_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        std::cerr << "Failed to open metadata file: " << path << std::endl;
+        return false;
+    }
+    LARGE_INTEGER fileSize;
+    if (!create && (!GetFileSizeEx(file, &fileSize) || static_cast<size_t>(fileSize.QuadPart) < size)) {
+        std::cerr << "Metadata file size is incorrect: " << path << std::endl;
+        CloseHandle(file);
+        return false;
+    }
+    // 写时复制映射不会扩展文件，新建时先把文件扩展到映射大小
+    if (create) {
+        LARGE_INTEGER end;
+        end.QuadPart = static_cast<LONGLONG>(size);
+        if (!SetFilePointerEx(file, end, nullptr, FILE_BEGIN) || !SetEndOfFile(file)) {
+            std::cerr << "Metadata file size is incorrect: " << path << std::endl;
+            CloseHandle(file);
+            return false;
+        }
+    }
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_WRITECOPY,
+        static_cast<DWORD>(static_cast<uint64_t>(size) >> 32), static_cast<DWORD>(size), nullptr);
+    void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, size) : nullptr;
+    if (!view) {
+        std::cerr << "Failed to map metadata file: " << path << std::endl;
+        if (mapping) {
+            CloseHandle(mapping);
+        }
+        CloseHandle(file);
+        return false;
+    }
+    file_ = file;
+    mapping_ = mapping;
+    data_ = static_cast<char*>(view);
+#else
+    int fd = ::open(path.c_str(), O_RDWR | (create ? (O_CREAT | O_TRUNC) : 0), 0644);
+    if (fd < 0) {
+        std::cerr << "Failed to open metadata file: " << path << std::endl;
+        return false;
+    }
+    off_t fileSize = ::lseek(fd, 0, SEEK_END);
+    if (create ? ::ftruncate(fd, size) != 0 : fileSize < static_cast<off_t>(size)) {
+        std::cerr << "Metadata file size is incorrect: " << path << std::endl;
+        ::close(fd);
+        return false;
+    }
+    void* view = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (view == MAP_FAILED) {
+        std::cerr << "Failed to map metadata file: " << path << std::endl;
+        ::close(fd);
+        return false;
+    }
+    fd_ = fd;
+    data_ = static_cast<char*>(view);
+#endif
+    size_ = size;
+    return true;
+}
+
+void MappedFile::close() {
+    if (!data_) {
+        return;
+    }
+    // 写时复制映射中未写回的修改直接丢弃
+#ifdef _WIN32
+    UnmapViewOfFile(data_);
+    CloseHandle(mapping_);
+    CloseHandle(file_);
+    mapping_ = nullptr;
+    file_ = nullptr;
+#else
+    ::munmap(data_, size_);
+    ::close(fd_);
+    fd_ = -1;
+#endif
+    data_ = nullptr;
+    size_ = 0;
+}
+
+bool MappedFile::writeBack(size_t offset, size_t length) {
+    if (!data_ || offset >= size_) {
+        return false;
+    }
+    length = std::min(length, size_ - offset);
+    const char* source = data_ + offset;
+    while (length > 0) {
+#ifdef _WIN32
+        OVERLAPPED ov = {};
+        ov.Offset = static_cast<DWORD>(offset);
+        ov.OffsetHigh = static_cast<DWORD>(static_cast<uint64_t>(offset) >> 32);
+        DWORD done = 0;
+        if (!WriteFile(file_, source, static_cast<DWORD>(std::min<size_t>(length, 1 << 30)), &done, &ov) || done == 0) {
+            return false;
+        }
+#else
+        ssize_t done = ::pwrite(fd_, source, length, static_cast<off_t>(offset));
+        if (done <= 0) {
+            return false;
+        }
+#endif
+        source += done;
+        offset += done;
+        length -= done;
+    }
+    return true;
+}
+
+bool MappedFile::syncFile() {
+    if (!data_) {
+        return false;
+    }
+#ifdef _WIN32
+    return FlushFileBuffers(file_) != 0;
+#else
+    return ::fsync(fd_) == 0;
+#endif
+}
+
+size_t MappedFile::pageSize() {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwPageSize;
+#else
+    return static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+#endif
+}
+
+// 计算各区域在文件中的偏移，每个区域按页对齐
+void MetadataRegion::computeLayout(int blockSize, int blockCount, int inodeCount) {
+    pageSize_ = MappedFile::pageSize();
+    auto align = [this](size_t n) { return (n + pageSize_ - 1) / pageSize_ * pageSize_; };
+    blockSize_ = blockSize;
+    blockCount_ = blockCount;
+    inodeCount_ = inodeCount;
+    fatOffset_ = align(sizeof(Superblock));
+    bitmapOffset_ = fatOffset_ + align(static_cast<size_t>(blockCount) * sizeof(int32_t));
+    inodeOffset_ = bitmapOffset_ + align((static_cast<size_t>(blockCount) + 63) / 64 * sizeof(uint64_t));
+    totalSize_ = inodeOffset_ + align(static_cast<size_t>(inodeCount) * sizeof(DiskInode));
+    pageDirty_.reset(new std::atomic<uint8_t>[totalSize_ / pageSize_]());
+    dirtyPages_.clear();
+}
+
+bool MetadataRegion::checkGeometry(int blockSize, int blockCount, int inodeCount) {
+    if (blockSize < MIN_BLOCK_SIZE || (blockSize & (blockSize - 1)) != 0) {
+        std::cerr << "Invalid block size: " << blockSize << " (must be a power of two of at least "
+            << MIN_BLOCK_SIZE << " bytes)." << std::endl;
+        return false;
+    }
+    if (blockCount <= 0) {
+        std::cerr << "Invalid block count: " << blockCount << " (must be positive)." << std::endl;
+        return false;
+    }
+    if (inodeCount <= 0) {
+        std::cerr << "Invalid inode count: " << inodeCount << " (must be positive)." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool MetadataRegion::create(const std::string& path, int blockSize, int blockCount, int inodeCount) {
+    // 先检查参数再关闭和截断，参数不合法时原来的卷保持不变
+    if (!checkGeometry(blockSize, blockCount, inodeCount)) {
+        return false;
+    }
+    close();
+    computeLayout(blockSize, blockCount, inodeCount);
+    if (!file_.open(path, totalSize_, true)) {
+        return false;
+    }
+    // 新扩展的文件内容全为 0，只需写入超级块
+    Superblock& sb = superblock();
+    sb.magic = MAGIC;
+    sb.version = VERSION;
+    sb.blockSize = blockSize;
+    sb.blockCount = blockCount;
+    sb.inodeCount = inodeCount;
+    sb.freeBlockCount = blockCount;
+    sb.freeInodeCount = 0;
+    sb.freeInodeHead = -1;
+    sb.detachedCount = 0;
+    markSuperblockDirty();
+    return true;
+}
+
+bool MetadataRegion::open(const std::string& path) {
+    close();
+    // 先单独读出超级块，得到几何参数后再映射整个文件
+    Superblock sb = {};
+    std::ifstream in(path, std::ios::binary);
+    if (!in || !in.read(reinterpret_cast<char*>(&sb), sizeof(sb))) {
+        std::cerr << "Failed to read superblock: " << path << std::endl;
+        return false;
+    }
+    in.close();
+    if (sb.magic != MAGIC) {
+        std::cerr << "Not a volume metadata file (bad magic): " << path << std::endl;
+        return false;
+    }
+    if (sb.version != VERSION) {
+        std::cerr << "Unsupported volume format version " << sb.version << " (expected " << VERSION << "): " << path << std::endl;
+        return false;
+    }
+    if (sb.blockSize <= 0 || sb.blockCount <= 0 || sb.inodeCount <= 0) {
+        std::cerr << "Superblock has invalid geometry: " << path << std::endl;
+        return false;
+    }
+    computeLayout(sb.blockSize, sb.blockCount, sb.inodeCount);
+    return file_.open(path, totalSize_, false);
+}
+
+void MetadataRegion::close() {
+    if (file_.isOpen()) {
+        sync();
+        file_.close();
+    }
+}
+
+// 各线程记录的修改范围。全局只有一个元数据区，直接用线程局部变量
+static thread_local bool threadRecording = false;
+static thread_local std::vector<std::pair<size_t, size_t>> threadChanges;
+
+void MetadataRegion::recordChanges(bool enabled) {
+    threadRecording = enabled;
+}
+
+void MetadataRegion::markDirty(const void* p, size_t length) {
+    if (!file_.isOpen() || length == 0) {
+        return;
+    }
+    size_t offset = static_cast<const char*>(p) - file_.data();
+    if (threadRecording) {
+        threadChanges.emplace_back(offset, length);
+    }
+    for (size_t page = offset / pageSize_; page <= (offset + length - 1) / pageSize_; ++page) {
+        if (pageDirty_[page].load(std::memory_order_relaxed) == 0 && pageDirty_[page].exchange(1) == 0) {
+            std::lock_guard<std::mutex> lock(dirtyMutex_);
+            dirtyPages_.push_back(page);
+        }
+    }
+}
+
+bool MetadataRegion::sync() {
+    if (!file_.isOpen()) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(dirtyMutex_);
+    // 相邻的脏页合并成一次写入，全部写完后再刷盘
+    std::sort(dirtyPages_.begin(), dirtyPages_.end());
+    bool ok = true;
+    size_t i = 0;
+    while (i < dirtyPages_.size()) {
+        size_t first = dirtyPages_[i];
+        size_t last = first;
+        while (i + 1 < dirtyPages_.size() && dirtyPages_[i + 1] == last + 1) {
+            last = dirtyPages_[++i];
+        }
+        ++i;
+        if (!file_.writeBack(first * pageSize_, (last - first + 1) * pageSize_)) {
+            std::cerr << "Failed to sync metadata pages: " << first << "-" << last << std::endl;
+            ok = false;
+        }
+    }
+    if (!dirtyPages_.empty() && !file_.syncFile()) {
+        std::cerr << "Failed to flush metadata file." << std::endl;
+        ok = false;
+    }
+    for (size_t page : dirtyPages_) {
+        pageDirty_[page] = 0;
+    }
+    dirtyPages_.clear();
+    return ok;
+}
+
+void MetadataRegion::takeChanges(std::vector<std::pair<size_t, size_t>>& changes) {
+    changes.insert(changes.end(), threadChanges.begin(), threadChanges.end());
+    threadChanges.clear();
+}
+
+bool MetadataRegion::apply(size_t offset, const char* data, size_t length) {
+    if (!file_.isOpen() || offset + length > totalSize_) {
+        return false;
+    }
+    std::memcpy(file_.data() + offset, data, length);
+    markDirty(file_.data() + offset, length);
+    return true;
+}
+
+void FatTable::set(int index, int value) {
+    entries_[index] = value;
+    metadata.markDirty(&entries_[index], sizeof(int32_t));
+}
+
+void FatTable::linkRun(int start, int count, int next) {
+    if (count <= 0) {
+        return;
+    }
+    for (int i = 0; i + 1 < count; ++i) {
+        entries_[start + i] = start + i + 1;
+    }
+    entries_[start + count - 1] = next;
+    metadata.markDirty(&entries_[start], static_cast<size_t>(count) * sizeof(int32_t));
+}
+
+void FatTable::fillRun(int start, int count, int value) {
+    if (count <= 0) {
+        return;
+    }
+    std::fill(entries_ + start, entries_ + start + count, value);
+    metadata.markDirty(&entries_[start], static_cast<size_t>(count) * sizeof(int32_t));
+}
+
+void FatTable::assign(int value) {
+    std::fill(entries_, entries_ + count_, value);
+    metadata.markDirty(entries_, static_cast<size_t>(count_) * sizeof(int32_t));
+}
+
+// 最低的 1 位的下标，x 不能为 0
+static inline int countTrailingZeros(uint64_t x) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, x);
+    return static_cast<int>(index);
+#else
+    return __builtin_ctzll(x);
+#endif
+}
+
+// 最高的 1 位之上 0 的个数，x 不能为 0
+static inline int countLeadingZeros(uint64_t x) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanReverse64(&index, x);
+    return 63 - static_cast<int>(index);
+#else
+    return __builtin_clzll(x);
+#endif
+}
+
+static inline int popCount(uint64_t x) {
+#ifdef _MSC_VER
+    return static_cast<int>(__popcnt64(x));
+#else
+    return __builtin_popcountll(x);
+#endif
+}
+
+void BlockBitmap::attach(uint64_t* words, int bitCount) {
+    words_ = words;
+    bitCount_ = bitCount;
+    wordCount_ = (static_cast<size_t>(bitCount) + 63) / 64;
+    groupCount_ = (static_cast<size_t>(bitCount) + GROUP_BLOCKS - 1) / GROUP_BLOCKS;
+    groups_.reset(new Group[groupCount_]);
+    for (size_t group = 0; group < groupCount_; ++group) {
+        groups_[group].extents.setMinLength(MIN_INDEXED_RUN);
+    }
+    fullGroups_.reset(new std::atomic<uint64_t>[(groupCount_ + 63) / 64]());
+    free_.store(metadata.superblock().freeBlockCount, std::memory_order_relaxed);
+}
+
+uint64_t BlockBitmap::padding(size_t index) const {
+    int tail = bitCount_ & 63;
+    return (index + 1 == wordCount_ && tail != 0) ? ~uint64_t(0) << tail : 0;
+}
+
+// 按字扫描组内的位图：不短于一个字的空闲区只能跨字，字内部夹在已占用位之间的空闲位不用看
+void BlockBitmap::build(size_t group) {
+    Group& g = groups_[group];
+    g.built = true;
+    g.freeBlocks = 0;
+    std::fill(std::begin(g.full), std::end(g.full), uint64_t(0));
+    g.extents.clear();
+    const size_t first = group * GROUP_WORDS;
+    const size_t last = std::min(wordCount_, first + GROUP_WORDS);
+    // 最后一组不足 GROUP_WORDS 个字，不存在的字视为已满
+    for (size_t i = last - first; i < static_cast<size_t>(GROUP_WORDS); ++i) {
+        g.full[i >> 6] |= uint64_t(1) << (i & 63);
+    }
+    long long runStart = -1;   // 延续到当前字的空闲区的起点
+    for (size_t w = first; w < last; ++w) {
+        uint64_t bits = word(w);
+        g.freeBlocks += 64 - popCount(bits);
+        if (bits == ~uint64_t(0)) {
+            g.full[(w - first) >> 6] |= uint64_t(1) << ((w - first) & 63);
+        }
+        if (bits == 0) {
+            if (runStart < 0) {
+                runStart = static_cast<long long>(w * 64);
+            }
+            continue;
+        }
+        if (runStart >= 0) {
+            long long end = static_cast<long long>(w * 64) + countTrailingZeros(bits);
+            g.extents.insert(static_cast<int>(runStart), static_cast<int>(end - runStart));
+        }
+        // 最高的已占用位之上的空闲位开始新的一段
+        runStart = countLeadingZeros(bits) > 0 ? static_cast<long long>(w * 64) + 64 - countLeadingZeros(bits) : -1;
+    }
+    if (runStart >= 0) {
+        g.extents.insert(static_cast<int>(runStart), static_cast<int>(groupEnd(group) - runStart));
+    }
+    updateGroupState(group);
+}
+
+void BlockBitmap::updateGroupState(size_t group) {
+    Group& g = groups_[group];
+    const uint64_t mask = uint64_t(1) << (group & 63);
+    if (g.freeBlocks == 0) {
+        fullGroups_[group >> 6].fetch_or(mask, std::memory_order_relaxed);
+    }
+    else {
+        fullGroups_[group >> 6].fetch_and(~mask, std::memory_order_relaxed);
+    }
+    g.longestRun.store(g.extents.largest().second, std::memory_order_relaxed);
+}
+
+size_t BlockBitmap::nextOpenGroup(size_t group) const {
+    while (group < groupCount_) {
+        uint64_t open = ~fullGroups_[group >> 6].load(std::memory_order_relaxed) & (~uint64_t(0) << (group & 63));
+        if (open) {
+            return std::min(groupCount_, (group & ~size_t(63)) + countTrailingZeros(open));
+        }
+        group = (group | 63) + 1;
+    }
+    return groupCount_;
+}
+
+int BlockBitmap::findFreeLocked(size_t group, int from) const {
+    const Group& g = groups_[group];
+    const size_t first = group * GROUP_WORDS;
+    size_t w = static_cast<size_t>(from) >> 6;
+    uint64_t free = ~word(w) & (~uint64_t(0) << (from & 63));
+    if (free) {
+        return static_cast<int>(w * 64 + countTrailingZeros(free));
+    }
+    // 组内之后第一个未满的字
+    for (size_t i = w - first + 1; i < static_cast<size_t>(GROUP_WORDS);) {
+        uint64_t open = ~g.full[i >> 6] & (~uint64_t(0) << (i & 63));
+        if (open) {
+            w = first + (i & ~size_t(63)) + countTrailingZeros(open);
+            return static_cast<int>(w * 64 + countTrailingZeros(~word(w)));
+        }
+        i = (i | 63) + 1;
+    }
+    return -1;
+}
+
+int BlockBitmap::freeRunLength(int start, int end, int limit) const {
+    int length = 0;
+    size_t bit = static_cast<size_t>(start);
+    while (length < limit && bit < static_cast<size_t>(end)) {
+        size_t offset = bit & 63;
+        uint64_t used = word(bit >> 6) >> offset;
+        if (used) {
+            length += countTrailingZeros(used);
+            break;
+        }
+        length += static_cast<int>(64 - offset);
+        bit += 64 - offset;
+    }
+    return std::min(std::min(length, limit), end - start);
+}
+
+int BlockBitmap::freeRunLengthBefore(int begin, int end, int limit) const {
+    int length = 0;
+    int bit = end;
+    while (length < limit && bit > begin) {
+        // 本字中 bit 之前的位移到高端，从高位往低位数空闲位
+        int inWord = ((bit - 1) & 63) + 1;
+        uint64_t used = word(static_cast<size_t>(bit - 1) >> 6) << (64 - inWord);
+        if (used) {
+            length += countLeadingZeros(used);
+            break;
+        }
+        length += inWord;
+        bit -= inWord;
+    }
+    return std::min(std::min(length, limit), end - begin);
+}
+
+int BlockBitmap::setLocked(size_t group, int start, int count) {
+    Group& g = groups_[group];
+    const size_t first = group * GROUP_WORDS;
+    size_t bit = static_cast<size_t>(start);
+    size_t firstWord = bit >> 6;
+    int added = 0;
+    for (int remaining = count; remaining > 0;) {
+        size_t w = bit >> 6;
+        size_t offset = bit & 63;
+        int n = std::min(remaining, static_cast<int>(64 - offset));
+        uint64_t mask = (n == 64 ? ~uint64_t(0) : ((uint64_t(1) << n) - 1)) << offset;
+        added += popCount(mask & ~words_[w]);
+        words_[w] |= mask;
+        if (g.built && word(w) == ~uint64_t(0)) {
+            g.full[(w - first) >> 6] |= uint64_t(1) << ((w - first) & 63);
+        }
+        bit += n;
+        remaining -= n;
+    }
+    size_t lastWord = (bit - 1) >> 6;
+    metadata.markDirty(&words_[firstWord], (lastWord - firstWord + 1) * sizeof(uint64_t));
+    if (g.built) {
+        g.extents.remove(start, count);
+        g.freeBlocks -= added;
+        updateGroupState(group);
+    }
+    return added;
+}
+
+int BlockBitmap::resetLocked(size_t group, int start, int count) {
+    Group& g = groups_[group];
+    const size_t first = group * GROUP_WORDS;
+    size_t bit = static_cast<size_t>(start);
+    size_t firstWord = bit >> 6;
+    int removed = 0;
+    for (int remaining = count; remaining > 0;) {
+        size_t w = bit >> 6;
+        size_t offset = bit & 63;
+        int n = std::min(remaining, static_cast<int>(64 - offset));
+        uint64_t mask = (n == 64 ? ~uint64_t(0) : ((uint64_t(1) << n) - 1)) << offset;
+        uint64_t cleared = mask & words_[w];
+        if (cleared) {
+            words_[w] &= ~mask;
+            removed += popCount(cleared);
+            if (g.built) {
+                g.full[(w - first) >> 6] &= ~(uint64_t(1) << ((w - first) & 63));
+            }
+        }
+        bit += n;
+        remaining -= n;
+    }
+    size_t lastWord = (bit - 1) >> 6;
+    metadata.markDirty(&words_[firstWord], (lastWord - firstWord + 1) * sizeof(uint64_t));
+    if (g.built) {
+        g.freeBlocks += removed;
+        // 整段连同两侧原有的空闲块作为一个空闲区放入索引
+        indexFreed(group, start, start + count);
+        updateGroupState(group);
+    }
+    return removed;
+}
+
+void BlockBitmap::indexFreed(size_t group, int start, int end) {
+    Group& g = groups_[group];
+    const int begin = groupStart(group);
+    const int limit = groupEnd(group);
+    // 两侧不够 MIN_INDEXED_RUN 的空闲位直接在位图中数完，够长的空闲区一定已在索引中
+    int before = freeRunLengthBefore(begin, start, MIN_INDEXED_RUN);
+    if (before == MIN_INDEXED_RUN && g.extents.startOf(start - 1) != -1) {
+        start = g.extents.startOf(start - 1);
+    }
+    else {
+        start -= before;
+    }
+    int after = end < limit ? freeRunLength(end, limit, MIN_INDEXED_RUN) : 0;
+    if (after == MIN_INDEXED_RUN && g.extents.runLengthAt(end) > 0) {
+        end += g.extents.runLengthAt(end);
+    }
+    else {
+        end += after;
+    }
+    g.extents.remove(start, end - start);
+    g.extents.insert(start, end - start);
+}
+
+bool BlockBitmap::test(int bit) const {
+    std::lock_guard<std::mutex> lock(groups_[groupOf(bit)].mutex);
+    return (words_[bit >> 6] >> (bit & 63)) & 1;
+}
+
+void BlockBitmap::setRange(int start, int count) {
+    int added = 0;
+    while (count > 0) {
+        size_t group = groupOf(start);
+        int n = std::min(count, groupEnd(group) - start);
+        {
+            std::lock_guard<std::mutex> lock(groups_[group].mutex);
+            added += setLocked(group, start, n);
+        }
+        start += n;
+        count -= n;
+    }
+    free_.fetch_sub(added, std::memory_order_relaxed);
+}
+
+void BlockBitmap::resetRange(int start, int count) {
+    int removed = 0;
+    while (count > 0) {
+        size_t group = groupOf(start);
+        int n = std::min(count, groupEnd(group) - start);
+        {
+            std::lock_guard<std::mutex> lock(groups_[group].mutex);
+            removed += resetLocked(group, start, n);
+        }
+        start += n;
+        count -= n;
+    }
+    free_.fetch_add(removed, std::memory_order_relaxed);
+}
+
+void BlockBitmap::set(int bit) {
+    setRange(bit, 1);
+}
+
+void BlockBitmap::reset(int bit) {
+    resetRange(bit, 1);
+}
+
+void BlockBitmap::reset() {
+    std::memset(words_, 0, wordCount_ * sizeof(uint64_t));
+    metadata.markDirty(words_, wordCount_ * sizeof(uint64_t));
+    for (size_t group = 0; group < groupCount_; ++group) {
+        std::lock_guard<std::mutex> lock(groups_[group].mutex);
+        build(group);
+    }
+    free_.store(bitCount_, std::memory_order_relaxed);
+}
+
+void BlockBitmap::storeFreeCount() {
+    Superblock& sb = metadata.superblock();
+    if (sb.freeBlockCount != freeCount()) {
+        sb.freeBlockCount = freeCount();
+        metadata.markSuperblockDirty();
+    }
+}
+
+int BlockBitmap::claimFree(int from) {
+    from = std::max(from, 0);
+    if (from >= bitCount_) {
+        return -1;
+    }
+    for (size_t group = groupOf(from); group < groupCount_; group = nextOpenGroup(group + 1)) {
+        Group& g = groups_[group];
+        std::lock_guard<std::mutex> lock(g.mutex);
+        if (!g.built) {
+            build(group);
+        }
+        int block = g.freeBlocks > 0 ? findFreeLocked(group, std::max(from, groupStart(group))) : -1;
+        if (block != -1) {
+            setLocked(group, block, 1);
+            free_.fetch_sub(1, std::memory_order_relaxed);
+            return block;
+        }
+    }
+    return -1;
+}
+
+int BlockBitmap::claimRun(int start, int limit) {
+    int claimed = 0;
+    while (claimed < limit && start >= 0 && start < bitCount_) {
+        size_t group = groupOf(start);
+        int end = groupEnd(group);
+        int n;
+        {
+            std::lock_guard<std::mutex> lock(groups_[group].mutex);
+            n = freeRunLength(start, end, limit - claimed);
+            if (n > 0) {
+                setLocked(group, start, n);
+            }
+        }
+        claimed += n;
+        start += n;
+        // 在组内遇到已占用的块就停下，到达组末尾时接着看下一组
+        if (n == 0 || start < end) {
+            break;
+        }
+    }
+    free_.fetch_sub(claimed, std::memory_order_relaxed);
+    return claimed;
+}
+
+int BlockBitmap::claimBestFit(int count, int hint) {
+    if (count <= 0 || count > GROUP_BLOCKS || groupCount_ == 0) {
+        return -1;
+    }
+    const size_t first = hint >= 0 && hint < bitCount_ ? groupOf(hint) : 0;
+    for (size_t i = 0; i < groupCount_; ++i) {
+        size_t group = (first + i) % groupCount_;
+        Group& g = groups_[group];
+        // 最长空闲区不够的组不加锁，直接跳过
+        if (g.longestRun.load(std::memory_order_relaxed) < count) {
+            continue;
+        }
+        std::lock_guard<std::mutex> lock(g.mutex);
+        if (!g.built) {
+            build(group);
+        }
+        int start = g.extents.bestFit(count);
+        if (start != -1) {
+            setLocked(group, start, count);
+            free_.fetch_sub(count, std::memory_order_relaxed);
+            return start;
+        }
+    }
+    return -1;
+}
+
+std::pair<int, int> BlockBitmap::claimLargest(int limit, int hint) {
+    if (limit <= 0) {
+        return { -1, 0 };
+    }
+    const size_t first = hint >= 0 && hint < bitCount_ ? groupOf(hint) : 0;
+    for (size_t i = 0; i < groupCount_; ++i) {
+        size_t group = (first + i) % groupCount_;
+        Group& g = groups_[group];
+        if (g.longestRun.load(std::memory_order_relaxed) == 0) {
+            continue;
+        }
+        std::lock_guard<std::mutex> lock(g.mutex);
+        if (!g.built) {
+            build(group);
+        }
+        std::pair<int, int> extent = g.extents.largest();
+        if (extent.second > 0) {
+            int length = std::min(extent.second, limit);
+            setLocked(group, extent.first, length);
+            free_.fetch_sub(length, std::memory_order_relaxed);
+            return { extent.first, length };
+        }
+    }
+    // 只剩短碎片：逐段拼接
+    int block = claimFree(hint);
+    if (block == -1 && hint > 0) {
+        block = claimFree(0);
+    }
+    if (block == -1) {
+        return { -1, 0 };
+    }
+    return { block, 1 + claimRun(block + 1, limit - 1) };
+}
+
+int BlockBitmap::largestFreeRun() {
+    int longest = 0;
+    for (size_t group = 0; group < groupCount_; ++group) {
+        std::lock_guard<std::mutex> lock(groups_[group].mutex);
+        if (!groups_[group].built) {
+            build(group);
+        }
+        longest = std::max(longest, groups_[group].extents.largest().second);
+    }
+    return longest;
+}
+
+// CRC32（多项式 0xEDB88320）查找表，按 8 字节一组查表（slicing-by-8）：
+// table[k][i] 是字节 i 之后再跟 k 个 0 字节的 CRC
+static std::array<std::array<uint32_t, 256>, 8> makeCrcTables() {
+    std::array<std::array<uint32_t, 256>, 8> tables;
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; ++k) {
+            c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        }
+        tables[0][i] = c;
+    }
+    for (uint32_t i = 0; i < 256; ++i) {
+        for (int k = 1; k < 8; ++k) {
+            tables[k][i] = tables[0][tables[k - 1][i] & 0xFF] ^ (tables[k - 1][i] >> 8);
+        }
+    }
+    return tables;
+}
+
+static uint32_t crc32Update(uint32_t crc, const void* data, size_t length) {
+    static const std::array<std::array<uint32_t, 256>, 8> t = makeCrcTables();
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    // 小端序：8 字节中低 4 字节与当前 CRC 异或
+    while (length >= 8) {
+        uint32_t low;
+        uint32_t high;
+        std::memcpy(&low, bytes, 4);
+        std::memcpy(&high, bytes + 4, 4);
+        low ^= crc;
+        crc = t[7][low & 0xFF] ^ t[6][(low >> 8) & 0xFF] ^ t[5][(low >> 16) & 0xFF] ^ t[4][low >> 24]
+            ^ t[3][high & 0xFF] ^ t[2][(high >> 8) & 0xFF] ^ t[1][(high >> 16) & 0xFF] ^ t[0][high >> 24];
+        bytes += 8;
+        length -= 8;
+    }
+    for (size_t i = 0; i < length; ++i) {
+        crc = t[0][(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+uint32_t crc32(const void* data, size_t length) {
+    return ~crc32Update(0xFFFFFFFFu, data, length);
+}
+
+uint32_t inodeChecksum(const DiskInode& inode) {
+    // checksum 字段前后两段分别累加，跳过字段本身
+    const size_t head = offsetof(DiskInode, checksum);
+    const size_t tail = head + sizeof(inode.checksum);
+    const char* bytes = reinterpret_cast<const char*>(&inode);
+    uint32_t crc = crc32Update(0xFFFFFFFFu, bytes, head);
+    crc = crc32Update(crc, bytes + tail, sizeof(DiskInode) - tail);
+    return ~crc;
+}
+
+void InodeTable::attach(DiskInode* records, int count) {
+    records_ = records;
+    count_ = count;
+    const Superblock& sb = metadata.superblock();
+    freeHead_ = sb.freeInodeHead;
+    freeCount_ = sb.freeInodeCount;
+}
+
+void InodeTable::seal(int ino) {
+    if (records_[ino].linkCount > 0) {
+        records_[ino].checksum = inodeChecksum(records_[ino]);
+    }
+    metadata.markDirty(&records_[ino], sizeof(DiskInode));
+}
+
+void InodeTable::put(int ino, const DiskInode& inode) {
+    std::lock_guard<std::mutex> lock(lockOf(ino));
+    records_[ino] = inode;
+    seal(ino);
+}
+
+void InodeTable::format() {
+    for (int ino = 0; ino < count_; ++ino) {
+        records_[ino] = DiskInode{};
+        records_[ino].firstBlock = ino + 1 < count_ ? ino + 1 : -1;
+    }
+    metadata.markDirty(records_, static_cast<size_t>(count_) * sizeof(DiskInode));
+    std::lock_guard<std::mutex> lock(freeMutex_);
+    freeHead_ = count_ > 0 ? 0 : -1;
+    freeCount_ = count_;
+    Superblock& sb = metadata.superblock();
+    sb.freeInodeHead = freeHead_;
+    sb.freeInodeCount = freeCount_;
+    metadata.markSuperblockDirty();
+}
+
+int InodeTable::allocate() {
+    std::lock_guard<std::mutex> freeLock(freeMutex_);
+    int ino = freeHead_;
+    if (ino < 0 || ino >= count_) {
+        return -1;
+    }
+    std::lock_guard<std::mutex> lock(lockOf(ino));
+    freeHead_ = records_[ino].firstBlock;
+    freeCount_--;
+    DiskInode inode = {};
+    inode.version = INODE_VERSION;
+    inode.mode = MODE_FILE | DEFAULT_FILE_PERMISSIONS;
+    inode.linkCount = 1;
+    inode.firstBlock = -1;
+    inode.parent = -1;
+    inode.generation = records_[ino].generation + 1;
+    records_[ino] = inode;
+    seal(ino);
+    return ino;
+}
+
+void InodeTable::pushFree(int ino) {
+    std::lock_guard<std::mutex> lock(lockOf(ino));
+    if (records_[ino].linkCount == 0) {
+        return;
+    }
+    DiskInode inode = {};
+    inode.firstBlock = freeHead_;
+    inode.generation = records_[ino].generation;
+    records_[ino] = inode;
+    metadata.markDirty(&records_[ino], sizeof(DiskInode));
+    freeHead_ = ino;
+    freeCount_++;
+}
+
+void InodeTable::release(int ino) {
+    std::lock_guard<std::mutex> lock(freeMutex_);
+    pushFree(ino);
+}
+
+void InodeTable::release(const std::vector<int>& inodes) {
+    std::lock_guard<std::mutex> lock(freeMutex_);
+    for (int ino : inodes) {
+        pushFree(ino);
+    }
+}
+
+void InodeTable::storeFreeList() {
+    std::lock_guard<std::mutex> lock(freeMutex_);
+    Superblock& sb = metadata.superblock();
+    if (sb.freeInodeHead != freeHead_ || sb.freeInodeCount != freeCount_) {
+        sb.freeInodeHead = freeHead_;
+        sb.freeInodeCount = freeCount_;
+        metadata.markSuperblockDirty();
+    }
+}
@@ -0,0 +1,356 @@
+﻿#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <type_traits>
+#include <utility>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include "FreeExtentIndex.h"
+
+// 内存映射文件，按写时复制方式映射（POSIX 下为 MAP_PRIVATE，Windows 下为 FILE_MAP_COPY）：
+// 对映射区的修改不会被系统自行写回文件，只在 writeBack 时写入，配合预写日志保证先写日志后写原位
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // 映射文件，create 为 true 时创建并扩展到 size 字节
+    bool open(const std::string& path, size_t size, bool create);
+    void close();
+    bool isOpen() const { return data_ != nullptr; }
+
+    char* data() const { return data_; }
+    size_t size() const { return size_; }
+    // 把映射区 [offset, offset + length) 的内容写入文件
+    bool writeBack(size_t offset, size_t length);
+    // 把已写入的内容刷到磁盘
+    bool syncFile();
+    // 系统页大小
+    static size_t pageSize();
+
+private:
+    char* data_ = nullptr;
+    size_t size_ = 0;
+#ifdef _WIN32
+    void* file_ = nullptr;
+    void* mapping_ = nullptr;
+#else
+    int fd_ = -1;
+#endif
+};
+
+// 超级块中最多记录的摘下等待释放的子树根个数，已满时删除大目录改为同步释放
+const int MAX_DETACHED_ROOTS = 64;
+
+// 超级块：记录卷的几何参数，格式化时确定，位于元数据文件开头
+struct Superblock {
+    uint32_t magic;            // 魔数，用于识别元数据文件
+    uint32_t version;          // 格式版本
+    int32_t blockSize;         // 块大小（字节）
+    int32_t blockCount;        // 物理块数量
+    int32_t inodeCount;        // inode 表容量
+    int32_t freeBlockCount;    // 空闲块数量
+    int32_t freeInodeCount;    // 空闲 inode 数量
+    int32_t freeInodeHead;     // 空闲 inode 链表头，-1 表示没有空闲 inode
+    int32_t detachedCount;     // 摘下等待后台释放的子树根个数
+    int32_t detachedRoots[MAX_DETACHED_ROOTS]; // 这些子树根的 inode 号，挂载时只需恢复它们
+};
+
+// 磁盘上的索引节点记录：定长、字段自然对齐无填充的平凡类型，
+// 直接存放在映射区中按 inode 号下标访问，整张表可以整体 memcpy
+struct DiskInode {
+    uint16_t version;          // 记录格式版本，0 表示从未写入
+    uint16_t mode;             // 类型位 | 权限位（与 POSIX st_mode 相同）
+    uint32_t linkCount;        // 链接数，0 表示空闲
+    int32_t firstBlock;        // 第一个物理块号（空闲时为下一个空闲 inode 号）
+    int32_t parent;            // 所在目录的 inode 号
+    int64_t size;              // 文件大小（目录为目录项区的字节数）
+    int64_t createTime;        // 创建时间（纳秒时间戳）
+    int64_t modifyTime;        // 修改时间（纳秒时间戳）
+    int64_t subtreeSize;       // 子树中所有文件的总大小（文件为自身大小）
+    int32_t subtreeFiles;      // 子树中的文件数（文件为 1）
+    int32_t subtreeInodes;     // 子树中的 inode 数，目录和文件都算，包括自身
+    uint32_t checksum;         // 除本字段外全部字节的 CRC32，只对已分配的记录有效
+    uint32_t generation;       // 分配代数：inode 号每分配一次加一，释放后保留，用来识别指向已删除文件的旧句柄
+};
+static_assert(std::is_trivially_copyable<DiskInode>::value && std::is_standard_layout<DiskInode>::value,
+    "DiskInode must be a POD record");
+static_assert(sizeof(DiskInode) == 64, "DiskInode layout must not contain padding");
+
+// inode 记录格式版本
+const uint16_t INODE_VERSION = 3;
+// mode 中的类型位
+const uint16_t MODE_TYPE_MASK = 0xF000;
+const uint16_t MODE_DIRECTORY = 0x4000;
+const uint16_t MODE_FILE = 0x8000;
+// 新建文件和目录的默认权限位
+const uint16_t DEFAULT_FILE_PERMISSIONS = 0644;
+const uint16_t DEFAULT_DIR_PERMISSIONS = 0755;
+
+// 计算 inode 记录的校验和（不含 checksum 字段）
+uint32_t inodeChecksum(const DiskInode& inode);
+
+// CRC32（多项式 0xEDB88320）
+uint32_t crc32(const void* data, size_t length);
+
+// 根目录的 inode 号
+const int ROOT_INODE = 0;
+// 已从目录树摘下、等待后台释放的子树根的 parent
+const int DETACHED_PARENT = -2;
+
+// 目录项：定长记录，顺序存放在目录 inode 的数据块中
+const int DIR_NAME_MAX = 59;
+struct DirEntry {
+    int32_t ino;                   // inode 号，-1 表示空槽
+    char name[DIR_NAME_MAX + 1];   // 名称，以 '\0' 结尾
+};
+
+// 元数据区：超级块 | FAT | 位图 | inode 表，整体映射到内存，
+// 每次修改只标记所在的页，sync() 时只把脏页写回。
+// 同时记录每次修改的字节范围，供预写日志把修改打包成事务。并发的操作各自修改不同的字节
+// （由各结构自己的锁保证），修改范围记在各线程自己的列表中，标记脏页只是一次原子操作，互不等待
+class MetadataRegion {
+public:
+    static const uint32_t MAGIC = 0x4F534653; // "OSFS"
+    static const uint32_t VERSION = 6;
+
+    // 格式化时允许的最小块大小；块大小还必须是 2 的幂，目录项不会跨块
+    static const int MIN_BLOCK_SIZE = 512;
+
+    // 检查格式化用的几何参数，不合法时输出原因并返回 false
+    static bool checkGeometry(int blockSize, int blockCount, int inodeCount);
+    // 创建新的元数据文件（格式化），按给定几何参数初始化超级块，参数不合法时不改动已有文件
+    bool create(const std::string& path, int blockSize, int blockCount, int inodeCount);
+    // 打开已有的元数据文件，几何参数从超级块读取，只建立映射，不读取其余内容
+    bool open(const std::string& path);
+    void close();
+    bool isOpen() const { return file_.isOpen(); }
+
+    Superblock& superblock() const { return *reinterpret_cast<Superblock*>(file_.data()); }
+    // 修改超级块字段后调用
+    void markSuperblockDirty() { markDirty(file_.data(), sizeof(Superblock)); }
+
+    char* fatArea() const { return file_.data() + fatOffset_; }
+    char* bitmapArea() const { return file_.data() + bitmapOffset_; }
+    char* inodeArea() const { return file_.data() + inodeOffset_; }
+    int blockSize() const { return blockSize_; }
+    int blockCount() const { return blockCount_; }
+    int inodeCount() const { return inodeCount_; }
+
+    // 标记 [p, p + length) 所在的页为脏页，当前线程在记录修改时还记录这次修改的范围
+    void markDirty(const void* p, size_t length);
+    // 把所有脏页写回磁盘。期间不能有其他线程修改元数据
+    bool sync();
+
+    // 当前线程开始/停止记录修改范围，由日志在线程加入和离开事务时调用
+    void recordChanges(bool enabled);
+    // 取出当前线程上次取出以来记录的修改范围（文件偏移, 长度），追加到 changes 末尾
+    void takeChanges(std::vector<std::pair<size_t, size_t>>& changes);
+    const char* bytes(size_t offset) const { return file_.data() + offset; }
+    // 日志重放：把 data 写到文件偏移 offset 处
+    bool apply(size_t offset, const char* data, size_t length);
+    size_t totalSize() const { return totalSize_; }
+
+private:
+    void computeLayout(int blockSize, int blockCount, int inodeCount);
+
+    MappedFile file_;
+    int blockSize_ = 0;
+    int blockCount_ = 0;
+    int inodeCount_ = 0;
+    size_t fatOffset_ = 0;
+    size_t bitmapOffset_ = 0;
+    size_t inodeOffset_ = 0;
+    size_t totalSize_ = 0;
+    size_t pageSize_ = 4096;
+    std::unique_ptr<std::atomic<uint8_t>[]> pageDirty_; // 每页一个脏标记
+    std::vector<size_t> dirtyPages_;   // 脏页号列表，sync 时不用扫描全部页
+    std::mutex dirtyMutex_;            // 保护 dirtyPages_，只在页第一次变脏时加锁
+};
+
+// 全局的元数据区
+extern MetadataRegion metadata;
+
+// FAT 表：映射区中的 int32 数组，写入时自动标记脏页
+class FatTable {
+public:
+    class Entry {
+    public:
+        Entry(FatTable& table, int index) : table_(table), index_(index) {}
+        operator int() const { return table_.get(index_); }
+        Entry& operator=(int value) { table_.set(index_, value); return *this; }
+        Entry& operator=(const Entry& other) { return *this = static_cast<int>(other); }
+    private:
+        FatTable& table_;
+        int index_;
+    };
+
+    void attach(int32_t* entries, int count) { entries_ = entries; count_ = count; }
+    size_t size() const { return static_cast<size_t>(count_); }
+    int get(int index) const { return entries_[index]; }
+    void set(int index, int value);
+    // 所有表项置为 value
+    void assign(int value);
+    // 把连续的 count 个块 start, start+1, ... 链接起来，最后一块指向 next
+    void linkRun(int start, int count, int next);
+    // 把连续的 count 个表项置为 value
+    void fillRun(int start, int count, int value);
+    Entry operator[](int index) { return Entry(*this, index); }
+    int operator[](int index) const { return entries_[index]; }
+
+private:
+    int32_t* entries_ = nullptr;
+    int count_ = 0;
+};
+
+// 空闲块位图：映射区中的 64 位字数组，写入时自动标记脏页。
+// 位图按 GROUP_BLOCKS 块分组，每组一把锁，并发的分配和释放只有落在同一组时才互相等待。
+// 每组在内存中另有摘要（每一位对应组内一个已满的位图字）、空闲块数和空闲区索引
+// （只收录组内不短于 MIN_INDEXED_RUN 的空闲区，跨组的空闲区在组边界处断开，用于最佳适配分配大段连续块）；
+// 全局另有一级摘要，每一位对应一个已满的组，查找空闲块时跳过已满的组和字。
+// 分配都是查找和置位在同一次加锁内完成（claim*），两个线程不会拿到同一块。
+// 空闲块数在内存中原子计数，封装日志事务时（没有操作在进行）由 storeFreeCount 写入超级块，
+// 每次分配不必都改超级块。
+// 挂载代价：attach 只为每组建一个描述符（O(块数 / GROUP_BLOCKS)），空闲块数直接采用超级块中的值
+// （它与位图在同一事务中修改，由日志保证一致，一致性检查会核对）。
+// 组的摘要和空闲区索引在第一次在组内分配时才扫描该组建立，需 GROUP_BLOCKS / 64 次字操作
+class BlockBitmap {
+public:
+    // 收录进空闲区索引的最短空闲区（一个位图字）
+    static const int MIN_INDEXED_RUN = 64;
+    // 每组的块数（128 个位图字），连续分配一次最多得到一组
+    static const int GROUP_BLOCKS = 8192;
+
+    // 挂接到映射区，各组的摘要和空闲区索引留到第一次使用时建立
+    void attach(uint64_t* words, int bitCount);
+    size_t size() const { return static_cast<size_t>(bitCount_); }
+    bool test(int bit) const;
+    void set(int bit);
+    void reset(int bit);
+    // 清空全部位
+    void reset();
+    // 空闲块数量
+    int freeCount() const { return free_.load(std::memory_order_relaxed); }
+    // 一致性检查按位图改正空闲块数
+    void setFreeCount(int count) { free_.store(count, std::memory_order_relaxed); }
+    // 把空闲块数写入超级块，只在没有操作进行时调用（日志封装事务前）
+    void storeFreeCount();
+    // 将 [start, start + count) 全部置位，按字批量处理
+    void setRange(int start, int count);
+    // 将 [start, start + count) 全部清零，按字批量处理，整段加入空闲区索引
+    void resetRange(int start, int count);
+
+    // 从 from 开始查找第一个空闲块并置位，返回块号，from 之后没有空闲块时返回 -1
+    int claimFree(int from);
+    // 从 start 开始连续的空闲块全部置位，最多 limit 个，返回置位的个数（start 已占用时为 0）
+    int claimRun(int start, int limit);
+    // 从 hint 所在的组开始，在第一个有足够长空闲区的组中最佳适配 count 个连续块并置位，
+    // 返回首块号；count 超过一组或没有足够长的空闲区时返回 -1
+    int claimBestFit(int count, int hint);
+    // 从 hint 所在的组开始，取第一个有收录空闲区的组中最长的一段置位，最多 limit 块；
+    // 各组都只剩短碎片时取 hint 之后（没有则从头）第一个空闲块开始的一段。
+    // 返回 (首块号, 块数)，没有空闲块时为 {-1, 0}
+    std::pair<int, int> claimLargest(int limit, int hint);
+    // 各组中最长的已收录空闲区的块数，只剩短碎片时为 0
+    int largestFreeRun();
+
+private:
+    static const int GROUP_WORDS = GROUP_BLOCKS / 64;
+
+    // 一组的内存描述符，除 longestRun 外都由 mutex 保护
+    struct Group {
+        std::mutex mutex;
+        bool built = false;                    // 摘要、空闲块数和索引是否已建立
+        int freeBlocks = 0;                    // 组内空闲块数
+        uint64_t full[GROUP_WORDS / 64] = {};  // 摘要：每一位对应组内一个已满的位图字
+        FreeExtentIndex extents;               // 组内的空闲区索引
+        std::atomic<int> longestRun{ GROUP_BLOCKS }; // 组内最长的已收录空闲区，未建立时取上限；不加锁读取时只作提示
+    };
+
+    // 位图字，末尾超出 bitCount_ 的位视为已占用
+    uint64_t word(size_t index) const { return words_[index] | padding(index); }
+    uint64_t padding(size_t index) const;
+    size_t groupOf(int bit) const { return static_cast<size_t>(bit) / GROUP_BLOCKS; }
+    int groupStart(size_t group) const { return static_cast<int>(group * GROUP_BLOCKS); }
+    int groupEnd(size_t group) const { return std::min(bitCount_, static_cast<int>((group + 1) * GROUP_BLOCKS)); }
+    // 以下 *Locked 函数要求持有组锁，组内范围不跨组
+    void build(size_t group);
+    int findFreeLocked(size_t group, int from) const;
+    // 从 start 开始连续空闲块的个数，不超过 end，最多统计 limit 个
+    int freeRunLength(int start, int end, int limit) const;
+    // end 之前连续空闲块的个数，不早于 begin，最多统计 limit 个
+    int freeRunLengthBefore(int begin, int end, int limit) const;
+    // 组内 [start, start + count) 置位/清零，返回改变的位数
+    int setLocked(size_t group, int start, int count);
+    int resetLocked(size_t group, int start, int count);
+    // [start, end) 刚被清零：把包含它的组内整段空闲区放入索引
+    void indexFreed(size_t group, int start, int end);
+    // 组变满或不再满时更新全局摘要和最长空闲区提示
+    void updateGroupState(size_t group);
+    // group 及之后第一个未满的组，没有则返回组数
+    size_t nextOpenGroup(size_t group) const;
+
+    uint64_t* words_ = nullptr;
+    int bitCount_ = 0;
+    size_t wordCount_ = 0;
+    size_t groupCount_ = 0;
+    std::unique_ptr<Group[]> groups_;
+    std::unique_ptr<std::atomic<uint64_t>[]> fullGroups_;  // 全局摘要：每一位对应一个已满的组
+    std::atomic<int> free_{ 0 };                            // 空闲块数
+};
+
+// inode 表：映射区中的定长 DiskInode 数组，空闲 inode 通过 firstBlock 串成链表，
+// 分配和释放都是 O(1)。put 写入已分配的记录时填写校验和。
+// 释放的记录保留分配代数，下次分配时加一。
+// 每条记录的读写按 inode 号分到固定个数的锁上，读到的总是完整的一条；
+// 空闲链表的表头和空闲数在内存中由自己的锁保护，封装日志事务时由 storeFreeList 写入超级块
+class InodeTable {
+public:
+    void attach(DiskInode* records, int count);
+    int size() const { return count_; }
+    // 读取一条记录（副本）
+    DiskInode get(int ino) const {
+        std::lock_guard<std::mutex> lock(lockOf(ino));
+        return records_[ino];
+    }
+    void put(int ino, const DiskInode& inode);
+    // 在持有记录锁时就地修改一条记录，之后重新计算校验和（已分配的记录）并标记脏页。
+    // 用于只改部分字段，与同时修改这条记录其他字段的线程互不覆盖
+    template <typename Change>
+    void update(int ino, Change&& change) {
+        std::lock_guard<std::mutex> lock(lockOf(ino));
+        change(records_[ino]);
+        seal(ino);
+    }
+    // 格式化时把所有 inode 串成空闲链表
+    void format();
+    // 分配一个空闲 inode 号，失败返回 -1
+    int allocate();
+    // 释放 inode 号
+    void release(int ino);
+    // 批量释放：一次加锁串进空闲链表
+    void release(const std::vector<int>& inodes);
+    // 把空闲链表的表头和空闲数写入超级块，只在没有操作进行时调用（日志封装事务前）
+    void storeFreeList();
+
+private:
+    static const int LOCK_SLOTS = 64;
+    std::mutex& lockOf(int ino) const { return locks_[static_cast<unsigned>(ino) % LOCK_SLOTS]; }
+    // 持有记录锁时调用：填写校验和并标记脏页
+    void seal(int ino);
+    // 持有 freeMutex_ 时把一条记录放回空闲链表
+    void pushFree(int ino);
+
+    DiskInode* records_ = nullptr;
+    int count_ = 0;
+    mutable std::mutex locks_[LOCK_SLOTS];
+    std::mutex freeMutex_;
+    int freeHead_ = -1;     // 空闲链表表头
+    int freeCount_ = 0;     // 空闲 inode 数
+};
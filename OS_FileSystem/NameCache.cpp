@@ -0,0 +1,62 @@
+﻿#include "NameCache.h"
+#include <functional>
+#include <mutex>
+#include <shared_mutex>
+
+// 定义全局的路径查找缓存
+NameCache nameCache;
+
+bool NameCache::within(std::string_view path, std::string_view root) {
+    return path.size() >= root.size() && path.compare(0, root.size(), root) == 0
+        && (path.size() == root.size() || root == "/" || path[root.size()] == '/');
+}
+
+const NameCache::Entry* NameCache::lookup(const Entries& entries, size_t hash, std::string_view path) {
+    const Entry* entry = entries.find(hash);
+    return entry && entry->path == path ? entry : nullptr;
+}
+
+bool NameCache::find(std::string_view path, int& ino) const {
+    size_t hash = std::hash<std::string_view>()(path);
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    const Entry* entry = lookup(positive_, hash, path);
+    if (!entry) {
+        entry = lookup(negative_, hash, path);
+    }
+    if (!entry) {
+        return false;
+    }
+    ino = entry->ino;
+    return true;
+}
+
+void NameCache::insert(std::string_view path, int ino) {
+    size_t hash = std::hash<std::string_view>()(path);
+    std::lock_guard<std::shared_mutex> lock(mutex_);
+    // 同一路径只留一项：正负项互相替换
+    (ino == -1 ? positive_ : negative_).erase(hash);
+    (ino == -1 ? negative_ : positive_).insert(hash, Entry{ std::string(path), ino });
+}
+
+void NameCache::invalidate(std::string_view path) {
+    size_t hash = std::hash<std::string_view>()(path);
+    std::lock_guard<std::shared_mutex> lock(mutex_);
+    for (Entries* entries : { &positive_, &negative_ }) {
+        if (lookup(*entries, hash, path)) {
+            entries->erase(hash);
+        }
+    }
+}
+
+void NameCache::invalidateTree(std::string_view path) {
+    std::lock_guard<std::shared_mutex> lock(mutex_);
+    auto inside = [path](size_t, const Entry& entry) { return within(entry.path, path); };
+    positive_.eraseIf(inside);
+    negative_.eraseIf(inside);
+}
+
+void NameCache::clear() {
+    std::lock_guard<std::shared_mutex> lock(mutex_);
+    positive_.clear();
+    negative_.clear();
+}
@@ -0,0 +1,45 @@
+﻿#pragma once
+#include "ClockCache.h"
+#include <string>
+#include <string_view>
+#include <cstddef>
+#include <shared_mutex>
+
+// 路径查找缓存（namei 缓存）：规范化的全路径哈希到 inode 号，不存在的路径也缓存为负项，
+// 深路径的重复查找只需一次哈希探测，不再逐级查目录。
+// 创建时写入正项，删除、重命名时按路径精确失效：文件只影响自身，目录影响整棵子树。
+// 正项和负项分开限量，满时各自按 CLOCK 每次淘汰一项，一连串查找失败只会挤掉旧的负项。
+// 只读操作并发时也会写入，内部用读写锁保护
+class NameCache {
+public:
+    // 查找路径，命中时返回 true，ino 为 inode 号（负项为 -1）
+    bool find(std::string_view path, int& ino) const;
+    // 记录查找结果，ino 为 -1 表示路径不存在
+    void insert(std::string_view path, int ino);
+    // 只让路径本身的缓存项失效
+    void invalidate(std::string_view path);
+    // 让路径本身及其下所有路径的缓存项失效
+    void invalidateTree(std::string_view path);
+    void clear();
+
+private:
+    struct Entry {
+        std::string path;      // 全路径，哈希冲突时用于确认
+        int ino;               // inode 号，-1 为负项
+    };
+    using Entries = ClockCache<size_t, Entry>;
+    static const size_t MAX_ENTRIES = 65536;
+    static const size_t MAX_NEGATIVE_ENTRIES = 8192;
+    // path 是否等于 root 或位于 root 之下
+    static bool within(std::string_view path, std::string_view root);
+    // 在 entries 中查找路径
+    static const Entry* lookup(const Entries& entries, size_t hash, std::string_view path);
+
+    mutable std::shared_mutex mutex_;
+    // 路径哈希 -> 缓存项，冲突时后来者覆盖
+    Entries positive_{ MAX_ENTRIES };
+    Entries negative_{ MAX_NEGATIVE_ENTRIES };
+};
+
+// 全局的路径查找缓存
+extern NameCache nameCache;
@@ -3,6 +3,7 @@
 #include <QDir>
 #include <QRegularExpression>
 #include <FileMainWindow.h>
+#include <FileSystem.h>
 
 OS_FileSystem::OS_FileSystem(QWidget* parent)
     : QMainWindow(parent)
@@ -23,12 +24,6 @@ void OS_FileSystem::Init()
     this->resize(600, 400);
     // 初始化界面
     InitWidget();
-
-    // 创建 inode 文件夹
-    QDir inodeDir(QString::fromStdString(config.realRootPath + "/inode"));
-    if (!inodeDir.exists()) {
-        inodeDir.mkpath(".");
-    }
 }
 
 void OS_FileSystem::InitWidget()
@@ -88,6 +83,13 @@ void OS_FileSystem::InitWidget()
         // 规范化路径（解析相对路径、去除尾部斜杠等）
         config.rootPath = virtualPath.toStdString();
         config.realRootPath = dir.absolutePath().toStdString();
+        setCurrentPath(config.rootPath);
+
+        // 挂载实际根路径下的卷（meta.bin 和 disk.img），不存在时格式化
+        if (!mountFileSystem()) {
+            QMessageBox::warning(this, "错误", "无法挂载文件系统，请检查实际根路径。");
+            return;
+        }
 
         QMessageBox::information(this, "成功", QString("配置已更新：\n虚拟根路径：%1\n实际根路径：%2")
             .arg(virtualPath)
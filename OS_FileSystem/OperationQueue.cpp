@@ -0,0 +1,99 @@
+﻿#include "OperationQueue.h"
+
+OperationQueue::OperationQueue(QObject* parent)
+    : QObject(parent) {
+    // 文件系统核心的修改需要串行执行，所以只用一个工作线程
+    worker_ = std::thread(&OperationQueue::run, this);
+}
+
+OperationQueue::~OperationQueue() {
+    shutdown();
+}
+
+std::shared_ptr<OperationProgress> OperationQueue::submit(const QString& name, Task task, Callback done) {
+    auto progress = std::make_shared<OperationProgress>();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stopping_) {
+            progress->cancelled = true;
+            return progress;
+        }
+        queue_.push_back({ name, std::move(task), std::move(done), progress });
+    }
+    ready_.notify_one();
+    return progress;
+}
+
+void OperationQueue::cancelAll() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (Operation& op : queue_) {
+        op.progress->cancelled = true;
+    }
+    if (currentProgress_) {
+        currentProgress_->cancelled = true;
+    }
+}
+
+std::shared_ptr<OperationProgress> OperationQueue::current(QString* name) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (name) {
+        *name = currentName_;
+    }
+    return currentProgress_;
+}
+
+int OperationQueue::pendingCount() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return static_cast<int>(queue_.size());
+}
+
+void OperationQueue::shutdown() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stopping_) {
+            return;
+        }
+        stopping_ = true;
+    }
+    ready_.notify_one();
+    if (worker_.joinable()) {
+        worker_.join();
+    }
+}
+
+void OperationQueue::run() {
+    while (true) {
+        Operation op;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            ready_.wait(lock, [this]() { return stopping_ || !queue_.empty(); });
+            if (queue_.empty()) {
+                return; // 已停止且队列已清空
+            }
+            op = std::move(queue_.front());
+            queue_.pop_front();
+            currentName_ = op.name;
+            currentProgress_ = op.progress;
+        }
+
+        // 排队期间被取消的操作不再执行
+        bool ok = false;
+        if (!op.progress->cancelled) {
+            emit operationStarted(op.name);
+            ok = op.task(*op.progress);
+        }
+        bool cancelled = op.progress->cancelled;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            currentName_.clear();
+            currentProgress_.reset();
+        }
+        emit operationFinished(op.name, ok, cancelled);
+        // 回调投递到本对象所在的线程（界面线程）执行
+        if (op.done) {
+            Callback done = std::move(op.done);
+            QMetaObject::invokeMethod(this, [done, ok, cancelled]() { done(ok, cancelled); }, Qt::QueuedConnection);
+        }
+    }
+}
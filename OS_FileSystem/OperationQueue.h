@@ -0,0 +1,56 @@
+﻿#pragma once
+#include <QObject>
+#include <QString>
+#include <functional>
+#include <memory>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "FileSystem.h"
+
+// 文件系统操作队列：操作按提交顺序在后台工作线程中执行，界面线程不会被阻塞。
+// 每个操作带一个进度/取消句柄，结束后在界面线程中回调
+class OperationQueue : public QObject {
+    Q_OBJECT
+public:
+    // 在工作线程中执行的操作，返回是否成功
+    using Task = std::function<bool(OperationProgress& progress)>;
+    // 操作结束后在界面线程中调用，cancelled 表示操作被取消
+    using Callback = std::function<void(bool ok, bool cancelled)>;
+
+    explicit OperationQueue(QObject* parent = nullptr);
+    ~OperationQueue();
+
+    // 把操作加入队列，返回它的进度/取消句柄
+    std::shared_ptr<OperationProgress> submit(const QString& name, Task task, Callback done = Callback());
+    // 取消正在执行和排队中的全部操作
+    void cancelAll();
+    // 正在执行的操作的进度句柄，空闲时返回空指针
+    std::shared_ptr<OperationProgress> current(QString* name = nullptr) const;
+    // 排队中（未开始）的操作数
+    int pendingCount() const;
+    // 不再接受新操作，等已提交的操作全部执行完后停止工作线程（要中止长操作先调用 cancelAll）
+    void shutdown();
+
+signals:
+    void operationStarted(const QString& name);
+    void operationFinished(const QString& name, bool ok, bool cancelled);
+
+private:
+    struct Operation {
+        QString name;
+        Task task;
+        Callback done;
+        std::shared_ptr<OperationProgress> progress;
+    };
+    void run();
+
+    std::thread worker_;
+    mutable std::mutex mutex_;
+    std::condition_variable ready_;
+    std::deque<Operation> queue_;
+    QString currentName_;
+    std::shared_ptr<OperationProgress> currentProgress_;
+    bool stopping_ = false;
+};
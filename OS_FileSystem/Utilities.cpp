@@ -1,111 +1,234 @@
 ﻿#include "Utilities.h"
-#include <sstream>
+#include "VirtualPath.h"
+#include "BlockCache.h"
+#include "Journal.h"
 #include <vector>
-#include <fstream>
-#include <QDir>
 #include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <shared_mutex>
 
 // 定义并初始化全局的 config 变量
 Config config;
 
-std::string getFullPath(const std::string& relativePath) {
-    std::string actualPath;
-    if (relativePath.empty()) {
-        actualPath = config.realRootPath + "/" + config.currentPath.substr(config.rootPath.length());
+// 保护 config.currentPath：解析相对路径的线程只读，可以同时进行
+static std::shared_mutex currentPathMutex;
+
+VirtualPath fullPathOf(std::string_view path) {
+    if (!path.empty() && path[0] == '/') {
+        return VirtualPath(path, "/");
     }
-    else if (relativePath[0] == '/') {
-        actualPath = config.realRootPath + relativePath;
+    std::shared_lock<std::shared_mutex> lock(currentPathMutex);
+    return VirtualPath(path, config.currentPath);
+}
+
+std::string getFullPath(std::string_view relativePath) {
+    return fullPathOf(relativePath).toString();
+}
+
+std::string getCurrentPath() {
+    std::shared_lock<std::shared_mutex> lock(currentPathMutex);
+    return config.currentPath;
+}
+
+void setCurrentPath(const std::string& path) {
+    std::lock_guard<std::shared_mutex> lock(currentPathMutex);
+    config.currentPath = path;
+}
+
+std::string simplifyPath(std::string_view path) {
+    return VirtualPath(path, "/").toString();
+}
+
+// 没有指定位置时下一次分配的起点（next-fit），避免每次都从 0 号块开始扫描已分配区域
+static std::atomic<int> allocCursor{ 0 };
+
+// 分配一个空闲块（已在位图中置位）
+int allocateBlock(int hint) {
+    if (bitmap.freeCount() == 0) {
+        return -1;
     }
-    else {
-        std::string currentActualPath = config.realRootPath + config.currentPath.substr(config.rootPath.length());
-        if (!currentActualPath.empty() && currentActualPath.back() != '/') {
-            currentActualPath += '/';
-        }
-        actualPath = currentActualPath + relativePath;
+    int from = hint >= 0 && hint < getBlockCount() ? hint : allocCursor.load(std::memory_order_relaxed);
+    int block = bitmap.claimFree(from);
+    if (block == -1) {
+        block = bitmap.claimFree(0); // 到达末尾后回绕
     }
-    // 确保路径不以 '/' 结尾
-    if (!actualPath.empty() && actualPath.back() == '/') {
-        actualPath.pop_back();
+    if (block != -1 && hint < 0) {
+        allocCursor.store(block + 1, std::memory_order_relaxed);
     }
-    return actualPath;
+    return block;
 }
 
-std::string simplifyPath(const std::string& path) {
-    std::vector<std::string> stack;
-    std::istringstream iss(path);
-    std::string part;
+std::vector<int> allocateBlocks(int count, int hint) {
+    std::vector<int> blocks;
+    if (count <= 0 || bitmap.freeCount() < count) {
+        return blocks;
+    }
+    // 每一段连续区：起始块号、长度
+    std::vector<std::pair<int, int>> runs;
+    int remaining = count;
 
-    while (std::getline(iss, part, '/')) {
-        if (part == "..") {
-            if (!stack.empty()) {
-                stack.pop_back();
+    // 1. 紧接在文件最后一块之后（可能是没有收录进索引的短空闲区，直接查位图）
+    if (hint >= 0 && hint < getBlockCount()) {
+        int length = bitmap.claimRun(hint, remaining);
+        if (length > 0) {
+            runs.emplace_back(hint, length);
+            remaining -= length;
+        }
+    }
+    // 2. 最佳适配：能容纳剩余块数的最小空闲区
+    if (remaining > 0) {
+        int start = bitmap.claimBestFit(remaining, hint);
+        if (start != -1) {
+            runs.emplace_back(start, remaining);
+            remaining = 0;
+        }
+    }
+    // 3. 没有足够长的连续区，逐组取最长的空闲区拼接，索引用完后再拼接短碎片
+    while (remaining > 0) {
+        std::pair<int, int> extent = bitmap.claimLargest(remaining, hint);
+        if (extent.second == 0) {
+            // 其他线程同时分配，空闲块已不够：撤销已分配的部分
+            for (const auto& run : runs) {
+                bitmap.resetRange(run.first, run.second);
             }
+            return blocks;
         }
-        else if (!part.empty() && part != ".") {
-            stack.push_back(part);
+        runs.push_back(extent);
+        remaining -= extent.second;
+    }
+
+    // 每段连续区一次性写入 FAT
+    blocks.reserve(count);
+    for (size_t i = 0; i < runs.size(); ++i) {
+        int next = i + 1 < runs.size() ? runs[i + 1].first : -1;
+        fat.linkRun(runs[i].first, runs[i].second, next);
+        for (int j = 0; j < runs[i].second; ++j) {
+            blocks.push_back(runs[i].first + j);
         }
     }
+    if (hint < 0) {
+        allocCursor.store(runs.back().first + runs.back().second, std::memory_order_relaxed);
+    }
+    return blocks;
+}
 
-    std::string simplifiedPath;
-    for (const auto& p : stack) {
-        simplifiedPath += "/" + p;
+int allocateExtent(int count) {
+    if (count <= 0 || bitmap.freeCount() < count) {
+        return -1;
+    }
+    int start = bitmap.claimBestFit(count, allocCursor.load(std::memory_order_relaxed));
+    if (start == -1) {
+        return -1;
     }
+    fat.linkRun(start, count, -1);
+    allocCursor.store(start + count, std::memory_order_relaxed);
+    return start;
+}
 
-    return simplifiedPath.empty() ? "/" : simplifiedPath;
+int largestFreeExtent() {
+    return bitmap.largestFreeRun();
 }
 
-// 分配一个空闲块
-int allocateBlock() {
-    for (int i = 0; i < BLOCK_COUNT; ++i) {
-        if (!bitmap.test(i)) {
-            return i;
-        }
+// 释放从 firstBlock 开始的整条 FAT 链
+void releaseBlocks(int firstBlock) {
+    int block = firstBlock;
+    int blockCount = getBlockCount();
+    while (block >= 0 && block < blockCount) {
+        int nextBlock = fat[block];
+        // 释放的块不必再写回，释放提交之前它的新内容也不能写回；
+        // 记过日志的目录块重放时不能再覆盖它的新用途
+        blockCache.discard(block, journal.currentSequence());
+        journal.revoke(block);
+        bitmap.reset(block);
+        fat[block] = -1;
+        block = nextBlock;
     }
-    return -1;
 }
 
-// 保存索引节点信息到磁盘
-void saveInode(const std::string& path, const Inode& inode) {
-    std::string inodePath = config.realRootPath + "/inode/" + getFullPath(path).substr(config.realRootPath.length()) + ".inode";
-    QDir().mkpath(QFileInfo(QString::fromStdString(inodePath)).absolutePath());
-    std::ofstream inodeFile(inodePath, std::ios::binary);
-    if (inodeFile) {
-        inodeFile.write(reinterpret_cast<const char*>(&inode), sizeof(Inode));
-        if (!inodeFile) {
-            std::cerr << "Failed to write inode file: " << inodePath << std::endl;
-        }
-        inodeFile.close();
-    }
-    else {
-        std::cerr << "Failed to open inode file for writing: " << inodePath << std::endl;
-    }
+void attachMetadata() {
+    fat.attach(reinterpret_cast<int32_t*>(metadata.fatArea()), metadata.blockCount());
+    bitmap.attach(reinterpret_cast<uint64_t*>(metadata.bitmapArea()), metadata.blockCount());
+    inodeTable.attach(reinterpret_cast<DiskInode*>(metadata.inodeArea()), metadata.inodeCount());
 }
 
-// 从磁盘加载索引节点信息
-Inode loadInode(const std::string& path) {
-    Inode inode = { -1, 0, QDateTime(), QDateTime() }; // 默认初始化
-    std::string inodePath = config.realRootPath + "/inode/" + getFullPath(path).substr(config.realRootPath.length()) + ".inode";
-    std::ifstream inodeFile(inodePath, std::ios::binary);
-    if (inodeFile) {
-        // 检查文件大小
-        inodeFile.seekg(0, std::ios::end);
-        std::streamsize size = inodeFile.tellg();
-        inodeFile.seekg(0, std::ios::beg);
+int getBlockSize() {
+    return metadata.blockSize();
+}
 
-        if (size == sizeof(Inode)) {
-            inodeFile.read(reinterpret_cast<char*>(&inode), sizeof(Inode));
-            if (inodeFile.gcount() != sizeof(Inode)) {
-                std::cerr << "Failed to read inode file: " << inodePath << std::endl;
-            }
-        }
-        else {
-            std::cerr << "Inode file size is incorrect: " << inodePath << std::endl;
-        }
-        inodeFile.close();
+int getBlockCount() {
+    return metadata.blockCount();
+}
+
+int allocateInode() {
+    return inodeTable.allocate();
+}
+
+int64_t currentTimeNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+void encodeInode(const Inode& inode, DiskInode& record) {
+    record.version = INODE_VERSION;
+    record.mode = (inode.type == FileType::Directory ? MODE_DIRECTORY : MODE_FILE) | (inode.permissions & ~MODE_TYPE_MASK);
+    record.linkCount = inode.linkCount;
+    record.firstBlock = inode.firstBlock;
+    record.parent = inode.parent;
+    record.size = inode.size;
+    record.createTime = inode.createTime;
+    record.modifyTime = inode.modifyTime;
+    record.subtreeSize = inode.subtreeSize;
+    record.subtreeFiles = static_cast<int32_t>(inode.subtreeFiles);
+    record.subtreeInodes = static_cast<int32_t>(inode.subtreeInodes);
+    record.checksum = 0;
+    record.generation = inode.generation;
+}
+
+bool decodeInode(const DiskInode& record, Inode& inode) {
+    if (record.linkCount == 0 || record.version != INODE_VERSION || record.checksum != inodeChecksum(record)) {
+        return false;
     }
-    else {
-        std::cerr << "Failed to open inode file: " << inodePath << std::endl;
+    inode.type = (record.mode & MODE_TYPE_MASK) == MODE_DIRECTORY ? FileType::Directory : FileType::File;
+    inode.permissions = record.mode & ~MODE_TYPE_MASK;
+    inode.linkCount = record.linkCount;
+    inode.firstBlock = record.firstBlock;
+    inode.parent = record.parent;
+    inode.size = record.size;
+    inode.createTime = record.createTime;
+    inode.modifyTime = record.modifyTime;
+    inode.subtreeSize = record.subtreeSize;
+    inode.subtreeFiles = record.subtreeFiles;
+    inode.subtreeInodes = record.subtreeInodes;
+    inode.generation = record.generation;
+    return true;
+}
+
+// 保存索引节点信息（写入 inode 表中对应的记录）
+void saveInode(int ino, const Inode& inode) {
+    if (ino < 0 || ino >= inodeTable.size()) {
+        std::cerr << "Inode number out of range: " << ino << std::endl;
+        return;
+    }
+    DiskInode record;
+    encodeInode(inode, record);
+    inodeTable.put(ino, record);
+}
+
+// 加载索引节点信息
+Inode loadInode(int ino) {
+    Inode inode = { FileType::File, 0, 0, -1, -1, 0, 0, 0, 0, 0, 0, 0 }; // 默认初始化
+    if (ino < 0 || ino >= inodeTable.size() || !decodeInode(inodeTable.get(ino), inode)) {
+        std::cerr << "Invalid inode: " << ino << std::endl;
     }
     return inode;
 }
 
+// 删除索引节点，释放 inode 号
+void removeInode(int ino) {
+    if (ino >= 0 && ino < inodeTable.size()) {
+        inodeTable.release(ino);
+    }
+}
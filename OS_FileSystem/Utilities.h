@@ -1,17 +1,34 @@
 ﻿#pragma once
 #include <string>
+#include <string_view>
 #include <vector>
-#include <QDateTime> // Qt 时间类，用于记录文件信息
-#include <bitset>
+#include <cstdint>
+#include "Metadata.h"
+#include "VirtualPath.h"
+
+// 默认卷几何参数：1024个物理块，每块4096字节，格式化时可以指定
+const int DEFAULT_BLOCK_COUNT = 1024;
+const int DEFAULT_BLOCK_SIZE = 4096;
+// 默认块缓存容量：64MB
+const size_t DEFAULT_CACHE_SIZE = 64 << 20;
+// 默认日志组提交间隔：20 毫秒
+const int DEFAULT_COMMIT_INTERVAL_MS = 20;
 
 // 声明 Config 类
 class Config {
 public:
-    Config() : rootPath("/home"), realRootPath("/"), currentPath("/home") {}
+    Config() : rootPath("/home"), realRootPath("/"), currentPath("/home"),
+        blockSize(DEFAULT_BLOCK_SIZE), blockCount(DEFAULT_BLOCK_COUNT), cacheSize(DEFAULT_CACHE_SIZE),
+        commitIntervalMs(DEFAULT_COMMIT_INTERVAL_MS), forceFormat(false) {}
 public:
     std::string rootPath; // 虚拟根目录
-    std::string realRootPath; // 真实根目录
-    std::string currentPath; // 当前路径
+    std::string realRootPath; // 真实根目录（存放 meta.bin 和 disk.img 的宿主机目录）
+    std::string currentPath; // 当前路径（其他线程可能同时读取，用 setCurrentPath 修改）
+    int blockSize; // 格式化时的块大小
+    int blockCount; // 格式化时的块数量
+    size_t cacheSize; // 块缓存容量（字节）
+    int commitIntervalMs; // 日志组提交间隔（毫秒）
+    bool forceFormat; // 挂载时是否重新格式化
 };
 
 // 声明全局的 config 变量
@@ -27,9 +44,10 @@ enum class FileType {
 struct FileItem {
     std::string name;          // 名称（不含路径）
     FileType type;             // 类型（文件/目录）
-    qint64 size;               // 大小（字节，目录为0）
-    QDateTime createTime;      // 创建时间
-    QDateTime modifyTime;      // 修改时间
+    int64_t size;              // 大小（字节，目录为子树中所有文件的总大小）
+    int64_t fileCount;         // 文件数（目录为子树中的文件数，文件为 1）
+    int64_t createTime;        // 创建时间（纳秒时间戳）
+    int64_t modifyTime;        // 修改时间（纳秒时间戳）
     int inode;                 // 索引节点号
 };
 
@@ -39,34 +57,93 @@ struct Directory {
     std::vector<FileItem> items; // 子文件/目录列表
 };
 
-// 索引节点结构
+// 索引节点结构（内存中的形式，只含定长字段，与 DiskInode 互相转换不分配内存）
 struct Inode {
+    FileType type;             // 类型（文件/目录）
+    uint16_t permissions;      // 权限位
+    uint32_t linkCount;        // 链接数
     int firstBlock;            // 第一个物理块号
-    qint64 size;               // 文件大小
-    QDateTime createTime;      // 创建时间
-    QDateTime modifyTime;      // 修改时间
+    int parent;                // 所在目录的 inode 号
+    int64_t size;              // 文件大小
+    int64_t createTime;        // 创建时间（纳秒时间戳）
+    int64_t modifyTime;        // 修改时间（纳秒时间戳）
+    int64_t subtreeSize;       // 子树中所有文件的总大小（文件为自身大小）
+    int64_t subtreeFiles;      // 子树中的文件数（文件为 1）
+    int64_t subtreeInodes;     // 子树中的 inode 数（包括目录和自身）
+    uint32_t generation;       // inode 号的分配代数
 };
 
-// 假设文件系统总共有1024个物理块
-const int BLOCK_COUNT = 1024;
-using FAT = std::vector<int>;
-using Bitmap = std::bitset<BLOCK_COUNT>;
+// 每 4 个块配一个 inode
+const int BLOCKS_PER_INODE = 4;
+// FAT 表、位图和 inode 表都是元数据映射区上的视图
+using FAT = FatTable;
+using Bitmap = BlockBitmap;
 
-// 全局的FAT表和位图
+// 全局的FAT表、位图和inode表
 extern FAT fat;
 extern Bitmap bitmap;
+extern InodeTable inodeTable;
+
+// 将 FAT 表、位图和 inode 表挂接到元数据映射区
+void attachMetadata();
+
+// 当前卷的块大小和块数量（来自超级块）
+int getBlockSize();
+int getBlockCount();
 
-// 辅助函数：获取文件/目录的全路径
-std::string getFullPath(const std::string& relativePath);
+// 辅助函数：获取文件/目录的全路径（相对路径基于当前路径，结果已简化）。
+// 核心内部直接使用 fullPathOf，不产生中间字符串
+std::string getFullPath(std::string_view relativePath);
+
+// 把路径解析为规范化的全路径：绝对路径不读取当前路径；相对路径在读锁内以当前路径为基准
+// 直接解析进 VirtualPath 的缓冲区，不复制当前路径
+VirtualPath fullPathOf(std::string_view path);
 
 // 辅助函数：简化路径
-std::string simplifyPath(const std::string& path);
+std::string simplifyPath(std::string_view path);
+
+// 当前路径的副本和修改。当前路径属于命令行和图形界面，但文件系统的公开函数在工作线程中
+// 解析相对路径时也要读取，二者之间用锁保护
+std::string getCurrentPath();
+void setCurrentPath(const std::string& path);
+
+// 分配一个空闲块并在位图中置位，从 hint 开始查找（没有指定时接着上次分配的位置）。
+// 位图按组加锁，不同线程从不同的 hint 开始时落在不同的组，互不等待
+int allocateBlock(int hint = -1);
+
+// 分配 count 个块并在 FAT 中链接成一条以 -1 结尾的链，返回按链顺序排列的块号。
+// 优先紧接在 hint 之后连续分配，其次从 hint 所在的组起最佳适配一段足够长的空闲区，
+// 最后逐组取最长的空闲区拼接，索引中的空闲区用完后再拼接短碎片；
+// 空闲块不足时不分配任何块，返回空数组
+std::vector<int> allocateBlocks(int count, int hint = -1);
+
+// 分配 count 个连续块并链接（在各组的空闲区索引中最佳适配），返回首块号，
+// 没有足够长的连续空闲区时返回 -1（连续区不跨组，短于 BlockBitmap::MIN_INDEXED_RUN 的碎片不参与）
+int allocateExtent(int count);
+
+// 最大连续空闲区的块数，只剩短碎片时为 0
+int largestFreeExtent();
+
+// 释放从 firstBlock 开始的整条 FAT 链
+void releaseBlocks(int firstBlock);
+
+// 分配一个 inode 号，失败返回 -1
+int allocateInode();
+
+// 当前时间（纳秒时间戳）
+int64_t currentTimeNs();
+
+// 把 inode 编码为磁盘记录（填写版本号，校验和由 inode 表写入时计算）
+void encodeInode(const Inode& inode, DiskInode& record);
+
+// 把磁盘记录解码为 inode，记录未分配、版本不符或校验和错误时返回 false
+bool decodeInode(const DiskInode& record, Inode& inode);
 
-// 分配一个空闲块
-int allocateBlock();
+// 保存索引节点信息（写入 inode 表中对应的记录）
+void saveInode(int ino, const Inode& inode);
 
-// 保存索引节点信息到磁盘
-void saveInode(const std::string& path, const Inode& inode);
+// 加载索引节点信息
+Inode loadInode(int ino);
 
-// 从磁盘加载索引节点信息
-Inode loadInode(const std::string& path);
\ No newline at end of file
+// 删除索引节点，释放 inode 号
+void removeInode(int ino);
\ No newline at end of file
@@ -0,0 +1,92 @@
+﻿#include "VirtualPath.h"
+#include <cstring>
+
+VirtualPath::VirtualPath(std::string_view path, std::string_view base) {
+    bool absolute = !path.empty() && path[0] == '/';
+    // 每个组件最多输出一个 '/' 加组件本身，长度不会超过输入之和
+    size_t capacity = path.size() + (absolute ? 0 : base.size()) + 1;
+    if (capacity > INLINE_CAPACITY) {
+        heap_.resize(capacity);
+    }
+    if (!absolute) {
+        appendAll(base);
+    }
+    appendAll(path);
+}
+
+void VirtualPath::appendAll(std::string_view path) {
+    size_t begin = 0;
+    while (begin <= path.size()) {
+        size_t end = path.find('/', begin);
+        if (end == std::string_view::npos) {
+            end = path.size();
+        }
+        append(path.substr(begin, end - begin));
+        begin = end + 1;
+    }
+}
+
+void VirtualPath::append(std::string_view part) {
+    if (part.empty() || part == ".") {
+        return;
+    }
+    if (part == "..") {
+        if (depth_ > 0) {
+            --depth_;
+            length_ = start(depth_) - 1;
+        }
+        return;
+    }
+    char* data = buffer();
+    data[length_++] = '/';
+    setStart(depth_++, static_cast<uint32_t>(length_));
+    std::memcpy(data + length_, part.data(), part.size());
+    length_ += part.size();
+}
+
+void VirtualPath::setStart(size_t index, uint32_t offset) {
+    if (index < INLINE_DEPTH) {
+        starts_[index] = offset;
+        return;
+    }
+    index -= INLINE_DEPTH;
+    if (index < deepStarts_.size()) {
+        deepStarts_[index] = offset;
+    }
+    else {
+        deepStarts_.push_back(offset);
+    }
+}
+
+std::string_view VirtualPath::str() const {
+    return depth_ == 0 ? std::string_view("/") : std::string_view(buffer(), length_);
+}
+
+std::string_view VirtualPath::component(size_t index) const {
+    size_t begin = start(index);
+    size_t end = index + 1 < depth_ ? start(index + 1) - 1 : length_;
+    return std::string_view(buffer() + begin, end - begin);
+}
+
+std::string_view VirtualPath::name() const {
+    return depth_ == 0 ? std::string_view() : component(depth_ - 1);
+}
+
+std::string_view VirtualPath::parent() const {
+    return prefix(depth_ == 0 ? 0 : depth_ - 1);
+}
+
+std::string_view VirtualPath::prefix(size_t depth) const {
+    if (depth == 0) {
+        return std::string_view("/");
+    }
+    return std::string_view(buffer(), depth < depth_ ? start(depth) - 1 : length_);
+}
+
+bool VirtualPath::isWithin(std::string_view root) const {
+    std::string_view path = str();
+    if (root == "/" || path == root) {
+        return true;
+    }
+    return path.size() > root.size() && path.compare(0, root.size(), root) == 0 && path[root.size()] == '/';
+}
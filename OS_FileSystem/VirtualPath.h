@@ -0,0 +1,51 @@
+﻿#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// 规范化的虚拟路径："/a/b" 形式，已去掉 "."、".." 和多余的 '/'，根目录为 "/"。
+// 路径文本和各组件的位置放在对象内的定长缓冲区里，常见长度的路径解析时不分配堆内存；
+// 组件以 string_view 的形式指向内部缓冲区，对象析构后失效
+class VirtualPath {
+public:
+    // 以 base（绝对路径）为当前目录解析 path：绝对路径直接规范化，相对路径接在 base 之后，
+    // ".." 不会越过根目录
+    VirtualPath(std::string_view path, std::string_view base);
+
+    // 规范化后的全路径
+    std::string_view str() const;
+    std::string toString() const { return std::string(str()); }
+    bool isRoot() const { return depth_ == 0; }
+    // 组件个数，根目录为 0
+    size_t depth() const { return depth_; }
+    // 第 index 个组件
+    std::string_view component(size_t index) const;
+    // 最后一个组件，根目录返回空
+    std::string_view name() const;
+    // 父目录的全路径，根目录的父目录是它自己
+    std::string_view parent() const;
+    // 前 depth 个组件构成的全路径
+    std::string_view prefix(size_t depth) const;
+    // 是否等于 root 或位于 root 之下
+    bool isWithin(std::string_view root) const;
+
+private:
+    static const size_t INLINE_CAPACITY = 256;   // 内联缓冲区字节数
+    static const size_t INLINE_DEPTH = 32;       // 内联记录的组件个数
+
+    void append(std::string_view part);
+    void appendAll(std::string_view path);
+    char* buffer() { return heap_.empty() ? inline_ : &heap_[0]; }
+    const char* buffer() const { return heap_.empty() ? inline_ : heap_.data(); }
+    uint32_t start(size_t index) const { return index < INLINE_DEPTH ? starts_[index] : deepStarts_[index - INLINE_DEPTH]; }
+    void setStart(size_t index, uint32_t offset);
+
+    char inline_[INLINE_CAPACITY];
+    std::string heap_;                       // 超过内联容量时使用
+    uint32_t starts_[INLINE_DEPTH];          // 前 INLINE_DEPTH 个组件的起始偏移
+    std::vector<uint32_t> deepStarts_;       // 更深的组件的起始偏移
+    size_t length_ = 0;                      // 路径长度（根目录为 0）
+    size_t depth_ = 0;                       // 组件个数
+};
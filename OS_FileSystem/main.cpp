@@ -1,51 +1,31 @@
 ﻿#include "OS_FileSystem.h"
 #include <QtWidgets/QApplication>
-#include <fstream>
-#include <qfile.h>
-#include <filesystem.h>
-#include <iostream>
+#include "Utilities.h"
+#include <cstdlib>
 
-void loadFileSystem() {
-    // 初始化 FAT 表和位图（若文件不存在）
-    if (!QFile::exists("fat.bin") || !QFile::exists("bitmap.bin")) {
-        fat.assign(BLOCK_COUNT, -1); // 初始化为全 -1
-        bitmap.reset(); // 初始化为全 0（未使用）
-        formatFileSystem(); // 调用格式化函数创建初始文件
-    }
-    else {
-        // 从文件加载现有数据
-        std::ifstream fatFile("fat.bin", std::ios::binary);
-        if (fatFile) {
-            fat.resize(BLOCK_COUNT); // 确保 FAT 表大小正确
-            if (!fatFile.read(reinterpret_cast<char*>(fat.data()), fat.size() * sizeof(int))) {
-                std::cerr << "Failed to read FAT table from file." << std::endl;
-                fat.assign(BLOCK_COUNT, -1); // 初始化为全 -1
-            }
-            fatFile.close();
+int main(int argc, char* argv[])
+{
+    // 命令行参数：--format 重新格式化，--block-size / --block-count 指定格式化时的卷几何参数，
+    // --cache-mb 指定块缓存容量，--commit-ms 指定日志组提交间隔
+    // 卷在确认实际根路径后挂载
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--format") {
+            config.forceFormat = true;
+        }
+        else if (arg == "--block-size" && i + 1 < argc) {
+            config.blockSize = std::atoi(argv[++i]);
         }
-        else {
-            std::cerr << "Failed to open FAT table file." << std::endl;
-            fat.assign(BLOCK_COUNT, -1); // 初始化为全 -1
+        else if (arg == "--block-count" && i + 1 < argc) {
+            config.blockCount = std::atoi(argv[++i]);
         }
-        // 同理加载 bitmap
-        std::ifstream bitmapFile("bitmap.bin", std::ios::binary);
-        if (bitmapFile) {
-            if (!bitmapFile.read(reinterpret_cast<char*>(&bitmap), sizeof(bitmap))) {
-                std::cerr << "Failed to read bitmap from file." << std::endl;
-                bitmap.reset(); // 初始化为全 0
-            }
-            bitmapFile.close();
+        else if (arg == "--cache-mb" && i + 1 < argc) {
+            config.cacheSize = static_cast<size_t>(std::atoi(argv[++i])) << 20;
         }
-        else {
-            std::cerr << "Failed to open bitmap file." << std::endl;
-            bitmap.reset(); // 初始化为全 0
+        else if (arg == "--commit-ms" && i + 1 < argc) {
+            config.commitIntervalMs = std::atoi(argv[++i]);
         }
     }
-}
-
-int main(int argc, char* argv[])
-{
-    loadFileSystem();
     QApplication a(argc, argv);
     OS_FileSystem w;
     w.show();
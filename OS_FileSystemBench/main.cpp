@@ -0,0 +1,725 @@
+﻿#include "FileSystem.h"
+#include "FileHandle.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <new>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+// 基准测试：块分配、路径解析、inode 读写和元数据操作的吞吐量与延迟，
+// 每项输出 ops/sec、p50/p99 延迟和每次操作的堆分配次数，--json 时每项输出一行 JSON。
+// 另有少量正确性检查，失败时在标准错误输出原因，进程返回 1
+
+// 全局堆分配计数，替换全局 operator new 统计
+static std::atomic<long long> allocationCount{ 0 };
+
+void* operator new(std::size_t size) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+    return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    return std::malloc(size ? size : 1);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t& tag) noexcept {
+    return operator new(size, tag);
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { std::free(p); }
+
+// 一项基准测试的结果
+struct BenchResult {
+    std::string name;
+    long long ops = 0;
+    double seconds = 0;
+    double p50Ns = 0;
+    double p99Ns = 0;
+    double allocsPerOp = 0;
+};
+
+// 运行参数
+struct BenchOptions {
+    std::string filter;            // 只运行名称包含该子串的项
+    double scale = 1.0;            // 迭代次数倍率
+    int blockSize = DEFAULT_BLOCK_SIZE;
+    int blockCount = 1 << 18;
+    size_t cacheSize = DEFAULT_CACHE_SIZE;
+    bool json = false;
+    std::string label;             // 写入每行 JSON，便于跨提交对比
+};
+
+static BenchOptions options;
+
+// 失败的正确性检查项数，非 0 时进程返回 1
+static int checkFailures = 0;
+
+static bool selected(const std::string& name) {
+    return options.filter.empty() || name.find(options.filter) != std::string::npos;
+}
+
+// 名称以 prefix 开头的一组基准测试中是否可能有被选中的项
+static bool groupSelected(const std::string& prefix) {
+    return options.filter.empty() || prefix.find(options.filter) != std::string::npos
+        || options.filter.compare(0, prefix.size(), prefix) == 0;
+}
+
+static long long scaled(long long ops) {
+    return std::max(1LL, static_cast<long long>(ops * options.scale));
+}
+
+// 重新格式化并挂载基准测试卷
+static void freshVolume() {
+    config.forceFormat = true;
+    config.blockSize = options.blockSize;
+    config.blockCount = options.blockCount;
+    config.cacheSize = options.cacheSize;
+    setCurrentPath(config.rootPath);
+    mountFileSystem();
+}
+
+static void report(const BenchResult& result) {
+    double opsPerSec = result.seconds > 0 ? result.ops / result.seconds : 0.0;
+    if (options.json) {
+        std::cout << "{\"benchmark\":\"" << result.name << "\"";
+        if (!options.label.empty()) {
+            std::cout << ",\"label\":\"" << options.label << "\"";
+        }
+        std::cout << ",\"ops\":" << result.ops << ",\"seconds\":" << result.seconds
+            << ",\"ops_per_sec\":" << opsPerSec << ",\"p50_ns\":" << result.p50Ns
+            << ",\"p99_ns\":" << result.p99Ns << ",\"allocs_per_op\":" << result.allocsPerOp << "}" << std::endl;
+    }
+    else {
+        std::printf("%-28s %10lld %14.0f %10.0f %10.0f %10.2f\n", result.name.c_str(), result.ops,
+            opsPerSec, result.p50Ns, result.p99Ns, result.allocsPerOp);
+        std::fflush(stdout);
+    }
+}
+
+// 执行 ops 次 op(i)，逐次计时。计时缓冲区在计数开始前分配，不计入每次操作的分配次数
+static void measure(const std::string& name, long long ops, const std::function<void(long long)>& op) {
+    if (!selected(name)) {
+        return;
+    }
+    std::vector<int64_t> samples(static_cast<size_t>(ops));
+    long long allocationsBefore = allocationCount.load(std::memory_order_relaxed);
+    auto start = std::chrono::steady_clock::now();
+    for (long long i = 0; i < ops; ++i) {
+        auto begin = std::chrono::steady_clock::now();
+        op(i);
+        samples[static_cast<size_t>(i)] = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - begin).count();
+    }
+    BenchResult result;
+    result.name = name;
+    result.ops = ops;
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    result.allocsPerOp = static_cast<double>(allocationCount.load(std::memory_order_relaxed) - allocationsBefore) / ops;
+    std::sort(samples.begin(), samples.end());
+    result.p50Ns = static_cast<double>(samples[static_cast<size_t>((ops - 1) * 50 / 100)]);
+    result.p99Ns = static_cast<double>(samples[static_cast<size_t>((ops - 1) * 99 / 100)]);
+    report(result);
+}
+
+// threads 个线程同时各执行 opsPerThread 次 op(t, i)，t 为线程序号。
+// ops/sec 为全部线程的总吞吐量，延迟取全部线程的样本
+static void measureParallel(const std::string& name, int threads, long long opsPerThread,
+    const std::function<void(int, long long)>& op) {
+    if (!selected(name)) {
+        return;
+    }
+    std::vector<std::vector<int64_t>> samples(static_cast<size_t>(threads), std::vector<int64_t>(static_cast<size_t>(opsPerThread)));
+    std::vector<std::thread> workers;
+    workers.reserve(static_cast<size_t>(threads));
+    std::atomic<int> ready{ 0 };
+    std::atomic<bool> go{ false };
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t] {
+            std::vector<int64_t>& own = samples[static_cast<size_t>(t)];
+            ready++;
+            while (!go) {
+                std::this_thread::yield();
+            }
+            for (long long i = 0; i < opsPerThread; ++i) {
+                auto begin = std::chrono::steady_clock::now();
+                op(t, i);
+                own[static_cast<size_t>(i)] = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - begin).count();
+            }
+        });
+    }
+    while (ready < threads) {
+        std::this_thread::yield();
+    }
+    long long allocationsBefore = allocationCount.load(std::memory_order_relaxed);
+    auto start = std::chrono::steady_clock::now();
+    go = true;
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    BenchResult result;
+    result.name = name;
+    result.ops = opsPerThread * threads;
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    result.allocsPerOp = static_cast<double>(allocationCount.load(std::memory_order_relaxed) - allocationsBefore) / result.ops;
+    std::vector<int64_t> all;
+    all.reserve(static_cast<size_t>(result.ops));
+    for (const std::vector<int64_t>& own : samples) {
+        all.insert(all.end(), own.begin(), own.end());
+    }
+    std::sort(all.begin(), all.end());
+    result.p50Ns = static_cast<double>(all[static_cast<size_t>((result.ops - 1) * 50 / 100)]);
+    result.p99Ns = static_cast<double>(all[static_cast<size_t>((result.ops - 1) * 99 / 100)]);
+    report(result);
+}
+
+// 块分配：先随机占用 fillPercent% 的块，再逐块分配。
+// 直接操作位图和 FAT，全程持有文件系统锁，提交线程不会在中途写回它们
+static void benchAllocation() {
+    for (int fillPercent : { 0, 50, 90, 99 }) {
+        std::string name = "alloc/block/fill-" + std::to_string(fillPercent);
+        if (!selected(name)) {
+            continue;
+        }
+        freshVolume();
+        const int blockCount = getBlockCount();
+        std::vector<int> order(blockCount);
+        for (int i = 0; i < blockCount; ++i) {
+            order[i] = i;
+        }
+        std::shuffle(order.begin(), order.end(), std::mt19937(42));
+        int target = static_cast<int>(static_cast<int64_t>(blockCount) * fillPercent / 100);
+        runLocked([&] {
+            for (int i = 0, used = blockCount - bitmap.freeCount(); i < blockCount && used < target; ++i) {
+                if (!bitmap.test(order[i])) {
+                    bitmap.set(order[i]);
+                    fat[order[i]] = -1;
+                    ++used;
+                }
+            }
+            // 分配次数不超过剩余空闲块的一半，保持填充率基本不变
+            long long ops = std::min<long long>(scaled(20000), bitmap.freeCount() / 2);
+            measure(name, ops, [](long long) {
+                int block = allocateBlock();
+                fat[block] = -1;
+            });
+        });
+    }
+
+    std::string name = "alloc/chain-8/fill-50";
+    if (selected(name)) {
+        freshVolume();
+        runLocked([&] {
+            // 每隔一段占用一段，制造碎片
+            for (int block = 0; block + 16 <= getBlockCount() / 2; block += 16) {
+                bitmap.setRange(block, 5);
+            }
+            std::vector<int> heads;
+            long long ops = scaled(5000);
+            heads.reserve(static_cast<size_t>(ops));
+            measure(name, ops, [&](long long) {
+                std::vector<int> chain = allocateBlocks(8);
+                if (!chain.empty()) {
+                    heads.push_back(chain.front());
+                }
+            });
+            for (int head : heads) {
+                releaseBlocks(head);
+            }
+        });
+    }
+}
+
+// 路径解析
+static void benchPaths() {
+    setCurrentPath("/home/user/projects/os");
+    long long ops = scaled(200000);
+    measure("path/getFullPath/relative", ops, [](long long) {
+        std::string path = getFullPath("src/./core/../include/fs.h");
+        (void)path;
+    });
+    measure("path/getFullPath/absolute", ops, [](long long) {
+        std::string path = getFullPath("/home/user/docs/report.txt");
+        (void)path;
+    });
+    std::string deep;
+    for (int i = 0; i < 32; ++i) {
+        deep += "/level" + std::to_string(i) + (i % 4 == 3 ? "/.." : "") + (i % 5 == 0 ? "/." : "");
+    }
+    measure("path/simplifyPath/deep-32", ops, [&](long long) {
+        std::string path = simplifyPath(deep);
+        (void)path;
+    });
+    setCurrentPath(config.rootPath);
+}
+
+// inode 读写
+static void benchInodes() {
+    if (!groupSelected("inode/")) {
+        return;
+    }
+    freshVolume();
+    // 直接读写 inode 表，全程持有文件系统锁
+    runLocked([] {
+        std::vector<int> inodes;
+        for (int i = 0; i < 4096; ++i) {
+            int ino = allocateInode();
+            if (ino < 0) {
+                break;
+            }
+            Inode inode{};
+            inode.type = FileType::File;
+            inode.permissions = 0644;
+            inode.linkCount = 1;
+            inode.firstBlock = -1;
+            inode.parent = ROOT_INODE;
+            inode.createTime = inode.modifyTime = currentTimeNs();
+            inode.subtreeFiles = 1;
+            inode.subtreeInodes = 1;
+            inode.generation = inodeTable.get(ino).generation;
+            saveInode(ino, inode);
+            inodes.push_back(ino);
+        }
+        long long ops = scaled(500000);
+        std::mt19937 random(7);
+        std::vector<int> order(static_cast<size_t>(ops));
+        for (auto& ino : order) {
+            ino = inodes[random() % inodes.size()];
+        }
+        measure("inode/load", ops, [&](long long i) {
+            Inode inode = loadInode(order[static_cast<size_t>(i)]);
+            (void)inode;
+        });
+        measure("inode/save", ops, [&](long long i) {
+            int ino = order[static_cast<size_t>(i)];
+            Inode inode = loadInode(ino);
+            inode.modifyTime = i;
+            saveInode(ino, inode);
+        });
+    });
+}
+
+// 创建、重命名、删除文件
+static void benchMetadataOps() {
+    if (!groupSelected("meta/")) {
+        return;
+    }
+    freshVolume();
+    const std::string dir = config.rootPath + "/bench";
+    createDirectory(dir);
+    long long ops = std::min<long long>(scaled(20000), getBlockCount() / BLOCKS_PER_INODE / 2);
+    std::vector<std::string> names(static_cast<size_t>(ops));
+    std::vector<std::string> renamed(static_cast<size_t>(ops));
+    for (long long i = 0; i < ops; ++i) {
+        names[static_cast<size_t>(i)] = dir + "/file" + std::to_string(i);
+        renamed[static_cast<size_t>(i)] = dir + "/renamed" + std::to_string(i);
+    }
+    measure("meta/create", ops, [&](long long i) {
+        createFile(names[static_cast<size_t>(i)]);
+    });
+    measure("meta/lookup", ops, [&](long long i) {
+        lookupPath(names[static_cast<size_t>(i)]);
+    });
+    // 相对路径：以当前路径为基准解析
+    std::vector<std::string> relative(static_cast<size_t>(ops));
+    for (long long i = 0; i < ops; ++i) {
+        relative[static_cast<size_t>(i)] = "file" + std::to_string(i);
+    }
+    setCurrentPath(dir);
+    measure("meta/lookup/relative", ops, [&](long long i) {
+        lookupPath(relative[static_cast<size_t>(i)]);
+    });
+    setCurrentPath(config.rootPath);
+    measure("meta/rename", ops, [&](long long i) {
+        renameItem(names[static_cast<size_t>(i)], renamed[static_cast<size_t>(i)]);
+    });
+    measure("meta/delete", ops, [&](long long i) {
+        deleteItem(renamed[static_cast<size_t>(i)]);
+    });
+}
+
+// 宽目录和深目录的列举与查找
+static void benchDirectories() {
+    if (!groupSelected("dir/")) {
+        return;
+    }
+    freshVolume();
+    const std::string wide = config.rootPath + "/wide";
+    createDirectory(wide);
+    int wideEntries = static_cast<int>(std::min<long long>(scaled(10000), getBlockCount() / BLOCKS_PER_INODE / 2));
+    for (int i = 0; i < wideEntries; ++i) {
+        createFile(wide + "/entry" + std::to_string(i));
+    }
+    std::string deep = config.rootPath;
+    for (int i = 0; i < 64; ++i) {
+        deep += "/d" + std::to_string(i);
+        createDirectory(deep);
+        createFile(deep + "/file");
+    }
+    measure("dir/list/wide-" + std::to_string(wideEntries), scaled(50), [&](long long) {
+        Directory info = getDirectoryInfo(wide);
+        (void)info;
+    });
+    measure("dir/list/deep-64", scaled(20000), [&](long long) {
+        Directory info = getDirectoryInfo(deep);
+        (void)info;
+    });
+    measure("dir/lookup/deep-64", scaled(20000), [&](long long) {
+        lookupPath(deep + "/file");
+    });
+    measure("dir/subdirs/root", scaled(20000), [&](long long) {
+        std::vector<std::string> names = getSubdirectoryNames(config.rootPath);
+        (void)names;
+    });
+}
+
+// 数据读写：反复读取的小文件热集，以及比块缓存大的一次性顺序扫描是否会挤掉热集
+static void benchIo() {
+    if (!groupSelected("io/")) {
+        return;
+    }
+    freshVolume();
+    const std::string dir = config.rootPath + "/io";
+    createDirectory(dir);
+    const size_t smallSize = 4096;
+    int hotFiles = static_cast<int>(std::min<long long>(scaled(1024), getBlockCount() / BLOCKS_PER_INODE / 4));
+    std::vector<std::string> names(static_cast<size_t>(hotFiles));
+    std::string content(smallSize, 'x');
+    for (int i = 0; i < hotFiles; ++i) {
+        names[static_cast<size_t>(i)] = dir + "/config" + std::to_string(i);
+        createFile(names[static_cast<size_t>(i)]);
+        writeFileContent(names[static_cast<size_t>(i)], content);
+    }
+    // 冷文件取缓存容量的两倍，不超过卷容量的一半
+    const size_t chunk = 64 << 10;
+    size_t volumeBytes = static_cast<size_t>(getBlockCount()) * static_cast<size_t>(options.blockSize);
+    size_t coldSize = std::max(chunk, std::min(2 * std::max(options.cacheSize, chunk), volumeBytes / 2) / chunk * chunk);
+    const std::string cold = dir + "/cold";
+    createFile(cold);
+    writeFileContent(cold, std::string(coldSize, 'c'));
+    syncFileSystem();
+
+    std::mt19937 random(7);
+    std::vector<int> order(static_cast<size_t>(scaled(100000)));
+    for (int& index : order) {
+        index = static_cast<int>(random() % static_cast<unsigned>(hotFiles));
+    }
+    measure("io/read/hot-4k", static_cast<long long>(order.size()), [&](long long i) {
+        readFileRange(names[static_cast<size_t>(order[static_cast<size_t>(i)])], 0, smallSize);
+    });
+    long long chunks = static_cast<long long>(coldSize / chunk);
+    measure("io/scan/cold-64k", chunks, [&](long long i) {
+        readFileRange(cold, i * static_cast<long long>(chunk), chunk);
+    });
+    measure("io/read/hot-4k/after-scan", static_cast<long long>(order.size()), [&](long long i) {
+        readFileRange(names[static_cast<size_t>(order[static_cast<size_t>(i)])], 0, smallSize);
+    });
+    measure("io/write/hot-4k", static_cast<long long>(order.size()), [&](long long i) {
+        writeFileContent(names[static_cast<size_t>(order[static_cast<size_t>(i)])], content);
+    });
+    // 编辑保存：4 MB 文件中改一个字节，整体重写与只重写差异部分对比
+    const std::string edited = dir + "/edited";
+    std::string original(4 << 20, 'e');
+    createFile(edited);
+    writeFileContent(edited, original);
+    std::string changed = original;
+    measure("io/save/full-4m", scaled(200), [&](long long i) {
+        changed[static_cast<size_t>(i * 4099) % changed.size()] ^= 1;
+        writeFileContent(edited, changed);
+    });
+    std::string before = changed;
+    measure("io/save/diff-4m", scaled(200), [&](long long i) {
+        size_t position = static_cast<size_t>(i * 4099) % changed.size();
+        changed[position] ^= 1;
+        updateFileContent(edited, before, changed);
+        before[position] ^= 1;
+    });
+    measure("io/append/4k", scaled(20000), [&](long long) {
+        appendFile(edited, content);
+    });
+    if (!options.json && selected("io/")) {
+        const BlockCacheStats& stats = getCacheStats();
+        std::printf("%-28s hits %llu misses %llu evictions %llu writebacks %llu\n", "io/cache",
+            static_cast<unsigned long long>(stats.hits), static_cast<unsigned long long>(stats.misses),
+            static_cast<unsigned long long>(stats.evictions), static_cast<unsigned long long>(stats.writebacks));
+    }
+}
+
+// 流式句柄：4 KB 一次顺序写入、顺序读取大文件（预读和写缓冲合并），以及 4 KB 随机读
+static void benchStreaming() {
+    if (!groupSelected("stream/")) {
+        return;
+    }
+    freshVolume();
+    const size_t record = 4096;
+    size_t volumeBytes = static_cast<size_t>(getBlockCount()) * static_cast<size_t>(options.blockSize);
+    long long records = std::min<long long>(scaled(65536), static_cast<long long>(volumeBytes / 4 / record));
+    const std::string path = config.rootPath + "/stream";
+    std::vector<char> buffer(record, 's');
+    FileHandle file;
+    file.open(path, FileHandle::Read | FileHandle::Write | FileHandle::Create | FileHandle::Truncate);
+    measure("stream/write-4k", records, [&](long long) {
+        file.write(buffer.data(), record);
+    });
+    file.flush();
+    file.seek(0);
+    measure("stream/read-4k", records, [&](long long) {
+        file.read(buffer.data(), record);
+    });
+    std::mt19937 random(11);
+    measure("stream/random-read-4k", std::min(records, scaled(20000)), [&](long long) {
+        file.seek(static_cast<int64_t>(random() % static_cast<unsigned>(records)) * static_cast<int64_t>(record));
+        file.read(buffer.data(), record);
+    });
+    file.close();
+}
+
+// 正确性检查：干净的卷上一致性检查不应报告问题
+static void expectClean(const std::string& name, const FsckReport& report) {
+    if (report.clean() && report.repairs == 0) {
+        return;
+    }
+    checkFailures++;
+    std::cerr << name << ": FAILED, " << report.problems() << " problems, " << report.repairs << " repairs" << std::endl;
+    for (const std::string& message : report.messages) {
+        std::cerr << "  " << message << std::endl;
+    }
+}
+
+// 回归检查：块大小不是目录项大小整数倍的卷上目录项会跨块。现在格式化时已经拒绝这样的块大小，
+// 但早先格式化的卷仍然可以挂载，这里格式化后在根目录还是空的时候改写超级块中的块大小来模拟。
+// 一致性检查不应报告问题，修复也不应改动任何东西
+static void checkOddBlockSize() {
+    const std::string name = "fsck/odd-block-size";
+    if (!selected(name)) {
+        return;
+    }
+    const std::string volumeRoot = config.realRootPath;
+    const std::string rootPath = config.rootPath;
+    config.realRootPath = volumeRoot + "/odd-block-size";
+    config.rootPath = "/";
+    std::error_code error;
+    std::filesystem::create_directories(config.realRootPath, error);
+    config.forceFormat = true;
+    config.blockSize = 512;
+    config.blockCount = 1024;
+    setCurrentPath("/");
+    bool ok = mountFileSystem();
+    // 卸载时做了检查点，此后根目录的数据块里还没有内容，只改块大小卷仍然一致
+    unmountFileSystem();
+    metadata.superblock().blockSize = 100;
+    metadata.markSuperblockDirty();
+    ok = ok && metadata.sync();
+    config.forceFormat = false;
+    ok = ok && mountFileSystem() && getBlockSize() == 100;
+    ok = ok && createDirectory("/d");
+    for (const char* file : { "/d/a", "/d/b", "/d/c" }) {
+        ok = ok && createFile(file) && writeFileContent(file, std::string(250, file[3]));
+    }
+    if (!ok) {
+        checkFailures++;
+        std::cerr << name << ": FAILED to set up the volume" << std::endl;
+    }
+    else {
+        expectClean(name, checkFileSystem(false));
+        expectClean(name + "/repair", checkFileSystem(true));
+        if (readFileContent("/d/b") != std::string(250, 'b')) {
+            checkFailures++;
+            std::cerr << name << ": FAILED, /d/b changed after repair" << std::endl;
+        }
+        expectClean(name + "/after-repair", checkFileSystem(false));
+    }
+    if (!options.json) {
+        std::printf("%-28s %s\n", name.c_str(), checkFailures == 0 ? "ok" : "FAILED");
+    }
+    config.realRootPath = volumeRoot;
+    config.rootPath = rootPath;
+}
+
+// 一致性检查：单线程与全部硬件线程对比，计时前先确认检查结果是干净的
+static void benchCheck() {
+    if (!groupSelected("fsck/")) {
+        return;
+    }
+    freshVolume();
+    int files = static_cast<int>(std::min<long long>(scaled(20000), getBlockCount() / BLOCKS_PER_INODE / 2));
+    const std::string content(3 * static_cast<size_t>(options.blockSize) / 2, 'f');
+    for (int i = 0; i < files; ++i) {
+        std::string dir = config.rootPath + "/fsck" + std::to_string(i / 256);
+        if (i % 256 == 0) {
+            createDirectory(dir);
+        }
+        std::string path = dir + "/file" + std::to_string(i);
+        createFile(path);
+        writeFileContent(path, content);
+    }
+    if (selected("fsck/check")) {
+        expectClean("fsck/check", checkFileSystem(false));
+    }
+    int threads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    for (int count : { 1, threads }) {
+        measure("fsck/check-" + std::to_string(count) + "t", scaled(10), [&](long long) {
+            checkFileSystem(false, count);
+        });
+        if (threads == 1) {
+            break;
+        }
+    }
+}
+
+// 多线程：1、2、4……直到硬件线程数个线程同时查找路径、列目录、读取热文件，
+// 以及各自写自己的文件、在自己的目录中创建和删除文件。各线程只锁自己的目录和文件，都应随核数线性增长
+// （写入类的还受组提交的 fsync 限制）
+static void benchConcurrency() {
+    if (!groupSelected("mt/")) {
+        return;
+    }
+    freshVolume();
+    int hardware = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    std::vector<int> counts;
+    for (int count = 1; count < hardware; count *= 2) {
+        counts.push_back(count);
+    }
+    counts.push_back(hardware);
+    // 每个线程一棵 8 层深的目录，末端 64 个 4 KB 文件
+    const int filesPerThread = 64;
+    const std::string content(4096, 'm');
+    std::vector<std::vector<std::string>> files(static_cast<size_t>(hardware));
+    std::vector<std::vector<std::string>> relativeFiles(static_cast<size_t>(hardware)); // 相对于根路径
+    std::vector<std::vector<FileId>> inodes(static_cast<size_t>(hardware));
+    std::vector<std::string> leaves(static_cast<size_t>(hardware));
+    for (int t = 0; t < hardware; ++t) {
+        std::string dir = config.rootPath + "/mt" + std::to_string(t);
+        for (int depth = 0; depth < 8; ++depth) {
+            dir += "/d" + std::to_string(depth);
+        }
+        createDirectory(dir);
+        leaves[static_cast<size_t>(t)] = dir;
+        for (int i = 0; i < filesPerThread; ++i) {
+            std::string path = dir + "/f" + std::to_string(i);
+            createFile(path);
+            writeFileContent(path, content);
+            files[static_cast<size_t>(t)].push_back(path);
+            relativeFiles[static_cast<size_t>(t)].push_back(path.substr(config.rootPath.size() + 1));
+            inodes[static_cast<size_t>(t)].push_back(lookupFileId(path));
+        }
+    }
+    syncFileSystem();
+    long long ops = scaled(50000);
+    for (int count : counts) {
+        std::string suffix = "-" + std::to_string(count) + "t";
+        measureParallel("mt/lookup" + suffix, count, ops, [&](int t, long long i) {
+            lookupPath(files[static_cast<size_t>(t)][static_cast<size_t>(i % filesPerThread)]);
+        });
+        // 各线程同时读取当前路径解析相对路径
+        measureParallel("mt/lookup-relative" + suffix, count, ops, [&](int t, long long i) {
+            lookupPath(relativeFiles[static_cast<size_t>(t)][static_cast<size_t>(i % filesPerThread)]);
+        });
+        measureParallel("mt/list" + suffix, count, scaled(5000), [&](int t, long long) {
+            Directory info = getDirectoryInfo(leaves[static_cast<size_t>(t)]);
+            (void)info;
+        });
+        measureParallel("mt/read-4k" + suffix, count, ops, [&](int t, long long i) {
+            char buffer[4096];
+            readFileAt(inodes[static_cast<size_t>(t)][static_cast<size_t>(i % filesPerThread)], 0, buffer, sizeof(buffer));
+        });
+        long long creates = std::min<long long>(scaled(2000), getBlockCount() / BLOCKS_PER_INODE / 4 / hardware / static_cast<long long>(counts.size()));
+        measureParallel("mt/write-4k" + suffix, count, scaled(5000), [&](int t, long long i) {
+            writeFileAt(inodes[static_cast<size_t>(t)][static_cast<size_t>(i % filesPerThread)], 0, content.data(), content.size());
+        });
+        measureParallel("mt/create" + suffix, count, std::max(1LL, creates), [&](int t, long long i) {
+            createFile(leaves[static_cast<size_t>(t)] + "/c" + std::to_string(count) + "-" + std::to_string(i));
+        });
+        measureParallel("mt/delete" + suffix, count, std::max(1LL, creates), [&](int t, long long i) {
+            deleteItem(leaves[static_cast<size_t>(t)] + "/c" + std::to_string(count) + "-" + std::to_string(i));
+        });
+    }
+}
+
+static void printUsage() {
+    std::cerr << "Usage: OS_FileSystemBench [--root DIR] [--json] [--label TEXT] [--filter SUBSTR]\n"
+                 "                          [--scale X] [--block-size N] [--block-count N]\n"
+                 "                          [--cache-mb N]\n"
+                 "The volume in DIR (default <temp>/OS_FileSystemBench) is formatted repeatedly.\n";
+}
+
+int main(int argc, char* argv[])
+{
+    // 默认放在系统临时目录下，避免在工作目录里留下上 GB 的磁盘镜像
+    std::error_code error;
+    std::filesystem::path tempDir = std::filesystem::temp_directory_path(error);
+    config.realRootPath = ((error ? std::filesystem::path(".") : tempDir) / "OS_FileSystemBench").string();
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--root" && i + 1 < argc) {
+            config.realRootPath = argv[++i];
+        }
+        else if (arg == "--json") {
+            options.json = true;
+        }
+        else if (arg == "--label" && i + 1 < argc) {
+            options.label = argv[++i];
+        }
+        else if (arg == "--filter" && i + 1 < argc) {
+            options.filter = argv[++i];
+        }
+        else if (arg == "--scale" && i + 1 < argc) {
+            options.scale = std::atof(argv[++i]);
+        }
+        else if (arg == "--block-size" && i + 1 < argc) {
+            options.blockSize = std::atoi(argv[++i]);
+        }
+        else if (arg == "--block-count" && i + 1 < argc) {
+            options.blockCount = std::atoi(argv[++i]);
+        }
+        else if (arg == "--cache-mb" && i + 1 < argc) {
+            options.cacheSize = static_cast<size_t>(std::atoi(argv[++i])) << 20;
+        }
+        else {
+            printUsage();
+            return 2;
+        }
+    }
+    std::filesystem::create_directories(config.realRootPath, error);
+    if (error) {
+        std::cerr << "Failed to create " << config.realRootPath << ": " << error.message() << std::endl;
+        return 1;
+    }
+
+    if (!options.json) {
+        std::printf("%-28s %10s %14s %10s %10s %10s\n", "benchmark", "ops", "ops/sec", "p50(ns)", "p99(ns)", "allocs/op");
+    }
+    benchAllocation();
+    benchPaths();
+    benchInodes();
+    benchMetadataOps();
+    benchDirectories();
+    benchIo();
+    benchStreaming();
+    benchCheck();
+    checkOddBlockSize();
+    benchConcurrency();
+    unmountFileSystem();
+    return checkFailures == 0 ? 0 : 1;
+}
@@ -0,0 +1,179 @@
+﻿#include "CommandProcessor.h"
+#include "FileSystem.h"
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cerrno>
+#include <climits>
+#include <algorithm>
+
+// 命令行版文件系统：命令来自 -c 参数、脚本文件或标准输入，
+// 批处理模式下每条命令输出一行 JSON 结果，最后输出吞吐量汇总
+
+static void printUsage() {
+    std::cerr << "Usage: OS_FileSystemCli [--root DIR] [--format] [--block-size N] [--block-count N]\n"
+                 "                        [--cache-mb N] [--commit-ms N] [--batch] [-c COMMAND]... [--script FILE]\n"
+                 "Commands are read from -c, the script file, or standard input.\n";
+}
+
+// 解析整数参数，整个字符串都是数字且在 int 范围内时返回 true
+static bool parseInt(const char* text, int& value) {
+    char* end = nullptr;
+    errno = 0;
+    long parsed = std::strtol(text, &end, 10);
+    if (end == text || *end != '\0' || errno == ERANGE || parsed < INT_MIN || parsed > INT_MAX) {
+        return false;
+    }
+    value = static_cast<int>(parsed);
+    return true;
+}
+
+// JSON 字符串转义
+static std::string jsonString(const std::string& text) {
+    std::string result = "\"";
+    for (unsigned char c : text) {
+        switch (c) {
+        case '"': result += "\\\""; break;
+        case '\\': result += "\\\\"; break;
+        case '\n': result += "\\n"; break;
+        case '\r': result += "\\r"; break;
+        case '\t': result += "\\t"; break;
+        default:
+            if (c < 0x20) {
+                char buffer[8];
+                std::snprintf(buffer, sizeof(buffer), "\\u%04x", c);
+                result += buffer;
+            }
+            else {
+                result += static_cast<char>(c);
+            }
+        }
+    }
+    return result + "\"";
+}
+
+int main(int argc, char* argv[])
+{
+    config.realRootPath = ".";
+    bool batch = false;
+    std::vector<std::string> commands;
+    std::string scriptPath;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--root" && i + 1 < argc) {
+            config.realRootPath = argv[++i];
+        }
+        else if (arg == "--format") {
+            config.forceFormat = true;
+        }
+        else if ((arg == "--block-size" || arg == "--block-count") && i + 1 < argc) {
+            int& value = arg == "--block-size" ? config.blockSize : config.blockCount;
+            if (!parseInt(argv[++i], value)) {
+                std::cerr << "Invalid value for " << arg << ": " << argv[i] << std::endl;
+                return 2;
+            }
+        }
+        else if (arg == "--cache-mb" && i + 1 < argc) {
+            config.cacheSize = static_cast<size_t>(std::atoi(argv[++i])) << 20;
+        }
+        else if (arg == "--commit-ms" && i + 1 < argc) {
+            config.commitIntervalMs = std::atoi(argv[++i]);
+        }
+        else if (arg == "--batch") {
+            batch = true;
+        }
+        else if (arg == "-c" && i + 1 < argc) {
+            commands.push_back(argv[++i]);
+        }
+        else if (arg == "--script" && i + 1 < argc) {
+            scriptPath = argv[++i];
+        }
+        else {
+            printUsage();
+            return 2;
+        }
+    }
+    // 几何参数只在格式化时使用，但写错了总是提前报告
+    if (!MetadataRegion::checkGeometry(config.blockSize, config.blockCount, std::max(1, config.blockCount / BLOCKS_PER_INODE))) {
+        return 2;
+    }
+    if (!mountFileSystem()) {
+        std::cerr << "Failed to mount file system in " << config.realRootPath << std::endl;
+        return 1;
+    }
+
+    std::ifstream script;
+    if (!scriptPath.empty()) {
+        script.open(scriptPath);
+        if (!script) {
+            std::cerr << "Failed to open script: " << scriptPath << std::endl;
+            return 1;
+        }
+    }
+    std::istream& input = script.is_open() ? static_cast<std::istream&>(script) : std::cin;
+    bool fromInput = commands.empty() || script.is_open();
+
+    CommandProcessor processor;
+    long long lineNumber = 0;
+    long long executed = 0;
+    long long failed = 0;
+    auto start = std::chrono::steady_clock::now();
+    auto run = [&](const std::string& line) {
+        ++lineNumber;
+        std::string name = CommandProcessor::commandName(line);
+        if (name.empty() || name[0] == '#') {
+            return;
+        }
+        auto begin = std::chrono::steady_clock::now();
+        CommandResult result = processor.execute(line);
+        auto micros = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - begin).count();
+        ++executed;
+        if (!result.ok) {
+            ++failed;
+        }
+        if (batch) {
+            std::cout << "{\"line\":" << lineNumber << ",\"command\":" << jsonString(name)
+                << ",\"ok\":" << (result.ok ? "true" : "false") << ",\"us\":" << micros;
+            if (!result.output.empty()) {
+                std::cout << ",\"output\":" << jsonString(result.output);
+            }
+            if (!result.ok) {
+                std::cout << ",\"error\":" << jsonString(result.error);
+            }
+            std::cout << "}\n";
+        }
+        else if (result.ok) {
+            std::cout << result.output;
+            if (!result.output.empty() && result.output.back() != '\n') {
+                std::cout << '\n';
+            }
+        }
+        else {
+            std::cerr << "error: " << result.error << std::endl;
+        }
+    };
+
+    for (const std::string& command : commands) {
+        run(command);
+    }
+    if (fromInput) {
+        std::string line;
+        while (std::getline(input, line)) {
+            if (!line.empty() && line.back() == '\r') {
+                line.pop_back();
+            }
+            run(line);
+        }
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (batch) {
+        std::cout << "{\"summary\":true,\"commands\":" << executed << ",\"failed\":" << failed
+            << ",\"seconds\":" << seconds << ",\"ops_per_sec\":" << (seconds > 0 ? executed / seconds : 0.0) << "}\n";
+    }
+    // 提交日志并做检查点
+    unmountFileSystem();
+    return failed == 0 ? 0 : 1;
+}